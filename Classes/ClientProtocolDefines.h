@@ -1,11 +1,19 @@
 #ifndef LOSEMYMIND_CLIENTPROTOCOLDEFINES_H
 #define LOSEMYMIND_CLIENTPROTOCOLDEFINES_H
 
+#include <string>
 #include "FoundationKit/Base/Types.h"
+#include "Networking/ProtocolMessage.h"
 USING_NS_FK;
 
 #define  CLIENT_LOGIN  1000
 #define  CLIENT_CHAT  1001
 
+// 聊天消息，64字节以内的消息解码时不分配内存
+struct ClientChatMessage
+{
+    SmallString<64> msg;
+    DECLARE_PROTOCOL_MESSAGE(CLIENT_CHAT, msg)
+};
 
 #endif // LOSEMYMIND_CLIENTPROTOCOLDEFINES_H
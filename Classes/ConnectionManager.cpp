@@ -6,14 +6,26 @@
 #include <functional>
 #include "FoundationKit/Base/MathEx.h"
 #include "FoundationKit/Base/DataStream.h"
+#include "FoundationKit/Base/FrameArena.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/Timer.h"
 #include "FoundationKit/Foundation/unique_id.hpp"
+#include "FoundationKit/Foundation/FrameProfiler.h"
 #include "Networking/IProtocol.h"
 
 #define LISTENSERVER_DEFAULT_PORT 4159
 #define LISTENSERVER_DEFAULT_ENDPOINT IPv4Endpoint(IPv4Address(127, 0, 0, 1), LISTENSERVER_DEFAULT_PORT)
 
+// ͳƣ̷߳ƬѭۼӲ
+static Counter g_connectionsAccepted = Metrics::counter("viserver_connections_accepted_total", "Client connections accepted.");
+static Counter g_connectionsClosed = Metrics::counter("viserver_connections_closed_total", "Client connections closed.");
+static Gauge   g_connectionsOpen = Metrics::gauge("viserver_connections_open", "Client connections currently open.");
+static Counter g_bytesReceived = Metrics::counter("viserver_bytes_received_total", "Bytes received from clients.");
+static Counter g_packetsReceived = Metrics::counter("viserver_packets_received_total", "Reads from client sockets that returned data.");
+
 ConnectionManager::ConnectionManager()
     :_tcpListener(nullptr)
+    , _addClientMutex("connection_clients")
     , _bStartup(false)
 {
 
@@ -45,21 +57,33 @@ void ConnectionManager::Shutdown()
 {
     _tcpListener->Stop();
     SAFE_DELETE(_tcpListener);
-    for (auto iter : _clients)
+    std::lock_guard<ProfiledMutex> lockClient(_addClientMutex);
+    for (auto& iter : _clients)
     {
         SAFE_DELETE(iter.second);
     }
+    g_connectionsClosed.increment((int64)_clients.size());
+    _clients.clear();
+    g_connectionsOpen.set(0);
     _bStartup = false;
 }
 
 // ղͻϢ
 void ConnectionManager::update(float deltaTime)
 {
-    std::unique_lock<std::mutex> uniqueLock(_addClientMutex);
-    ClientMap  tempClients = _clients;
+    PROFILE_SCOPE("ConnectionManager::update");
+    // ͻбĿշ֡ڴϣ֡ʱVIServer::updateͳһͷš
+    FrameArena& frameArena = FrameArena::getThreadArena();
+    typedef std::pair<uint64, Socket*> ClientEntry;
+    FrameVector<ClientEntry> tempClients((FrameAllocator<ClientEntry>(frameArena)));
+    std::unique_lock<ProfiledMutex> uniqueLock(_addClientMutex);
+    tempClients.reserve(_clients.size());
+    tempClients.insert(tempClients.end(), _clients.begin(), _clients.end());
     uniqueLock.unlock();
 
-    for (auto clientPair : tempClients)
+    // пͻ˹һDataStreamresetḴĻ
+    DataStream dataStream;
+    for (auto& clientPair : tempClients)
     {
         Socket *client = clientPair.second;
         uint32 dataSize = 0;
@@ -69,15 +93,29 @@ void ConnectionManager::update(float deltaTime)
             // ͻǷпɶȡ
             if (client->HasPendingData(dataSize))
             {
-                std::vector<uint8> datagram(MathEx::min(dataSize, 65507u));
+                uint32 datagramSize = MathEx::min(dataSize, 65507u);
+                // DataStream::resetḴݣпͻ˹һջ
+                if (_receiveBuffer.size() < datagramSize)
+                    _receiveBuffer.resize(datagramSize);
+                uint8* datagram = _receiveBuffer.data();
                 int32 bytesRead = 0;
                 // 
-                if (client->Recv(datagram.data(), datagram.size(), bytesRead))
+                bool received = false;
+                {
+                    PROFILE_SCOPE("ConnectionManager::recv");
+                    received = client->Recv(datagram, datagramSize, bytesRead);
+                }
+                if (received)
                 {
+                    // ¼յʱ䣬Ӧʱͳƶ˵˺ʱ
+                    client->MarkRequestReceived(Timer::nowNanoseconds());
+                    g_packetsReceived.increment();
+                    g_bytesReceived.increment(bytesRead);
                     // ַЭ
-                    DataStream dataStream;
-                    dataStream.reset(datagram.data(), datagram.size());
-                    IProtocol::DispathStreamProtocol(clientPair.first, dataStream);
+                    dataStream.reset(datagram, bytesRead);
+                    PROFILE_SCOPE("ConnectionManager::dispatch");
+                    // ϴ׷ģظʱ¼ͽ׶
+                    IProtocol::DispathStreamProtocol(clientPair.first, dataStream, &client->GetRequestTrace());
                 }
             }
             else
@@ -96,26 +134,59 @@ void ConnectionManager::update(float deltaTime)
 // ͻӽ
 bool ConnectionManager::HandleListenerConnectionAccepted(Socket* ClientSocket, const IPv4Endpoint& ClientEndpoint)
 {
-    std::lock_guard<std::mutex>   lockClient(_addClientMutex);
+    std::lock_guard<ProfiledMutex>   lockClient(_addClientMutex);
     _clients.insert(std::make_pair(unique_id::create(), ClientSocket));
+    g_connectionsAccepted.increment();
+    g_connectionsOpen.set((int64)_clients.size());
     return true;
 }
 
 // ͻ˶Ͽ
 void ConnectionManager::HandleClientDisconnected(uint64 clientId)
 {
-    std::lock_guard<std::mutex>   lockClient(_addClientMutex);
+    Socket* clientSocket = nullptr;
+    std::unique_lock<ProfiledMutex> uniqueLock(_addClientMutex);
     auto iterFind = _clients.find(clientId);
     if (iterFind != _clients.end())
     {
-        _clients.erase(clientId);
+        clientSocket = iterFind->second;
+        _clients.erase(iterFind);
+        g_connectionsClosed.increment();
+        g_connectionsOpen.set((int64)_clients.size());
+    }
+    uniqueLock.unlock();
+    // ѾӱƳͷSocketرյײӣ
+    SAFE_DELETE(clientSocket);
+}
+
+// ȡӵϢ
+void ConnectionManager::getConnectionInfos(std::vector<ConnectionInfo>& out)
+{
+    // ֻӱѯԶ˵ַϵͳãŵ⡣
+    // Socket ֻ߳ɾǰȫġ
+    std::vector<std::pair<uint64, Socket*> > clients;
+    std::unique_lock<ProfiledMutex> uniqueLock(_addClientMutex);
+    clients.reserve(_clients.size());
+    clients.insert(clients.end(), _clients.begin(), _clients.end());
+    uniqueLock.unlock();
+
+    InternetAddrBSD peerAddress;
+    for (auto& clientPair : clients)
+    {
+        ConnectionInfo info;
+        info.clientId = clientPair.first;
+        if (clientPair.second->GetPeerAddress(peerAddress))
+            info.peer = peerAddress.ToString(true);
+        info.description = clientPair.second->GetDescription();
+        info.state = clientPair.second->GetConnectionState();
+        out.push_back(info);
     }
 }
 
 // ݿͻIDؿͻ˶
 Socket* ConnectionManager::getClientByID(uint64 clientId)
 {
-    std::lock_guard<std::mutex>   lockClient(_addClientMutex);
+    std::lock_guard<ProfiledMutex>   lockClient(_addClientMutex);
     auto iterFind = _clients.find(clientId);
     if (iterFind != _clients.end())
     {
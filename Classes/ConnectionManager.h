@@ -3,10 +3,12 @@
 #include <mutex>
 #include <list>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <functional>
 #include "FoundationKit/GenericPlatformMacros.h"
 #include "FoundationKit/Foundation/Singleton.h"
+#include "FoundationKit/Base/FlatHashMap.h"
+#include "FoundationKit/Base/ProfiledMutex.h"
 #include "Networking/TcpListener.h"
 #include "Networking/IPv4Address.h"
 #include "Networking/IPv4Endpoint.h"
@@ -14,13 +16,23 @@
 
 USING_NS_FK;
 
+// ӱһӵϢڵӿ
+struct ConnectionInfo
+{
+    uint64                 clientId;
+    std::string            peer;
+    std::string            description;
+    ESocketConnectionState state;
+};
 
 class ConnectionManager : public Singleton<ConnectionManager>
 {
     ConnectionManager();
     friend Singleton<ConnectionManager>;
 public:
-    typedef std::unordered_map<uint64, Socket*>   ClientMap;
+    // Ӽ¼ƽڿѰַĹϣûڵķ䣬
+    // ʱһαȽ16ֽڡ
+    typedef FlatHashMap<uint64, Socket*> ClientMap;
 
     ~ConnectionManager();
 
@@ -43,12 +55,18 @@ public:
     // ݿͻIDؿͻ˶
     Socket* getClientByID(uint64 clientId);
 
+    // ȡӵϢ̵ֻ߳
+    void getConnectionInfos(std::vector<ConnectionInfo>& out);
+
 protected:
 
     // TCP Ӽͻӡ
     TcpListener*           _tcpListener;
     ClientMap              _clients;
-    std::mutex             _addClientMutex;
+    // ߳̽Ӻ̸߳¶ҪProfiledMutexͳá
+    ProfiledMutex          _addClientMutex;
+    // ߳հõĻݱٷ䡣
+    std::vector<uint8>     _receiveBuffer;
 
     bool                   _bStartup;
 };
@@ -0,0 +1,85 @@
+#ifndef LOSEMYMIND_DATASTREAMBENCHMARK_H
+#define LOSEMYMIND_DATASTREAMBENCHMARK_H
+
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "FoundationKit/Base/DataStream.h"
+
+USING_NS_FK;
+
+/**
+ * Compares serialising one composite message piecewise with operator<< and
+ * with writeAll(), each into a fresh DataStream as a reply would be.
+ *
+ * Buffer allocations per message are counted from the capacity changes: the
+ * piecewise run checks the capacity after every field, writeAll() is
+ * checked to reserve exactly the bytes it then writes, so it cannot regrow
+ * after its one reserve().
+ */
+void BenchmarkDataStreamWrite(uint32 messages = 200000)
+{
+    typedef std::chrono::steady_clock clock;
+    const int32 protocolId = 1001;
+    const uint64 clientId = 4611;
+    const std::string name = "losemymind";
+    std::vector<int32> items(24, 7);
+    std::map<int32, std::string> attributes;
+    for (int32 i = 0; i < 8; ++i)
+    {
+        attributes[i] = "attribute value";
+    }
+
+    uint64 piecewiseAllocations = 0;
+    size_t bytes = 0;
+    clock::time_point start = clock::now();
+    for (uint32 i = 0; i < messages; ++i)
+    {
+        DataStream stream;
+        size_t capacity = stream.getBuffer().capacity();
+        auto track = [&]()
+        {
+            if (stream.getBuffer().capacity() != capacity)
+            {
+                capacity = stream.getBuffer().capacity();
+                ++piecewiseAllocations;
+            }
+        };
+        stream << protocolId; track();
+        stream << clientId; track();
+        stream << name; track();
+        stream << items; track();
+        stream << attributes; track();
+        bytes = stream.size();
+    }
+    double piecewiseSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    uint64 writeAllAllocations = 0;
+    bool exact = true;
+    start = clock::now();
+    for (uint32 i = 0; i < messages; ++i)
+    {
+        DataStream stream;
+        size_t capacity = stream.getBuffer().capacity();
+        stream.writeAll(protocolId, clientId, name, items, attributes);
+        if (stream.getBuffer().capacity() != capacity)
+            ++writeAllAllocations;
+        exact = exact && stream.size() == DataStream::measure(protocolId, clientId, name, items, attributes);
+    }
+    double writeAllSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    printf("BenchmarkDataStreamWrite: %u bytes per message, operator<< %.2f allocations %.0fns, writeAll %.2f allocations %.0fns, measure %s\n"
+        , (uint32)bytes
+        , (double)piecewiseAllocations / messages, piecewiseSeconds * 1e9 / messages
+        , (double)writeAllAllocations / messages, writeAllSeconds * 1e9 / messages
+        , exact ? "exact" : "MISMATCH");
+}
+
+
+#endif // LOSEMYMIND_DATASTREAMBENCHMARK_H
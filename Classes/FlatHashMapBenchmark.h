@@ -0,0 +1,100 @@
+#ifndef LOSEMYMIND_FLATHASHMAPBENCHMARK_H
+#define LOSEMYMIND_FLATHASHMAPBENCHMARK_H
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FoundationKit/Base/FlatHashMap.h"
+
+USING_NS_FK;
+
+template<typename Map, typename Key>
+static void BenchmarkMapRun(const char* name, const std::vector<Key>& keys, const std::vector<Key>& missing)
+{
+    typedef std::chrono::steady_clock clock;
+    size_t count = keys.size();
+    uint64 checksum = 0;
+
+    clock::time_point start = clock::now();
+    Map map;
+    for (size_t i = 0; i < count; ++i)
+    {
+        map.insert(std::make_pair(keys[i], (uint32)i));
+    }
+    clock::time_point inserted = clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        checksum += map.find(keys[i])->second;
+    }
+    clock::time_point found = clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        checksum += map.find(missing[i]) == map.end();
+    }
+    clock::time_point missed = clock::now();
+    for (auto& entry : map)
+    {
+        checksum += entry.second;
+    }
+    clock::time_point iterated = clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        map.erase(keys[i]);
+    }
+    clock::time_point erased = clock::now();
+
+    auto perOp = [count](clock::time_point begin, clock::time_point end)
+    {
+        return std::chrono::duration<double, std::nano>(end - begin).count() / count;
+    };
+    printf("  %-20s insert %6.1fns  hit %6.1fns  miss %6.1fns  iterate %5.1fns  erase %6.1fns  (%llu)\n"
+        , name
+        , perOp(start, inserted), perOp(inserted, found), perOp(found, missed)
+        , perOp(missed, iterated), perOp(iterated, erased), checksum);
+}
+
+/**
+ * Compares FlatHashMap with std::unordered_map on the key types of the
+ * server tables: uint64 connection ids and short std::string commands.
+ *
+ * Every size runs insert, successful find, failed find, iteration and erase,
+ * timings are per element. Keys are random so lookups miss the cache the
+ * way they do under load once the table outgrows it.
+ */
+void BenchmarkFlatHashMap()
+{
+    std::mt19937_64 random(20160101);
+    const size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    for (size_t size : sizes)
+    {
+        std::vector<uint64> keys(size), missing(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            // Even keys are stored, odd keys are never found.
+            keys[i] = random() & ~1ULL;
+            missing[i] = random() | 1ULL;
+        }
+        std::vector<std::string> stringKeys(size), stringMissing(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            stringKeys[i] = "command." + std::to_string(keys[i] % (size * 16));
+            stringMissing[i] = "missing." + std::to_string(missing[i] % (size * 16));
+        }
+
+        printf("BenchmarkFlatHashMap: %u entries\n", (uint32)size);
+        BenchmarkMapRun<std::unordered_map<uint64, uint32> >("unordered_map<u64>", keys, missing);
+        BenchmarkMapRun<FlatHashMap<uint64, uint32> >("FlatHashMap<u64>", keys, missing);
+        BenchmarkMapRun<std::unordered_map<std::string, uint32> >("unordered_map<str>", stringKeys, stringMissing);
+        BenchmarkMapRun<FlatHashMap<std::string, uint32, StringHash, StringEqual> >("FlatHashMap<str>", stringKeys, stringMissing);
+    }
+}
+
+
+#endif // LOSEMYMIND_FLATHASHMAPBENCHMARK_H
@@ -6,6 +6,7 @@ losemymind.libo@gmail.com
 ****************************************************************************/
 #include <string>
 #include "Data.h"
+#include "MemoryTracker.h"
 
 NS_FK_BEGIN
 const Data Data::Null;
@@ -84,6 +85,7 @@ void Data::copy(unsigned char* bytes, const size_t size)
         _size = size;
         _bytes = new unsigned char[sizeof(unsigned char) * _size];
         memcpy(_bytes, bytes, _size);
+        MemoryTracker::allocate(MemoryTag::FileData, _size);
     }
 }
 
@@ -93,12 +95,17 @@ void Data::fastSet(unsigned char* bytes, const size_t size, bool needDelete /*=
     _ownMem = needDelete;
     _bytes = bytes;
     _size = size;
+    if (_ownMem && _bytes != nullptr)
+        MemoryTracker::allocate(MemoryTag::FileData, _size);
 }
 
 void Data::clear()
 {
-    if (_ownMem)
+    if (_ownMem && _bytes != nullptr)
+    {
+        MemoryTracker::free(MemoryTag::FileData, _size);
         delete[] _bytes;
+    }
     _bytes = nullptr;
     _size = 0;
 }
@@ -5,28 +5,50 @@
 
 ****************************************************************************/
 
-#include <sstream>
 #include "DataStream.h"
 
 NS_FK_BEGIN
 
+// Capacity of an empty buffer, the inline storage is not heap memory.
+// Computed where used: a namespace scope constant would be initialised
+// dynamically, after streams in other static constructors already used it.
+static inline size_t inlineCapacity()
+{
+    return ustring().capacity();
+}
+
 DataStream::DataStream()
 : _readIndex(0)
 , _burnAfterReading(false)
+, _error(false)
+, _trackedCapacity(inlineCapacity())
 {
 }
 DataStream::DataStream(const DataStream& pDataStream)
 	: _buffer(pDataStream.getBuffer())
     , _readIndex(pDataStream._readIndex)
     , _burnAfterReading(pDataStream._burnAfterReading)
+    , _error(pDataStream._error)
+    , _trackedCapacity(inlineCapacity())
 {
+    trackCapacity();
 }
 
 DataStream::DataStream(DataStream&& pDataStream)
 	: _buffer(std::move(pDataStream._buffer))
     , _readIndex(pDataStream._readIndex)
     , _burnAfterReading(pDataStream._burnAfterReading)
+    , _error(pDataStream._error)
+    , _trackedCapacity(inlineCapacity())
+{
+    trackCapacity();
+    pDataStream.trackCapacity();
+}
+
+DataStream::~DataStream()
 {
+    size_t inlineBytes = inlineCapacity();
+    MemoryTracker::resize(MemoryTag::DataStream, _trackedCapacity > inlineBytes ? _trackedCapacity - inlineBytes : 0, 0);
 }
 
 DataStream& DataStream::operator=(const DataStream& pDataStream)
@@ -34,6 +56,8 @@ DataStream& DataStream::operator=(const DataStream& pDataStream)
 	_buffer = pDataStream.getBuffer();
     _burnAfterReading = pDataStream._burnAfterReading;
     _readIndex = pDataStream._readIndex;
+    _error = pDataStream._error;
+    trackCapacity();
 	return *this;
 }
 
@@ -42,6 +66,9 @@ DataStream& DataStream::operator=(DataStream&& pDataStream)
 	_buffer = std::move(pDataStream._buffer);
     _burnAfterReading = pDataStream._burnAfterReading;
     _readIndex = pDataStream._readIndex;
+    _error = pDataStream._error;
+    trackCapacity();
+    pDataStream.trackCapacity();
 	return *this;
 }
 
@@ -61,6 +88,7 @@ DataStream& DataStream::operator << (const ustring& data)
 {
     *this << data.size();
     _buffer.append(data.c_str(), data.size());
+    trackCapacity();
     return *this;
 }
 
@@ -70,11 +98,10 @@ DataStream& DataStream::operator >> (uint8* data)
     *this >> size;
 
     // Check for fake string size to prevent memory hacks
-    if (size > _buffer.size())
+    if (_error || size > remaining())
     {
-        std::ostringstream os;
-        os << "String size (" << size << ") > packet size (" << _buffer.size() << ")";
-        throw std::out_of_range(os.str());
+        _error = true;
+        return *this;
     }
     if (size == 0)
     {
@@ -88,9 +115,19 @@ DataStream& DataStream::operator >> (uint8* data)
 
 DataStream& DataStream::operator >> (std::string& data)
 {
-    ustring temp;
-    *this >> temp;
-    data.assign((const char*)temp.c_str(), temp.size());
+    size_type size = 0;
+    *this >> size;
+
+    // Check for fake string size to prevent memory hacks
+    if (_error || size > remaining())
+    {
+        _error = true;
+        data.clear();
+        return *this;
+    }
+    // Copied straight from the buffer, no temporary ustring.
+    data.assign((const char*)_buffer.data() + getReadIndex(), size);
+    readIndexIncrement(size);
     return *this;
 }
 
@@ -100,11 +137,11 @@ DataStream& DataStream::operator>>(ustring& data)
 	*this >> size;
 
 	// Check for fake string size to prevent memory hacks
-	if(size > _buffer.size())
+	if(_error || size > remaining())
 	{
-		std::ostringstream os;
-		os << "String size (" << size << ") > packet size (" << _buffer.size() << ")";
-		throw std::out_of_range(os.str());
+		_error = true;
+		data.clear();
+		return *this;
 	}
 	if(size == 0)
 	{
@@ -124,13 +161,42 @@ void DataStream::write(const uint8* data, size_type pSize)
 {
     *this << pSize;
 	_buffer.append(data, pSize);
+    trackCapacity();
+
+}
 
+size_t DataStream::measure(const uint8* data)
+{
+    return sizeof(size_t) + ustring(data).size();
+}
+
+size_t DataStream::measure(const std::string& data)
+{
+    return sizeof(size_type) + data.size();
+}
+
+size_t DataStream::measure(const ustring& data)
+{
+    return sizeof(size_t) + data.size();
+}
+
+void DataStream::reserve(size_t count)
+{
+    _buffer.reserve(_buffer.size() + count);
+    trackCapacity();
 }
 
 void DataStream::read(uint8* data, size_type dataSize)
 {
 	//memcpy(data,&_buffer[0],dataSize);
 	//_buffer.erase(0,dataSize);
+    if (_error || dataSize > remaining())
+    {
+        _error = true;
+        return;
+    }
+    if (dataSize == 0)
+        return;
     memcpy(data, &_buffer[getReadIndex()], dataSize);
     readIndexIncrement(dataSize);
 }
@@ -139,20 +205,25 @@ void DataStream::clear()
 {
 	_buffer.clear();
     _readIndex = 0;
+    _error = false;
 }
 
 void DataStream::reset(const ustring& data)
 {
 	_buffer.clear();
     _buffer.append(data);
+    trackCapacity();
     _readIndex = 0;
+    _error = false;
 }
 
 void DataStream::reset(const uint8* data, size_type size)
 {
     _buffer.clear();
     _buffer.append(data, size);
+    trackCapacity();
     _readIndex = 0;
+    _error = false;
 }
 
 size_t DataStream::size()
@@ -160,6 +231,13 @@ size_t DataStream::size()
 	return _buffer.size();
 }
 
+size_t DataStream::remaining()const
+{
+    if (_burnAfterReading)
+        return _buffer.size();
+    return _buffer.size() > _readIndex ? _buffer.size() - _readIndex : 0;
+}
+
 const ustring& DataStream::getBuffer()const
 {
 	return _buffer;
@@ -185,4 +263,14 @@ void DataStream::readIndexIncrement(size_type count)
         _readIndex += count;
 }
 
+void DataStream::trackCapacityChanged()
+{
+    size_t capacity = _buffer.capacity();
+    size_t inlineBytes = inlineCapacity();
+    MemoryTracker::resize(MemoryTag::DataStream
+        , _trackedCapacity > inlineBytes ? _trackedCapacity - inlineBytes : 0
+        , capacity > inlineBytes ? capacity - inlineBytes : 0);
+    _trackedCapacity = capacity;
+}
+
 NS_FK_END
\ No newline at end of file
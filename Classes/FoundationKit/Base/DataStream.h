@@ -17,6 +17,9 @@
 #include <string>
 #include "FoundationKit/GenericPlatformMacros.h"
 #include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/MemoryTracker.h"
+#include "FoundationKit/Base/SmallVector.h"
+#include "FoundationKit/Base/SmallString.h"
 NS_FK_BEGIN
 
 class  DataStream
@@ -28,11 +31,13 @@ public:
 	DataStream(DataStream&& pDataStream);
 	DataStream& operator=(const DataStream& pDataStream);
 	DataStream& operator=(DataStream&& pDataStream);
+    ~DataStream();
 
     template<typename T, typename = typename std::enable_if<std::is_fundamental<T>::value>::type >
     DataStream& operator<<(T data)
     {
         _buffer.append((uint8*)&data, sizeof(T));
+        trackCapacity();
         return *this;
     }
 
@@ -99,14 +104,155 @@ public:
 		return readSequenceContainer<std::list<V>, V>(data);
 	}
 
+	/**
+	 * Same encoding as std::vector. Up to N elements decode without
+	 * allocating, fundamentals are copied in one block.
+	 */
+	template <typename V, size_t N>
+	DataStream& operator<<(const SmallVector<V, N>& data)
+	{
+		return writeSequenceContainer(data);
+	}
+
+	template <typename V, size_t N>
+	DataStream& operator>>(SmallVector<V, N>& data)
+	{
+		if (!std::is_fundamental<V>::value)
+			return readSequenceContainer<SmallVector<V, N>, V>(data);
+
+		size_t size = 0;
+		*this >> size;
+		if (_error || size > remaining() / sizeof(V))
+		{
+			_error = true;
+			return *this;
+		}
+		size_t first = data.size();
+		data.resize(first + size);
+		read((uint8*)(data.data() + first), (size_type)(size * sizeof(V)));
+		return *this;
+	}
+
+	/** Same encoding as std::string. Up to N characters decode without allocating. */
+	template <size_t N>
+	DataStream& operator<<(const SmallString<N>& data)
+	{
+		write((const uint8*)data.data(), (size_type)data.size());
+		return *this;
+	}
+
+	template <size_t N>
+	DataStream& operator>>(SmallString<N>& data)
+	{
+		size_type size = 0;
+		*this >> size;
+		if (_error || size > remaining())
+		{
+			_error = true;
+			data.clear();
+			return *this;
+		}
+		data.assign((const char*)_buffer.data() + getReadIndex(), size);
+		readIndexIncrement(size);
+		return *this;
+	}
+
     void write(const uint8_t* data, size_type pSize);
 
+    /**
+     * Exact encoded size of a value, i.e. how many bytes operator<< appends.
+     * Fundamentals and containers of fundamentals are computed without
+     * touching the elements; everything else is summed element by element.
+     */
+    template<typename T, typename = typename std::enable_if<std::is_fundamental<T>::value>::type >
+    static size_t measure(T)
+    {
+        return sizeof(T);
+    }
+
+    static size_t measure(const uint8* data);
+    static size_t measure(const std::string& data);
+    static size_t measure(const ustring& data);
+
+    template <typename K, typename V>
+    static size_t measure(const std::map<K, V>& data)
+    {
+        return measureAssociativeContainer<std::map<K, V>, K, V>(data);
+    }
+
+    template <typename K, typename V>
+    static size_t measure(const std::unordered_map<K, V>& data)
+    {
+        return measureAssociativeContainer<std::unordered_map<K, V>, K, V>(data);
+    }
+
+    template <typename V>
+    static size_t measure(const std::vector<V>& data)
+    {
+        return measureSequenceContainer<std::vector<V>, V>(data);
+    }
+
+    template <typename V>
+    static size_t measure(const std::list<V>& data)
+    {
+        return measureSequenceContainer<std::list<V>, V>(data);
+    }
+
+    template <typename V, size_t N>
+    static size_t measure(const SmallVector<V, N>& data)
+    {
+        return measureSequenceContainer<SmallVector<V, N>, V>(data);
+    }
+
+    template <size_t N>
+    static size_t measure(const SmallString<N>& data)
+    {
+        return sizeof(size_type) + data.size();
+    }
+
+    static size_t measure()
+    {
+        return 0;
+    }
+
+    /** Sum of the encoded sizes of all arguments. */
+    template<typename T1, typename T2, typename... Args>
+    static size_t measure(const T1& first, const T2& second, const Args&... rest)
+    {
+        return measure(first) + measure(second, rest...);
+    }
+
+    /** Makes room for count more bytes so the following writes do not regrow the buffer. */
+    void reserve(size_t count);
+
+    /**
+     * Measures all arguments, reserves once and writes them in order.
+     * Equivalent to (*this << a << b << ...) with a single allocation.
+     */
+    template<typename... Args>
+    DataStream& writeAll(const Args&... args)
+    {
+        reserve(measure(args...));
+        writeEach(args...);
+        return *this;
+    }
+
+    DataStream& writeAll()
+    {
+        return *this;
+    }
+
+	/**
+	 * Reads a fundamental value. On underflow data is set to T() and the
+	 * stream enters the sticky error state, see hasError().
+	 */
 	template< typename T >
 	void read(T& data)
 	{
-		if (size() < sizeof(T))
+		if (_error || remaining() < sizeof(T))
 		{
 			data = T();
+			_error = true;
 			return;
 		}
         memcpy(&data, &_buffer[getReadIndex()], sizeof(T));
@@ -123,8 +269,36 @@ public:
 		return ret;
 	}
 
+	/** Reads every argument in order, equivalent to (*this >> a >> b >> ...). */
+	template<typename... Args>
+	DataStream& readAll(Args&... args)
+	{
+		readEach(args...);
+		return *this;
+	}
+
+	DataStream& readAll()
+	{
+		return *this;
+	}
+
+    /**
+     * Reads dataSize raw bytes. If fewer bytes remain nothing is copied
+     * and the stream enters the sticky error state.
+     */
     void read(uint8_t* data, size_type dataSize);
 
+    /**
+     * Returns true once any read ran past the end of the buffer or found
+     * a malformed length. Every later read is a no-op returning defaults,
+     * so a decoder can read a whole message and check this once at the end.
+     */
+    bool   hasError()const{ return _error; }
+
+    void   clearError(){ _error = false; }
+
+    /** Number of bytes that have not been read yet. */
+    size_t remaining()const;
 
 	void   clear();
     void   reset(const ustring& data);
@@ -151,12 +325,19 @@ private:
 	{
 		size_t size=0;
 		*this >> size;
+		// Every element takes at least one byte, reject fake counts up front.
+		if (size > remaining())
+		{
+			_error = true;
+			return *this;
+		}
 
-		for(size_t i = 0; i < size; ++i)
+		for(size_t i = 0; i < size && !_error; ++i)
 		{
 			V value;
 			*this >> value;
-			data.push_back(value);
+			if (!_error)
+				data.push_back(value);
 		}
 
 		return *this;
@@ -178,24 +359,96 @@ private:
 	{
 		size_t size=0;
 		*this >> size;
-		for(size_t i = 0; i < size; ++i)
+		if (size > remaining())
+		{
+			_error = true;
+			return *this;
+		}
+		for(size_t i = 0; i < size && !_error; ++i)
 		{
 			K key;
 			V value;
 			*this >> key >> value;
-			data.insert(std::pair<K,V>(key, value));
+			if (!_error)
+				data.insert(std::pair<K,V>(key, value));
 		}
 		return *this;
 	}
 
+	template<typename C, typename V>
+	static size_t measureSequenceContainer(const C& data)
+	{
+		if (std::is_fundamental<V>::value)
+			return sizeof(size_t) + data.size() * sizeof(V);
+
+		size_t total = sizeof(size_t);
+		// auto&& so std::vector<bool>, whose elements are proxies, binds too
+		for (auto&& iter : data)
+		{
+			total += measure(iter);
+		}
+		return total;
+	}
+
+	template<typename C, typename K, typename V>
+	static size_t measureAssociativeContainer(const C& data)
+	{
+		if (std::is_fundamental<K>::value && std::is_fundamental<V>::value)
+			return sizeof(size_t) + data.size() * (sizeof(K) + sizeof(V));
+
+		size_t total = sizeof(size_t);
+		for (auto& iter : data)
+		{
+			total += measure(iter.first) + measure(iter.second);
+		}
+		return total;
+	}
+
+	template<typename T>
+	void readEach(T& last)
+	{
+		*this >> last;
+	}
+
+	template<typename T, typename... Args>
+	void readEach(T& first, Args&... rest)
+	{
+		*this >> first;
+		readEach(rest...);
+	}
+
+	template<typename T>
+	void writeEach(const T& last)
+	{
+		*this << last;
+	}
+
+	template<typename T, typename... Args>
+	void writeEach(const T& first, const Args&... rest)
+	{
+		*this << first;
+		writeEach(rest...);
+	}
+
     size_type getReadIndex();
 
     void readIndexIncrement(size_type count);
 
+    // Reports buffer growth to MemoryTracker, only costs a compare when nothing changed.
+    void trackCapacity()
+    {
+        if (_buffer.capacity() != _trackedCapacity)
+            trackCapacityChanged();
+    }
+
+    void trackCapacityChanged();
+
 protected:
     ustring     _buffer;
     size_type   _readIndex;
     bool        _burnAfterReading;
+    bool        _error;
+    size_t      _trackedCapacity;
 };
 
 NS_FK_END
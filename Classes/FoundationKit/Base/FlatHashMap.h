@@ -0,0 +1,644 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_FLATHASHMAP_H
+#define LOSEMYMIND_FLATHASHMAP_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FK_FLATHASHMAP_SSE2 1
+#include <emmintrin.h>
+#else
+#define FK_FLATHASHMAP_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace detail
+{
+    // Control byte of a slot: empty, deleted, or full with 7 bits of its hash.
+    typedef int8 ctrl_t;
+    static const ctrl_t CTRL_EMPTY   = -128;
+    static const ctrl_t CTRL_DELETED = -2;
+    static const size_t GROUP_WIDTH  = 16;
+
+    inline uint32 lowestBit(uint32 mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, mask);
+        return static_cast<uint32>(index);
+#else
+        return static_cast<uint32>(__builtin_ctz(mask));
+#endif
+    }
+
+    // GROUP_WIDTH control bytes compared at once, one bit per slot in the results.
+    class ProbeGroup
+    {
+    public:
+        explicit ProbeGroup(const ctrl_t* pos)
+        {
+#if FK_FLATHASHMAP_SSE2
+            _ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+#else
+            memcpy(_ctrl, pos, GROUP_WIDTH);
+#endif
+        }
+
+        uint32 match(ctrl_t h2)const
+        {
+#if FK_FLATHASHMAP_SSE2
+            return static_cast<uint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl)));
+#else
+            uint32 mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; ++i)
+                mask |= (uint32)(_ctrl[i] == h2) << i;
+            return mask;
+#endif
+        }
+
+        uint32 matchEmpty()const
+        {
+            return match(CTRL_EMPTY);
+        }
+
+        // Empty and deleted are the only negative values below -1.
+        uint32 matchEmptyOrDeleted()const
+        {
+#if FK_FLATHASHMAP_SSE2
+            return static_cast<uint32>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), _ctrl)));
+#else
+            uint32 mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; ++i)
+                mask |= (uint32)(_ctrl[i] < -1) << i;
+            return mask;
+#endif
+        }
+
+    private:
+#if FK_FLATHASHMAP_SSE2
+        __m128i _ctrl;
+#else
+        ctrl_t  _ctrl[GROUP_WIDTH];
+#endif
+    };
+
+    // std::hash of integers is the identity on some standard libraries,
+    // the table needs well mixed high and low bits.
+    inline size_t mixHash(size_t hash)
+    {
+        uint64 h = hash;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+}
+
+/**
+ * Transparent hash and equality for std::string keys, so a map keyed by
+ * std::string can be searched with a const char* without building a string.
+ */
+struct StringHash
+{
+    typedef void is_transparent;
+
+    size_t operator()(const char* str)const
+    {
+        return hash(str, strlen(str));
+    }
+
+    size_t operator()(const std::string& str)const
+    {
+        return hash(str.c_str(), str.size());
+    }
+
+    // FNV-1a
+    static size_t hash(const char* data, size_t size)
+    {
+        uint64 h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i)
+        {
+            h ^= static_cast<uint8>(data[i]);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+struct StringEqual
+{
+    typedef void is_transparent;
+
+    bool operator()(const std::string& lhs, const std::string& rhs)const{ return lhs == rhs; }
+    bool operator()(const std::string& lhs, const char* rhs)const{ return lhs.compare(rhs) == 0; }
+    bool operator()(const char* lhs, const std::string& rhs)const{ return rhs.compare(lhs) == 0; }
+};
+
+/**
+ * Open addressing hash map in the style of Swiss tables.
+ *
+ * Keys and values live in one flat slot array next to an array of one byte
+ * control codes. A lookup hashes once, then compares 16 control bytes per
+ * SSE2 instruction against the 7 hash bits stored for every slot, and only
+ * touches slots whose bits match. There is no allocation per entry.
+ *
+ * Differences with std::unordered_map:
+ *   - Inserting may move every element, which invalidates references and
+ *     iterators. Erasing invalidates only the erased element.
+ *   - find(), count() and erase() accept any key type Hash and KeyEqual
+ *     understand (heterogeneous lookup), e.g. const char* with StringHash.
+ *   - Keys are copied when the table grows, since value_type keeps a const
+ *     key like the standard maps.
+ *
+ * The table grows at 7/8 load. Without SSE2 the same code compares control
+ * bytes one by one.
+ */
+template<typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K> >
+class FlatHashMap
+{
+public:
+    typedef K                       key_type;
+    typedef V                       mapped_type;
+    typedef std::pair<const K, V>   value_type;
+    typedef std::size_t             size_type;
+    typedef std::ptrdiff_t          difference_type;
+    typedef Hash                    hasher;
+    typedef KeyEqual                key_equal;
+    typedef value_type&             reference;
+    typedef const value_type&       const_reference;
+
+    template<typename ValueType>
+    class Iterator
+    {
+    public:
+        typedef std::forward_iterator_tag  iterator_category;
+        typedef typename std::remove_const<ValueType>::type value_type;
+        typedef std::ptrdiff_t             difference_type;
+        typedef ValueType*                 pointer;
+        typedef ValueType&                 reference;
+
+        Iterator() :_ctrl(nullptr), _end(nullptr), _slot(nullptr){}
+
+        // iterator converts to const_iterator.
+        template<typename Other>
+        Iterator(const Iterator<Other>& other) : _ctrl(other._ctrl), _end(other._end), _slot(other._slot){}
+
+        reference operator*()const{ return *_slot; }
+        pointer operator->()const{ return _slot; }
+
+        Iterator& operator++()
+        {
+            ++_ctrl;
+            ++_slot;
+            skipEmpty();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        template<typename Other>
+        bool operator==(const Iterator<Other>& other)const{ return _slot == other._slot; }
+        template<typename Other>
+        bool operator!=(const Iterator<Other>& other)const{ return _slot != other._slot; }
+
+    private:
+        template<typename, typename, typename, typename> friend class FlatHashMap;
+        template<typename> friend class Iterator;
+
+        Iterator(const detail::ctrl_t* ctrl, const detail::ctrl_t* end, ValueType* slot)
+            : _ctrl(ctrl), _end(end), _slot(slot)
+        {
+        }
+
+        void skipEmpty()
+        {
+            while (_ctrl != _end && *_ctrl < 0)
+            {
+                ++_ctrl;
+                ++_slot;
+            }
+        }
+
+        const detail::ctrl_t* _ctrl;
+        const detail::ctrl_t* _end;
+        ValueType*            _slot;
+    };
+
+    typedef Iterator<value_type>       iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+    FlatHashMap()
+        : _ctrl(nullptr)
+        , _slots(nullptr)
+        , _capacity(0)
+        , _size(0)
+        , _growthLeft(0)
+    {
+    }
+
+    FlatHashMap(const FlatHashMap& other)
+        : _ctrl(nullptr)
+        , _slots(nullptr)
+        , _capacity(0)
+        , _size(0)
+        , _growthLeft(0)
+        , _hash(other._hash)
+        , _equal(other._equal)
+    {
+        reserve(other._size);
+        for (auto& value : other)
+        {
+            insertUnique(value);
+        }
+    }
+
+    FlatHashMap(FlatHashMap&& other)
+        : _ctrl(nullptr)
+        , _slots(nullptr)
+        , _capacity(0)
+        , _size(0)
+        , _growthLeft(0)
+    {
+        swap(other);
+    }
+
+    ~FlatHashMap()
+    {
+        destroyAll();
+    }
+
+    FlatHashMap& operator=(const FlatHashMap& other)
+    {
+        if (this != &other)
+        {
+            FlatHashMap copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& other)
+    {
+        if (this != &other)
+        {
+            destroyAll();
+            swap(other);
+        }
+        return *this;
+    }
+
+    iterator begin()
+    {
+        iterator it(_ctrl, _ctrl + _capacity, _slots);
+        it.skipEmpty();
+        return it;
+    }
+
+    const_iterator begin()const
+    {
+        const_iterator it(_ctrl, _ctrl + _capacity, _slots);
+        it.skipEmpty();
+        return it;
+    }
+
+    iterator       end(){ return iterator(_ctrl + _capacity, _ctrl + _capacity, _slots + _capacity); }
+    const_iterator end()const{ return const_iterator(_ctrl + _capacity, _ctrl + _capacity, _slots + _capacity); }
+
+    size_type size()const{ return _size; }
+    bool      empty()const{ return _size == 0; }
+    size_type capacity()const{ return _capacity; }
+
+    void clear()
+    {
+        if (_capacity == 0)
+            return;
+        destroySlots();
+        resetCtrl();
+        _size = 0;
+    }
+
+    /** Makes room for count elements without growing again. */
+    void reserve(size_type count)
+    {
+        size_type needed = count + count / 7 + 1;
+        if (needed <= maxLoad(_capacity))
+            return;
+        size_type capacity = detail::GROUP_WIDTH;
+        while (maxLoad(capacity) < needed)
+            capacity *= 2;
+        rehash(capacity);
+    }
+
+    template<typename Q>
+    iterator find(const Q& key)
+    {
+        size_type index = findIndex(key);
+        return index == npos() ? end() : iteratorAt(index);
+    }
+
+    template<typename Q>
+    const_iterator find(const Q& key)const
+    {
+        size_type index = findIndex(key);
+        return index == npos() ? end() : const_iterator(_ctrl + index, _ctrl + _capacity, _slots + index);
+    }
+
+    template<typename Q>
+    size_type count(const Q& key)const
+    {
+        return findIndex(key) == npos() ? 0 : 1;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        return emplaceKey(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value)
+    {
+        return emplaceKey(value.first, std::move(value.second));
+    }
+
+    template<typename P>
+    std::pair<iterator, bool> insert(P&& value)
+    {
+        return emplaceKey(std::forward<P>(value).first, std::forward<P>(value).second);
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type value(std::forward<Args>(args)...);
+        return emplaceKey(value.first, std::move(value.second));
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+    {
+        return emplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    mapped_type& operator[](const key_type& key)
+    {
+        return emplaceKey(key).first->second;
+    }
+
+    mapped_type& operator[](key_type&& key)
+    {
+        return emplaceKey(std::move(key)).first->second;
+    }
+
+    template<typename Q>
+    size_type erase(const Q& key)
+    {
+        size_type index = findIndex(key);
+        if (index == npos())
+            return 0;
+        eraseAt(index);
+        return 1;
+    }
+
+    /** Returns the iterator following pos. */
+    iterator erase(const_iterator pos)
+    {
+        size_type index = static_cast<size_type>(pos._ctrl - _ctrl);
+        eraseAt(index);
+        iterator next = iteratorAt(index);
+        next.skipEmpty();
+        return next;
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(const_iterator(pos));
+    }
+
+    void swap(FlatHashMap& other)
+    {
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_growthLeft, other._growthLeft);
+        std::swap(_hash, other._hash);
+        std::swap(_equal, other._equal);
+    }
+
+private:
+    static size_type npos(){ return static_cast<size_type>(-1); }
+
+    static size_type maxLoad(size_type capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    iterator iteratorAt(size_type index)
+    {
+        return iterator(_ctrl + index, _ctrl + _capacity, _slots + index);
+    }
+
+    // The first GROUP_WIDTH control bytes are mirrored after the last one,
+    // so a group can be loaded at any position without wrapping.
+    void setCtrl(size_type index, detail::ctrl_t value)
+    {
+        _ctrl[index] = value;
+        if (index < detail::GROUP_WIDTH)
+            _ctrl[_capacity + index] = value;
+    }
+
+    void resetCtrl()
+    {
+        memset(_ctrl, (uint8)detail::CTRL_EMPTY, _capacity + detail::GROUP_WIDTH);
+        _growthLeft = maxLoad(_capacity);
+    }
+
+    template<typename Q>
+    size_type findIndex(const Q& key)const
+    {
+        if (_size == 0)
+            return npos();
+        return findIndex(key, detail::mixHash(_hash(key)));
+    }
+
+    template<typename Q>
+    size_type findIndex(const Q& key, size_t hash)const
+    {
+        if (_size == 0)
+            return npos();
+        detail::ctrl_t h2 = static_cast<detail::ctrl_t>(hash & 0x7F);
+        size_type mask = _capacity - 1;
+        size_type pos = (hash >> 7) & mask;
+        for (size_type step = detail::GROUP_WIDTH;; step += detail::GROUP_WIDTH)
+        {
+            detail::ProbeGroup group(_ctrl + pos);
+            for (uint32 bits = group.match(h2); bits != 0; bits &= bits - 1)
+            {
+                size_type index = (pos + detail::lowestBit(bits)) & mask;
+                if (_equal(_slots[index].first, key))
+                    return index;
+            }
+            if (group.matchEmpty() != 0)
+                return npos();
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // First empty or deleted slot on the probe sequence of hash.
+    size_type findFreeIndex(size_t hash)const
+    {
+        size_type mask = _capacity - 1;
+        size_type pos = (hash >> 7) & mask;
+        for (size_type step = detail::GROUP_WIDTH;; step += detail::GROUP_WIDTH)
+        {
+            uint32 bits = detail::ProbeGroup(_ctrl + pos).matchEmptyOrDeleted();
+            if (bits != 0)
+                return (pos + detail::lowestBit(bits)) & mask;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    template<typename KeyArg, typename... Args>
+    std::pair<iterator, bool> emplaceKey(KeyArg&& key, Args&&... args)
+    {
+        size_t hash = detail::mixHash(_hash(key));
+        size_type index = findIndex(key, hash);
+        if (index != npos())
+            return std::make_pair(iteratorAt(index), false);
+
+        if (_capacity == 0)
+            rehash(detail::GROUP_WIDTH);
+        index = findFreeIndex(hash);
+        if (_growthLeft == 0 && _ctrl[index] == detail::CTRL_EMPTY)
+        {
+            // Out of room: drop tombstones if they are many, grow otherwise.
+            rehash(_size <= maxLoad(_capacity) / 2 ? _capacity : _capacity * 2);
+            index = findFreeIndex(hash);
+        }
+
+        ::new((void*)(_slots + index)) value_type(std::piecewise_construct
+            , std::forward_as_tuple(std::forward<KeyArg>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        if (_ctrl[index] == detail::CTRL_EMPTY)
+            --_growthLeft;
+        setCtrl(index, static_cast<detail::ctrl_t>(hash & 0x7F));
+        ++_size;
+        return std::make_pair(iteratorAt(index), true);
+    }
+
+    // Used by copy and rehash, the key is known to be missing and there is room.
+    void insertUnique(const value_type& value)
+    {
+        size_t hash = detail::mixHash(_hash(value.first));
+        size_type index = findFreeIndex(hash);
+        ::new((void*)(_slots + index)) value_type(value);
+        setCtrl(index, static_cast<detail::ctrl_t>(hash & 0x7F));
+        --_growthLeft;
+        ++_size;
+    }
+
+    void insertUnique(value_type&& value)
+    {
+        size_t hash = detail::mixHash(_hash(value.first));
+        size_type index = findFreeIndex(hash);
+        ::new((void*)(_slots + index)) value_type(std::move(value));
+        setCtrl(index, static_cast<detail::ctrl_t>(hash & 0x7F));
+        --_growthLeft;
+        ++_size;
+    }
+
+    void eraseAt(size_type index)
+    {
+        _slots[index].~value_type();
+        setCtrl(index, detail::CTRL_DELETED);
+        --_size;
+    }
+
+    void rehash(size_type capacity)
+    {
+        detail::ctrl_t* oldCtrl = _ctrl;
+        value_type*     oldSlots = _slots;
+        size_type       oldCapacity = _capacity;
+
+        // One block: control bytes first, then the slots.
+        size_type ctrlBytes = capacity + detail::GROUP_WIDTH;
+        size_type slotOffset = (ctrlBytes + std::alignment_of<value_type>::value - 1) & ~(std::alignment_of<value_type>::value - 1);
+        uint8* memory = static_cast<uint8*>(::operator new(slotOffset + capacity * sizeof(value_type)));
+        _ctrl = reinterpret_cast<detail::ctrl_t*>(memory);
+        _slots = reinterpret_cast<value_type*>(memory + slotOffset);
+        _capacity = capacity;
+        _size = 0;
+        resetCtrl();
+
+        for (size_type i = 0; i < oldCapacity; ++i)
+        {
+            if (oldCtrl[i] >= 0)
+            {
+                insertUnique(std::move(oldSlots[i]));
+                oldSlots[i].~value_type();
+            }
+        }
+        ::operator delete(oldCtrl);
+    }
+
+    void destroySlots()
+    {
+        if (!std::is_trivially_destructible<value_type>::value)
+        {
+            for (size_type i = 0; i < _capacity; ++i)
+            {
+                if (_ctrl[i] >= 0)
+                    _slots[i].~value_type();
+            }
+        }
+    }
+
+    void destroyAll()
+    {
+        if (_capacity == 0)
+            return;
+        destroySlots();
+        ::operator delete(_ctrl);
+        _ctrl = nullptr;
+        _slots = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _growthLeft = 0;
+    }
+
+    detail::ctrl_t* _ctrl;
+    value_type*     _slots;
+    size_type       _capacity;
+    size_type       _size;
+    size_type       _growthLeft;
+    hasher          _hash;
+    key_equal       _equal;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_FLATHASHMAP_H
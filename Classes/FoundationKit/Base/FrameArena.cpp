@@ -0,0 +1,128 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <cstdlib>
+#include "FrameArena.h"
+#include "MemoryTracker.h"
+
+NS_FK_BEGIN
+
+const size_t FrameArena::DEFAULT_BLOCK_SIZE;
+const size_t FrameArena::DEFAULT_ALIGNMENT;
+
+// Arena of the calling thread, see getThreadArena().
+static THREAD_LOCAL FrameArena* t_frameArena = nullptr;
+
+FrameArena::FrameArena(size_t blockSize, bool hugePages)
+    : _blockSize(blockSize)
+    , _hugePages(hugePages)
+    , _current(nullptr)
+    , _retired(nullptr)
+    , _offset(0)
+    , _capacity(0)
+    , _peakBytes(0)
+    , _allocationCount(0)
+    , _blockAllocationCount(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    freeBlocks(_current);
+    freeBlocks(_retired);
+}
+
+void FrameArena::reset()
+{
+    size_t used = getUsedBytes();
+    if (used > _peakBytes)
+        _peakBytes = used;
+
+    if (_retired != nullptr)
+    {
+        // This tick did not fit in one block, grow to what it used.
+        freeBlocks(_current);
+        freeBlocks(_retired);
+        _current = nullptr;
+        _retired = nullptr;
+        _capacity = 0;
+        newBlock(used > _blockSize ? used : _blockSize);
+    }
+    _offset = 0;
+    _allocationCount = 0;
+    _blockAllocationCount = 0;
+}
+
+size_t FrameArena::getUsedBytes()const
+{
+    size_t used = _offset;
+    for (Block* block = _retired; block != nullptr; block = block->next)
+    {
+        used += block->used;
+    }
+    return used;
+}
+
+FrameArena& FrameArena::getThreadArena()
+{
+    if (t_frameArena == nullptr)
+        t_frameArena = new FrameArena();
+    return *t_frameArena;
+}
+
+void* FrameArena::allocateSlow(size_t size, size_t alignment)
+{
+    if (_current != nullptr)
+    {
+        _current->used = _offset;
+        _current->next = _retired;
+        _retired = _current;
+        _current = nullptr;
+    }
+
+    size_t blockSize = size + alignment > _blockSize ? size + alignment : _blockSize;
+    newBlock(blockSize);
+    ++_blockAllocationCount;
+    return allocate(size, alignment);
+}
+
+FrameArena::Block* FrameArena::newBlock(size_t size)
+{
+    PageBlock page = { nullptr, sizeof(Block) + size, PageKind::Heap };
+    if (_hugePages)
+        page = PageAllocator::allocate(page.size, true);
+    else
+        page.base = malloc(page.size);
+    if (page.base == nullptr)
+        throw std::bad_alloc();
+
+    // Page backed blocks are rounded up, use all of them.
+    Block* block = static_cast<Block*>(page.base);
+    block->next = nullptr;
+    block->size = page.size - sizeof(Block);
+    block->used = 0;
+    block->page = page;
+    size = block->size;
+    MemoryTracker::allocate(MemoryTag::FrameArena, page.size);
+    _current = block;
+    _offset = 0;
+    _capacity += size;
+    return block;
+}
+
+void FrameArena::freeBlocks(Block* block)
+{
+    while (block != nullptr)
+    {
+        Block* next = block->next;
+        PageBlock page = block->page;
+        MemoryTracker::free(MemoryTag::FrameArena, page.size);
+        PageAllocator::free(page);
+        block = next;
+    }
+}
+
+NS_FK_END
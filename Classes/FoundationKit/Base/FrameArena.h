@@ -0,0 +1,199 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_FRAMEARENA_H
+#define LOSEMYMIND_FRAMEARENA_H
+
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+#include "FoundationKit/Base/PageAllocator.h"
+
+NS_FK_BEGIN
+
+/**
+ * Bump pointer allocator for data that only lives until the end of a tick.
+ *
+ * allocate() moves a pointer forward inside the current block, there is no
+ * per allocation free. reset() releases everything at once. When a tick
+ * needed more than one block, reset() replaces them with a single block
+ * big enough for that tick, so a steady workload settles on one block and
+ * no heap traffic at all.
+ *
+ * Not thread safe. Use getThreadArena() for the arena of the calling
+ * thread, the main loop resets it at the end of VIServer::update().
+ *
+ * Sample usage:
+ *
+ *     FrameVector<Socket*> sockets;        // memory from the thread arena
+ *     sockets.reserve(_clients.size());
+ *     ...
+ *     FrameArena::getThreadArena().reset(); // end of tick
+ */
+class FrameArena : noncopyable
+{
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+    static const size_t DEFAULT_ALIGNMENT  = 16;
+
+    /**
+     * @param blockSize Minimum bytes taken from the system at once.
+     * @param hugePages Back blocks with huge pages when possible, blocks are
+     *                  then rounded up to PageAllocator::HUGE_PAGE_SIZE.
+     */
+    explicit FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE, bool hugePages = false);
+    ~FrameArena();
+
+    /** alignment must be a power of two. Never returns nullptr. */
+    void* allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT)
+    {
+        if (_current == nullptr)
+            return allocateSlow(size, alignment);
+        UPTRINT base = reinterpret_cast<UPTRINT>(_current->data());
+        size_t offset = static_cast<size_t>(((base + _offset + alignment - 1) & ~(UPTRINT)(alignment - 1)) - base);
+        if (offset + size > _current->size)
+            return allocateSlow(size, alignment);
+        _offset = offset + size;
+        ++_allocationCount;
+        return _current->data() + offset;
+    }
+
+    /** Releases every allocation of this tick. */
+    void reset();
+
+    /** Bytes handed out since the last reset. */
+    size_t getUsedBytes()const;
+
+    /** Bytes of all blocks currently owned. */
+    size_t getCapacity()const{ return _capacity; }
+
+    /** Allocations since the last reset. */
+    uint32 getAllocationCount()const{ return _allocationCount; }
+
+    /** Blocks taken from the heap since the last reset. */
+    uint32 getBlockAllocationCount()const{ return _blockAllocationCount; }
+
+    /** Largest getUsedBytes() seen at a reset. */
+    size_t getPeakBytes()const{ return _peakBytes; }
+
+    /** Affects blocks allocated from now on. */
+    void   setHugePages(bool hugePages){ _hugePages = hugePages; }
+
+    /** Arena of the calling thread, created on first use and kept for the thread lifetime. */
+    static FrameArena& getThreadArena();
+
+private:
+    struct Block
+    {
+        Block*    next;
+        size_t    size;
+        size_t    used; // Bytes used when the block was retired.
+        PageBlock page; // Where the block itself lives.
+        uint8* data(){ return reinterpret_cast<uint8*>(this + 1); }
+    };
+
+    void*  allocateSlow(size_t size, size_t alignment);
+    Block* newBlock(size_t size);
+    void   freeBlocks(Block* block);
+
+    size_t _blockSize;
+    bool   _hugePages;
+    Block* _current;
+    Block* _retired;
+    size_t _offset;
+    size_t _capacity;
+    size_t _peakBytes;
+    uint32 _allocationCount;
+    uint32 _blockAllocationCount;
+};
+
+/**
+ * STL allocator drawing from a FrameArena. deallocate() does nothing, the
+ * memory comes back when the arena is reset, so containers using it must
+ * not outlive the tick.
+ */
+template<typename T>
+class FrameAllocator
+{
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef FrameAllocator<U> other;
+    };
+
+    FrameAllocator() :_arena(&FrameArena::getThreadArena()){}
+
+    explicit FrameAllocator(FrameArena& arena) :_arena(&arena){}
+
+    template<typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : _arena(other.getArena()){}
+
+    T* allocate(size_type n, const void* = nullptr)
+    {
+        return static_cast<T*>(_arena->allocate(n * sizeof(T), std::alignment_of<T>::value));
+    }
+
+    void deallocate(T*, size_type){}
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+
+    size_type max_size()const
+    {
+        return (std::numeric_limits<size_type>::max)() / sizeof(T);
+    }
+
+    FrameArena* getArena()const{ return _arena; }
+
+private:
+    FrameArena* _arena;
+};
+
+template<typename T, typename U>
+inline bool operator==(const FrameAllocator<T>& lhs, const FrameAllocator<U>& rhs)
+{
+    return lhs.getArena() == rhs.getArena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const FrameAllocator<T>& lhs, const FrameAllocator<U>& rhs)
+{
+    return lhs.getArena() != rhs.getArena();
+}
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocator<char> > FrameString;
+
+NS_FK_END
+#endif // LOSEMYMIND_FRAMEARENA_H
@@ -0,0 +1,210 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <cmath>
+#include <limits>
+#include "LatencyHistogram.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace
+{
+    // Index of the highest set bit, value must not be 0.
+    inline uint32 highestBit(uint64 value)
+    {
+#if defined(_MSC_VER)
+        // _BitScanReverse64 is not available to 32 bit builds.
+        unsigned long index = 0;
+        uint32 high = static_cast<uint32>(value >> 32);
+        if (high != 0)
+        {
+            _BitScanReverse(&index, high);
+            return static_cast<uint32>(index) + 32;
+        }
+        _BitScanReverse(&index, static_cast<uint32>(value));
+        return static_cast<uint32>(index);
+#else
+        return 63 - static_cast<uint32>(__builtin_clzll(value));
+#endif
+    }
+
+    inline void updateMin(std::atomic<int64>& target, int64 value)
+    {
+        int64 current = target.load(std::memory_order_relaxed);
+        while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    inline void updateMax(std::atomic<int64>& target, int64 value)
+    {
+        int64 current = target.load(std::memory_order_relaxed);
+        while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    inline uint64 percentileRank(double percentile, uint64 total)
+    {
+        double rank = std::ceil(percentile / 100.0 * total);
+        if (rank < 1.0)
+            return 1;
+        if (rank > (double)total)
+            return total;
+        return static_cast<uint64>(rank);
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(int64 value)
+{
+    if (value < 0)
+        value = 0;
+    else if (value > MAX_VALUE)
+        value = MAX_VALUE;
+    _counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    // Both are almost always no-ops once a few values went in, and then
+    // only cost a load.
+    updateMin(_min, value);
+    updateMax(_max, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    uint64 merged = 0;
+    for (uint32 i = 0; i < BUCKET_COUNT; ++i)
+    {
+        uint64 count = other._counts[i].load(std::memory_order_relaxed);
+        if (count != 0)
+        {
+            _counts[i].fetch_add(count, std::memory_order_relaxed);
+            merged += count;
+        }
+    }
+    if (merged == 0)
+        return;
+    _count.fetch_add(merged, std::memory_order_relaxed);
+    _sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    updateMin(_min, other._min.load(std::memory_order_relaxed));
+    updateMax(_max, other._max.load(std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset()
+{
+    for (uint32 i = 0; i < BUCKET_COUNT; ++i)
+    {
+        _counts[i].store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _min.store(std::numeric_limits<int64>::max(), std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+int64 LatencyHistogram::min()const
+{
+    return count() > 0 ? _min.load(std::memory_order_relaxed) : 0;
+}
+
+int64 LatencyHistogram::valueAtPercentile(double percentile)const
+{
+    // The total is taken from the buckets themselves, so a walk that races
+    // with record() still ends on a recorded value.
+    uint64 total = 0;
+    for (uint32 i = 0; i < BUCKET_COUNT; ++i)
+    {
+        total += _counts[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0)
+        return 0;
+
+    uint64 rank = percentileRank(percentile, total);
+    uint64 seen = 0;
+    for (uint32 i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += _counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            int64 upper = bucketUpperBound(i);
+            int64 maxValue = max();
+            return upper < maxValue ? upper : maxValue;
+        }
+    }
+    return max();
+}
+
+LatencySummary LatencyHistogram::getSummary()const
+{
+    static const double PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9 };
+    static const uint32 PERCENTILE_COUNT = sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+
+    uint64 counts[BUCKET_COUNT];
+    uint64 total = 0;
+    for (uint32 i = 0; i < BUCKET_COUNT; ++i)
+    {
+        counts[i] = _counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    LatencySummary summary;
+    summary.count = total;
+    summary.sum = sum();
+    summary.min = min();
+    summary.max = max();
+    int64* values[PERCENTILE_COUNT] = { &summary.p50, &summary.p90, &summary.p99, &summary.p999 };
+    for (uint32 p = 0; p < PERCENTILE_COUNT; ++p)
+    {
+        *values[p] = 0;
+    }
+    if (total == 0)
+        return summary;
+
+    uint32 p = 0;
+    uint64 rank = percentileRank(PERCENTILES[p], total);
+    uint64 seen = 0;
+    for (uint32 i = 0; i < BUCKET_COUNT && p < PERCENTILE_COUNT; ++i)
+    {
+        seen += counts[i];
+        while (p < PERCENTILE_COUNT && seen >= rank)
+        {
+            int64 upper = bucketUpperBound(i);
+            *values[p] = upper < summary.max ? upper : summary.max;
+            if (++p < PERCENTILE_COUNT)
+                rank = percentileRank(PERCENTILES[p], total);
+        }
+    }
+    return summary;
+}
+
+uint32 LatencyHistogram::bucketIndex(int64 value)
+{
+    if (value < (int64)SUB_BUCKET_COUNT)
+        return value > 0 ? static_cast<uint32>(value) : 0;
+    if (value > MAX_VALUE)
+        value = MAX_VALUE;
+    // Group g >= 1 covers [2^(g+5), 2^(g+6)) in 64 steps of 2^(g-1).
+    uint32 shift = highestBit(static_cast<uint64>(value)) - SUB_BUCKET_BITS;
+    uint32 subBucket = static_cast<uint32>(value >> shift) - SUB_BUCKET_COUNT;
+    return (shift + 1) * SUB_BUCKET_COUNT + subBucket;
+}
+
+int64 LatencyHistogram::bucketUpperBound(uint32 index)
+{
+    uint32 group = index / SUB_BUCKET_COUNT;
+    if (group == 0)
+        return index;
+    uint32 shift = group - 1;
+    int64 lower = static_cast<int64>(index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT) << shift;
+    return lower + (int64(1) << shift) - 1;
+}
+
+NS_FK_END
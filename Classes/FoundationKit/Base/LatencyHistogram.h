@@ -0,0 +1,99 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_LATENCYHISTOGRAM_H
+#define LOSEMYMIND_LATENCYHISTOGRAM_H
+
+#pragma once
+
+#include <atomic>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+/** Point in time view of a LatencyHistogram, values in the recorded unit. */
+struct LatencySummary
+{
+    uint64 count;
+    int64  sum;
+    int64  min;
+    int64  max;
+    int64  p50;
+    int64  p90;
+    int64  p99;
+    int64  p999;
+};
+
+/**
+ * Fixed memory latency histogram in the style of HdrHistogram.
+ *
+ * Values below 64 get a bucket each. Above that every power of two is
+ * split into 64 linear sub-buckets, so a reported percentile is at most
+ * 1/64 (1.6%) above the true value, whatever the magnitude. Values up to
+ * 2^40 are tracked (18 minutes in nanoseconds), larger ones are clamped.
+ *
+ * record() is O(1) and safe from any thread: a bit scan, three relaxed
+ * 64-bit fetch_adds (bucket, count, sum) and a load each for min and max,
+ * which only CAS when the value extends them. On 32-bit Windows every
+ * 64-bit atomic is a lock cmpxchg8b loop, so a record costs a few dozen ns
+ * uncontended and much more when threads share the cache lines. A
+ * histogram written by many threads at a high rate should be split into
+ * one per thread and combined with merge(), which is lock free too and can
+ * run while the source is still being recorded into.
+ *
+ * Queries walk the buckets (about 2k of them) and are meant for reporting,
+ * not for the hot path.
+ */
+class LatencyHistogram : noncopyable
+{
+public:
+    static const uint32 SUB_BUCKET_BITS  = 6;
+    static const uint32 SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const uint32 MAX_VALUE_BITS   = 40;
+    static const uint32 BUCKET_COUNT     = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+    static const int64  MAX_VALUE        = (int64(1) << MAX_VALUE_BITS) - 1;
+
+    LatencyHistogram();
+
+    /** Negative values count as 0, values above MAX_VALUE as MAX_VALUE. */
+    void   record(int64 value);
+
+    /** Adds the counts of other to this histogram. */
+    void   merge(const LatencyHistogram& other);
+
+    void   reset();
+
+    uint64 count()const{ return _count.load(std::memory_order_relaxed); }
+    int64  sum()const{ return _sum.load(std::memory_order_relaxed); }
+    int64  max()const{ return _max.load(std::memory_order_relaxed); }
+    int64  min()const;
+
+    /**
+     * Smallest recorded value such that percentile percent of the values
+     * are less or equal to it, to bucket precision. 0 if empty.
+     */
+    int64  valueAtPercentile(double percentile)const;
+
+    /** All the percentiles in one walk over the buckets. */
+    LatencySummary getSummary()const;
+
+    static uint32 bucketIndex(int64 value);
+
+    /** Largest value that falls into the bucket. */
+    static int64  bucketUpperBound(uint32 index);
+
+private:
+    std::atomic<uint64> _counts[BUCKET_COUNT];
+    std::atomic<uint64> _count;
+    std::atomic<int64>  _sum;
+    std::atomic<int64>  _min;
+    std::atomic<int64>  _max;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_LATENCYHISTOGRAM_H
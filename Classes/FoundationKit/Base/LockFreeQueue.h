@@ -0,0 +1,471 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_LOCKFREEQUEUE_H
+#define LOSEMYMIND_LOCKFREEQUEUE_H
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+/**
+ * Lock free queues for passing values between threads.
+ *
+ *   SpscQueue         bounded ring, one producer and one consumer.
+ *   MpscQueue         unbounded, any number of producers, one consumer
+ *                     (Dmitry Vyukov's intrusive node queue).
+ *   MpmcBoundedQueue  bounded ring, any number of producers and consumers
+ *                     (Dmitry Vyukov's sequence numbered cells).
+ *
+ * All three share the same interface: push() returns false when a bounded
+ * queue is full, tryPop() returns false when the queue looks empty. Indexes
+ * written by different sides live on separate cache lines. None of them
+ * block; wrap one in BlockingQueue to let the consumer sleep until a value
+ * arrives.
+ */
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+namespace detail
+{
+    inline size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+}
+
+/**
+ * Bounded single producer, single consumer ring.
+ *
+ * Each side keeps a private copy of the other side's index and only reloads
+ * it when the ring looks full (or empty), so in steady state the two threads
+ * do not touch each other's cache lines.
+ */
+template<typename T>
+class SpscQueue : noncopyable
+{
+public:
+    typedef T value_type;
+
+    /** capacity is rounded up to a power of two. */
+    explicit SpscQueue(size_t capacity)
+        : _mask(detail::roundUpToPowerOfTwo(capacity) - 1)
+        , _slots(static_cast<T*>(::operator new((_mask + 1) * sizeof(T))))
+        , _tail(0)
+        , _cachedHead(0)
+        , _head(0)
+        , _cachedTail(0)
+    {
+    }
+
+    ~SpscQueue()
+    {
+        T value;
+        while (tryPop(value))
+        {
+        }
+        ::operator delete(_slots);
+    }
+
+    bool push(const T& value){ return emplace(value); }
+    bool push(T&& value){ return emplace(std::move(value)); }
+
+    /** Producer only. */
+    template<typename... Args>
+    bool emplace(Args&&... args)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead > _mask)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead > _mask)
+                return false;
+        }
+        ::new((void*)(_slots + (tail & _mask))) T(std::forward<Args>(args)...);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer only. */
+    bool tryPop(T& value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail)
+                return false;
+        }
+        T* slot = _slots + (head & _mask);
+        value = std::move(*slot);
+        slot->~T();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity()const{ return _mask + 1; }
+
+    /** Exact only when called from the producer or the consumer with the other side idle. */
+    size_t sizeApprox()const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+private:
+    const size_t        _mask;
+    T* const            _slots;
+    char                _padding0[CACHE_LINE_SIZE];
+    // Producer side.
+    std::atomic<size_t> _tail;
+    size_t              _cachedHead;
+    char                _padding1[CACHE_LINE_SIZE - sizeof(size_t) * 2];
+    // Consumer side.
+    std::atomic<size_t> _head;
+    size_t              _cachedTail;
+    char                _padding2[CACHE_LINE_SIZE - sizeof(size_t) * 2];
+};
+
+/**
+ * Unbounded multiple producer, single consumer queue.
+ *
+ * push() is one atomic exchange and never fails or waits. A producer that
+ * is preempted between its exchange and linking its node hides the values
+ * pushed after it until it resumes; tryPop() returns false meanwhile.
+ * Every push allocates one node.
+ */
+template<typename T>
+class MpscQueue : noncopyable
+{
+public:
+    typedef T value_type;
+
+    MpscQueue()
+        : _head(&_stub)
+        , _tail(&_stub)
+    {
+        _stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (tryPop(value))
+        {
+        }
+        if (_tail != &_stub)
+            delete _tail;
+    }
+
+    bool push(const T& value){ return emplace(value); }
+    bool push(T&& value){ return emplace(std::move(value)); }
+
+    /** Any thread. */
+    template<typename... Args>
+    bool emplace(Args&&... args)
+    {
+        Node* node = new Node();
+        ::new((void*)&node->storage) T(std::forward<Args>(args)...);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = _head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer only. */
+    bool tryPop(T& value)
+    {
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+        // next becomes the new stub once its value is taken.
+        T* slot = reinterpret_cast<T*>(&next->storage);
+        value = std::move(*slot);
+        slot->~T();
+        _tail = next;
+        if (tail != &_stub)
+            delete tail;
+        return true;
+    }
+
+    /** Consumer only. */
+    bool empty()const
+    {
+        return _tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+    };
+
+    Node                _stub;
+    char                _padding0[CACHE_LINE_SIZE];
+    // Producer side.
+    std::atomic<Node*>  _head;
+    char                _padding1[CACHE_LINE_SIZE - sizeof(Node*)];
+    // Consumer side.
+    Node*               _tail;
+    char                _padding2[CACHE_LINE_SIZE - sizeof(Node*)];
+};
+
+/**
+ * Bounded multiple producer, multiple consumer ring.
+ *
+ * Every cell carries a sequence number telling whether it is ready for the
+ * producer or the consumer of a given lap, so both sides claim a cell with a
+ * single compare-exchange on their own index and never wait on each other
+ * unless the ring is full or empty.
+ */
+template<typename T>
+class MpmcBoundedQueue : noncopyable
+{
+public:
+    typedef T value_type;
+
+    /** capacity is rounded up to a power of two. */
+    explicit MpmcBoundedQueue(size_t capacity)
+        : _mask(detail::roundUpToPowerOfTwo(capacity) - 1)
+        , _cells(new Cell[_mask + 1])
+        , _enqueuePos(0)
+        , _dequeuePos(0)
+    {
+        for (size_t i = 0; i <= _mask; ++i)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~MpmcBoundedQueue()
+    {
+        T value;
+        while (tryPop(value))
+        {
+        }
+        delete[] _cells;
+    }
+
+    bool push(const T& value){ return emplace(value); }
+    bool push(T&& value){ return emplace(std::move(value)); }
+
+    /** Any thread. */
+    template<typename... Args>
+    bool emplace(Args&&... args)
+    {
+        Cell* cell;
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        ::new((void*)&cell->storage) T(std::forward<Args>(args)...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Any thread. */
+    bool tryPop(T& value)
+    {
+        Cell* cell;
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T* slot = reinterpret_cast<T*>(&cell->storage);
+        value = std::move(*slot);
+        slot->~T();
+        cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity()const{ return _mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+    };
+
+    const size_t        _mask;
+    Cell* const         _cells;
+    char                _padding0[CACHE_LINE_SIZE];
+    std::atomic<size_t> _enqueuePos;
+    char                _padding1[CACHE_LINE_SIZE - sizeof(size_t)];
+    std::atomic<size_t> _dequeuePos;
+    char                _padding2[CACHE_LINE_SIZE - sizeof(size_t)];
+};
+
+/**
+ * Lets consumers sleep until a producer signals.
+ *
+ * notify() is a fence and a load while nobody waits, so producers on a
+ * busy queue do not pay for the mutex.
+ */
+class QueueWaiter : noncopyable
+{
+public:
+    QueueWaiter() :_waiters(0){}
+
+    void notifyOne()
+    {
+        if (hasWaiters())
+        {
+            { std::lock_guard<std::mutex> lock(_mutex); }
+            _condition.notify_one();
+        }
+    }
+
+    void notifyAll()
+    {
+        if (hasWaiters())
+        {
+            { std::lock_guard<std::mutex> lock(_mutex); }
+            _condition.notify_all();
+        }
+    }
+
+    /**
+     * Waits until ready() returns true or timeoutMs elapses.
+     * ready() is evaluated under the waiter's mutex, after the waiter has
+     * registered, so a notify issued after a successful push is never lost.
+     */
+    template<typename Predicate>
+    bool waitFor(Predicate ready, uint32 timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool result = _condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    bool hasWaiters()const
+    {
+        // Pairs with the increment in waitFor(): either the waiter sees the
+        // pushed value or the producer sees the waiter.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _waiters.load(std::memory_order_relaxed) != 0;
+    }
+
+    std::atomic<uint32>     _waiters;
+    std::mutex              _mutex;
+    std::condition_variable _condition;
+};
+
+/**
+ * One of the queues above plus a QueueWaiter: consumers can block in
+ * waitPop() while producers stay lock free.
+ *
+ *     BlockingQueue<MpscQueue<Job> > jobs;
+ *     jobs.push(job);                          // any thread
+ *     if (jobs.waitPop(job, 100)) run(job);    // consumer thread
+ */
+template<typename Queue>
+class BlockingQueue : noncopyable
+{
+public:
+    typedef typename Queue::value_type value_type;
+
+    template<typename... Args>
+    explicit BlockingQueue(Args&&... args)
+        : _queue(std::forward<Args>(args)...)
+    {
+    }
+
+    bool push(const value_type& value)
+    {
+        if (!_queue.push(value))
+            return false;
+        _waiter.notifyOne();
+        return true;
+    }
+
+    bool push(value_type&& value)
+    {
+        if (!_queue.push(std::move(value)))
+            return false;
+        _waiter.notifyOne();
+        return true;
+    }
+
+    bool tryPop(value_type& value)
+    {
+        return _queue.tryPop(value);
+    }
+
+    /** Pops a value, sleeping up to timeoutMs for one to arrive. */
+    bool waitPop(value_type& value, uint32 timeoutMs)
+    {
+        if (_queue.tryPop(value))
+            return true;
+        Queue& queue = _queue;
+        return _waiter.waitFor([&queue, &value]()
+        {
+            return queue.tryPop(value);
+        }, timeoutMs);
+    }
+
+    /** Wakes every sleeping consumer, e.g. on shutdown. */
+    void wakeAll(){ _waiter.notifyAll(); }
+
+    Queue&       queue(){ return _queue; }
+    const Queue& queue()const{ return _queue; }
+
+private:
+    Queue       _queue;
+    QueueWaiter _waiter;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_LOCKFREEQUEUE_H
@@ -0,0 +1,122 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <atomic>
+#include "MemoryTracker.h"
+
+NS_FK_BEGIN
+
+namespace
+{
+    const size_t TAG_COUNT = static_cast<size_t>(MemoryTag::Count);
+
+    const char* TagNames[TAG_COUNT] = { "DataStream", "FrameArena", "SlabPool", "Logger", "FileData" };
+
+    // Written by its owner thread only, read by anyone.
+    struct ThreadCounters
+    {
+        std::atomic<int64> allocations[TAG_COUNT];
+        ThreadCounters*    next;
+    };
+
+    // Blocks are never freed, the counts of finished threads stay in the totals.
+    std::atomic<ThreadCounters*> g_counters(nullptr);
+
+    // Live bytes are shared so every growth can be checked against the peak.
+    // Zero initialised before any constructor runs.
+    std::atomic<int64>           g_liveBytes[TAG_COUNT];
+    std::atomic<int64>           g_peakBytes[TAG_COUNT];
+
+    THREAD_LOCAL ThreadCounters* t_counters = nullptr;
+
+    ThreadCounters* getThreadCounters()
+    {
+        ThreadCounters* counters = t_counters;
+        if (counters == nullptr)
+        {
+            counters = new ThreadCounters();
+            for (size_t i = 0; i < TAG_COUNT; ++i)
+                counters->allocations[i].store(0, std::memory_order_relaxed);
+            counters->next = g_counters.load(std::memory_order_relaxed);
+            while (!g_counters.compare_exchange_weak(counters->next, counters, std::memory_order_release, std::memory_order_relaxed));
+            t_counters = counters;
+        }
+        return counters;
+    }
+
+    // Single writer, a plain load and store is enough and avoids a locked instruction.
+    inline void add(std::atomic<int64>& counter, int64 value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void addBytes(MemoryTag tag, int64 value)
+    {
+        int64 live = g_liveBytes[(size_t)tag].fetch_add(value, std::memory_order_relaxed) + value;
+        if (value <= 0)
+            return;
+        std::atomic<int64>& peakBytes = g_peakBytes[(size_t)tag];
+        int64 peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+    }
+
+    void sumAllocations(int64 (&allocations)[TAG_COUNT])
+    {
+        for (size_t i = 0; i < TAG_COUNT; ++i)
+            allocations[i] = 0;
+        for (ThreadCounters* counters = g_counters.load(std::memory_order_acquire); counters != nullptr; counters = counters->next)
+        {
+            for (size_t i = 0; i < TAG_COUNT; ++i)
+                allocations[i] += counters->allocations[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void MemoryTracker::allocate(MemoryTag tag, size_t bytes)
+{
+    addBytes(tag, (int64)bytes);
+    add(getThreadCounters()->allocations[(size_t)tag], 1);
+}
+
+void MemoryTracker::free(MemoryTag tag, size_t bytes)
+{
+    addBytes(tag, -(int64)bytes);
+    add(getThreadCounters()->allocations[(size_t)tag], -1);
+}
+
+void MemoryTracker::resize(MemoryTag tag, size_t oldBytes, size_t newBytes)
+{
+    if (oldBytes == newBytes)
+        return;
+    if (oldBytes == 0)
+        allocate(tag, newBytes);
+    else if (newBytes == 0)
+        free(tag, oldBytes);
+    else
+        addBytes(tag, (int64)newBytes - (int64)oldBytes);
+}
+
+void MemoryTracker::getStats(std::vector<MemoryTagStats>& out)
+{
+    int64 allocations[TAG_COUNT];
+    sumAllocations(allocations);
+    for (size_t i = 0; i < TAG_COUNT; ++i)
+    {
+        MemoryTagStats stats;
+        stats.name        = TagNames[i];
+        stats.bytes       = g_liveBytes[i].load(std::memory_order_relaxed);
+        stats.allocations = allocations[i];
+        stats.peakBytes   = g_peakBytes[i].load(std::memory_order_relaxed);
+        out.push_back(stats);
+    }
+}
+
+const char* MemoryTracker::getTagName(MemoryTag tag)
+{
+    return (size_t)tag < TAG_COUNT ? TagNames[(size_t)tag] : "Unknown";
+}
+
+NS_FK_END
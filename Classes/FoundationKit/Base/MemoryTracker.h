@@ -0,0 +1,64 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_MEMORYTRACKER_H
+#define LOSEMYMIND_MEMORYTRACKER_H
+
+#pragma once
+
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+NS_FK_BEGIN
+
+/** Subsystems whose memory is accounted separately. */
+enum class MemoryTag : uint8
+{
+    DataStream,   // DataStream buffers.
+    FrameArena,   // Per tick arenas, receive buffers included.
+    SlabPool,     // SlabAllocator slabs: sockets, connection records...
+    Logger,       // Logger rings.
+    FileData,     // Data buffers of file and zip reads.
+    Count,
+};
+
+struct MemoryTagStats
+{
+    const char* name;
+    int64       bytes;        // Live bytes.
+    int64       allocations;  // Live allocations.
+    int64       peakBytes;    // Highest live bytes so far.
+};
+
+/**
+ * Tagged memory accounting.
+ *
+ * Subsystems report their own allocations with allocate()/free(). Live
+ * bytes are one shared atomic per tag, so allocate() and a growing
+ * resize() can raise the high-water mark on the spot and short spikes
+ * between ticks are not missed. Allocation counts go into a private block
+ * per thread, an uncontended relaxed store; readers add the blocks of all
+ * threads up, a free on another thread shows up as a negative count in
+ * that thread's block.
+ */
+class MemoryTracker
+{
+public:
+    static void allocate(MemoryTag tag, size_t bytes);
+    static void free(MemoryTag tag, size_t bytes);
+
+    /** Accounts a buffer that grew or shrank in place from oldBytes to newBytes. */
+    static void resize(MemoryTag tag, size_t oldBytes, size_t newBytes);
+
+    /** One entry per tag, in MemoryTag order. */
+    static void getStats(std::vector<MemoryTagStats>& out);
+
+    static const char* getTagName(MemoryTag tag);
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_MEMORYTRACKER_H
@@ -0,0 +1,365 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include "Metrics.h"
+#include "FlatHashMap.h"
+#include "ThreadExit.h"
+
+NS_FK_BEGIN
+
+namespace
+{
+    // Slot 0 absorbs updates of metrics registered after the shards ran out.
+    const uint32 OVERFLOW_SLOT = 0;
+
+    struct MetricInfo
+    {
+        std::string         name;
+        std::string         labels;
+        std::string         help;
+        MetricType          type;
+        uint32              firstSlot;
+        std::atomic<int64>* gauge;
+        LatencyHistogram*   latency;
+        std::vector<int64>  bounds;
+    };
+
+    struct Registry
+    {
+        Registry() :nextSlot(OVERFLOW_SLOT + 1){}
+
+        std::mutex                                                  mutex;
+        std::vector<MetricInfo*>                                    metrics;
+        FlatHashMap<std::string, MetricInfo*, StringHash, StringEqual> byKey;
+        uint32                                                      nextSlot;
+        std::vector<Metrics::Collector>                             collectors;
+    };
+
+    // Created on first use: metrics are registered from static constructors.
+    // Never destroyed, handles in other static objects outlive this file.
+    Registry& getRegistry()
+    {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    // Forces creation during static initialisation, before any thread starts.
+    Registry& g_registry = getRegistry();
+
+    // Never null, a mismatched latency registration records into this one.
+    LatencyHistogram& getDiscardedLatency()
+    {
+        static LatencyHistogram* discarded = new LatencyHistogram();
+        return *discarded;
+    }
+
+    LatencyHistogram& g_discardedLatency = getDiscardedLatency();
+
+    // One per thread, written by its owner only. The padding keeps the first
+    // and last slots off cache lines shared with neighbouring heap blocks.
+    struct Shard
+    {
+        char               paddingBefore[64];
+        std::atomic<int64> values[Metrics::MAX_SLOTS];
+        char               paddingAfter[64];
+    };
+
+    // Shards of running threads. When a thread exits its counts are folded
+    // into retired and its shard is freed, so totals never go backwards.
+    struct ShardList
+    {
+        ShardList()
+        {
+            for (uint32 i = 0; i < Metrics::MAX_SLOTS; ++i)
+                retired.values[i].store(0, std::memory_order_relaxed);
+        }
+
+        std::mutex          mutex;
+        std::vector<Shard*> shards;
+        Shard               retired;
+    };
+
+    ShardList& getShardList()
+    {
+        static ShardList* shardList = new ShardList();
+        return *shardList;
+    }
+
+    ShardList& g_shardList = getShardList();
+
+    THREAD_LOCAL Shard* t_shard = nullptr;
+
+    void retireThreadShard(void* data)
+    {
+        Shard* shard = static_cast<Shard*>(data);
+        ShardList& shardList = getShardList();
+        {
+            std::lock_guard<std::mutex> lock(shardList.mutex);
+            for (uint32 i = 0; i < Metrics::MAX_SLOTS; ++i)
+            {
+                std::atomic<int64>& total = shardList.retired.values[i];
+                total.store(total.load(std::memory_order_relaxed) + shard->values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            shardList.shards.erase(std::find(shardList.shards.begin(), shardList.shards.end(), shard));
+        }
+        t_shard = nullptr;
+        delete shard;
+    }
+
+    Shard* getThreadShard()
+    {
+        Shard* shard = t_shard;
+        if (shard == nullptr)
+        {
+            shard = new Shard();
+            for (uint32 i = 0; i < Metrics::MAX_SLOTS; ++i)
+                shard->values[i].store(0, std::memory_order_relaxed);
+            ThreadExit::atExit(&retireThreadShard, shard);
+            ShardList& shardList = getShardList();
+            std::lock_guard<std::mutex> lock(shardList.mutex);
+            shardList.shards.push_back(shard);
+            t_shard = shard;
+        }
+        return shard;
+    }
+
+    // Gauges live as long as the process, the unaligned block is never freed.
+    std::atomic<int64>* newGaugeCell()
+    {
+        const uintptr_t CACHE_LINE = 64;
+        char* block = new char[CACHE_LINE * 2];
+        char* line = (char*)(((uintptr_t)block + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
+        return new (line) std::atomic<int64>(0);
+    }
+
+    // Callers hold the registry lock.
+    MetricInfo* findOrAdd(Registry& registry, const std::string& name, const std::string& help
+        , const std::string& labels, MetricType type, uint32 slotCount, bool& added)
+    {
+        std::string key = labels.empty() ? name : name + "{" + labels + "}";
+        auto iter = registry.byKey.find(key);
+        if (iter != registry.byKey.end())
+        {
+            added = false;
+            return iter->second;
+        }
+
+        MetricInfo* info = new MetricInfo();
+        info->name = name;
+        info->labels = labels;
+        info->help = help;
+        info->type = type;
+        info->firstSlot = OVERFLOW_SLOT;
+        info->gauge = nullptr;
+        info->latency = nullptr;
+        if (slotCount > 0)
+        {
+            if (registry.nextSlot + slotCount <= Metrics::MAX_SLOTS)
+            {
+                info->firstSlot = registry.nextSlot;
+                registry.nextSlot += slotCount;
+            }
+            else
+            {
+                fprintf(stderr, "Metrics: out of slots, %s is not recorded\n", key.c_str());
+            }
+        }
+        registry.metrics.push_back(info);
+        registry.byKey[key] = info;
+        added = true;
+        return info;
+    }
+}
+
+void Counter::increment(int64 value)const
+{
+    Metrics::addToSlot(_slot, value);
+}
+
+int64 Counter::value()const
+{
+    return Metrics::sumSlot(_slot);
+}
+
+void Histogram::observe(int64 value)const
+{
+    uint32 bucket = static_cast<uint32>(std::lower_bound(_bounds, _bounds + _boundCount, value) - _bounds);
+    Shard* shard = getThreadShard();
+    if (_firstSlot == OVERFLOW_SLOT)
+        return;
+    std::atomic<int64>& count = shard->values[_firstSlot + bucket];
+    std::atomic<int64>& sum = shard->values[_firstSlot + _boundCount + 1];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+Counter Metrics::counter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    bool added = false;
+    MetricInfo* info = findOrAdd(registry, name, help, labels, MetricType::Counter, 1, added);
+    return Counter(info->type == MetricType::Counter ? info->firstSlot : OVERFLOW_SLOT);
+}
+
+Gauge Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    bool added = false;
+    MetricInfo* info = findOrAdd(registry, name, help, labels, MetricType::Gauge, 0, added);
+    if (added)
+    {
+        // A cache line of its own, gauges are updated from several threads.
+        info->gauge = newGaugeCell();
+    }
+    return Gauge(info->gauge);
+}
+
+Histogram Metrics::histogram(const std::string& name, const std::string& help, const std::vector<int64>& bounds, const std::string& labels)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    bool added = false;
+    // One slot per bucket, +Inf bucket and sum.
+    MetricInfo* info = findOrAdd(registry, name, help, labels, MetricType::Histogram, (uint32)bounds.size() + 2, added);
+    if (added)
+        info->bounds = bounds;
+    if (info->type != MetricType::Histogram)
+        return Histogram();
+    return Histogram(info->firstSlot, info->bounds.data(), (uint32)info->bounds.size());
+}
+
+LatencyHistogram* Metrics::latency(const std::string& name, const std::string& help, const std::string& labels)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    bool added = false;
+    MetricInfo* info = findOrAdd(registry, name, help, labels, MetricType::Summary, 0, added);
+    if (added)
+        info->latency = new LatencyHistogram();
+    if (info->type != MetricType::Summary)
+        return &getDiscardedLatency();
+    return info->latency;
+}
+
+std::vector<int64> Metrics::exponentialBounds(int64 max)
+{
+    std::vector<int64> bounds;
+    const int64 steps[] = { 1, 2, 5 };
+    for (int64 scale = 1; scale <= max; scale *= 10)
+    {
+        for (int64 step : steps)
+        {
+            if (step * scale <= max)
+                bounds.push_back(step * scale);
+        }
+    }
+    return bounds;
+}
+
+void Metrics::addCollector(const Collector& collector)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.collectors.push_back(collector);
+}
+
+void Metrics::getSnapshot(std::vector<MetricSample>& out)
+{
+    // Every slot summed once, shards are walked a single time.
+    std::vector<int64> totals(MAX_SLOTS, 0);
+    {
+        ShardList& shardList = getShardList();
+        std::lock_guard<std::mutex> lock(shardList.mutex);
+        for (uint32 i = 0; i < MAX_SLOTS; ++i)
+            totals[i] = shardList.retired.values[i].load(std::memory_order_relaxed);
+        for (Shard* shard : shardList.shards)
+        {
+            for (uint32 i = 0; i < MAX_SLOTS; ++i)
+                totals[i] += shard->values[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    Registry& registry = getRegistry();
+    std::vector<Collector> collectors;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (MetricInfo* info : registry.metrics)
+        {
+            MetricSample sample;
+            sample.name = info->name;
+            sample.labels = info->labels;
+            sample.help = info->help;
+            sample.type = info->type;
+            sample.value = 0;
+            sample.sum = 0;
+            switch (info->type)
+            {
+            case MetricType::Counter:
+                sample.value = info->firstSlot != OVERFLOW_SLOT ? totals[info->firstSlot] : 0;
+                break;
+            case MetricType::Gauge:
+                sample.value = info->gauge->load(std::memory_order_relaxed);
+                break;
+            case MetricType::Histogram:
+                sample.bucketBounds = info->bounds;
+                sample.bucketCounts.resize(info->bounds.size() + 1, 0);
+                if (info->firstSlot != OVERFLOW_SLOT)
+                {
+                    for (size_t i = 0; i < sample.bucketCounts.size(); ++i)
+                    {
+                        sample.bucketCounts[i] = totals[info->firstSlot + i];
+                        sample.value += sample.bucketCounts[i];
+                    }
+                    sample.sum = totals[info->firstSlot + info->bounds.size() + 1];
+                }
+                break;
+            case MetricType::Summary:
+            {
+                LatencySummary summary = info->latency->getSummary();
+                sample.value = (int64)summary.count;
+                sample.sum = summary.sum;
+                const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+                const int64 values[] = { summary.p50, summary.p90, summary.p99, summary.p999, summary.max };
+                sample.quantiles.assign(quantiles, quantiles + 5);
+                sample.quantileValues.assign(values, values + 5);
+                break;
+            }
+            }
+            out.push_back(sample);
+        }
+        collectors = registry.collectors;
+    }
+    // Outside the lock, collectors may register metrics themselves.
+    for (auto& collector : collectors)
+    {
+        collector(out);
+    }
+}
+
+void Metrics::addToSlot(uint32 slot, int64 value)
+{
+    std::atomic<int64>& counter = getThreadShard()->values[slot];
+    // Single writer, a plain load and store is enough and avoids a locked instruction.
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+int64 Metrics::sumSlot(uint32 slot)
+{
+    ShardList& shardList = getShardList();
+    std::lock_guard<std::mutex> lock(shardList.mutex);
+    int64 total = shardList.retired.values[slot].load(std::memory_order_relaxed);
+    for (Shard* shard : shardList.shards)
+        total += shard->values[slot].load(std::memory_order_relaxed);
+    return total;
+}
+
+NS_FK_END
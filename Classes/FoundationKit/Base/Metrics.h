@@ -0,0 +1,160 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_METRICS_H
+#define LOSEMYMIND_METRICS_H
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/LatencyHistogram.h"
+
+NS_FK_BEGIN
+
+enum class MetricType : uint8
+{
+    Counter,    // Only goes up, e.g. messages received.
+    Gauge,      // Current value, e.g. open connections.
+    Histogram,  // Distribution of observed values, e.g. handler time.
+    Summary,    // Percentiles of a LatencyHistogram.
+};
+
+/** Aggregated value of one metric at the time of Metrics::getSnapshot(). */
+struct MetricSample
+{
+    std::string         name;
+    std::string         labels;        // Prometheus style: protocol="1001",reason="malformed"
+    std::string         help;
+    MetricType          type;
+    int64               value;         // Counter and gauge value, histogram and summary observation count.
+    int64               sum;           // Histogram and summary: sum of the observed values.
+    std::vector<int64>  bucketBounds;  // Histogram only: inclusive upper bounds, ascending.
+    std::vector<int64>  bucketCounts;  // Histogram only: bucketBounds.size() + 1 entries, the last one is +Inf.
+    std::vector<double> quantiles;     // Summary only: 0.5, 0.9, 0.99, 0.999 and 1 (the maximum).
+    std::vector<int64>  quantileValues;
+};
+
+/**
+ * Monotonic counter.
+ *
+ * increment() adds to a slot of the calling thread's shard: no lock, no
+ * locked instruction and no cache line shared with other threads. The
+ * shards are summed when a snapshot is taken. When a thread exits its
+ * shard is folded into a shared total and freed.
+ */
+class Counter
+{
+public:
+    Counter() :_slot(0){}
+    explicit Counter(uint32 slot) :_slot(slot){}
+
+    void  increment(int64 value = 1)const;
+    int64 value()const;
+
+private:
+    uint32 _slot;
+};
+
+/**
+ * Value that can go up and down.
+ *
+ * A gauge is one shared atomic on its own cache line: set() has to be
+ * visible as is, so it cannot be sharded. Use it for values that change
+ * far less often than a counter, or register a collector instead.
+ */
+class Gauge
+{
+public:
+    Gauge() :_value(nullptr){}
+    explicit Gauge(std::atomic<int64>* value) :_value(value){}
+
+    void  set(int64 value)const{ if (_value) _value->store(value, std::memory_order_relaxed); }
+    void  add(int64 value)const{ if (_value) _value->fetch_add(value, std::memory_order_relaxed); }
+    int64 value()const{ return _value ? _value->load(std::memory_order_relaxed) : 0; }
+
+private:
+    std::atomic<int64>* _value;
+};
+
+/**
+ * Histogram with fixed bucket bounds, sharded like Counter.
+ *
+ * observe() finds the bucket with a short search over the bounds and
+ * bumps two slots of the calling thread's shard (bucket and sum).
+ */
+class Histogram
+{
+public:
+    Histogram() :_firstSlot(0), _bounds(nullptr), _boundCount(0){}
+    Histogram(uint32 firstSlot, const int64* bounds, uint32 boundCount)
+        : _firstSlot(firstSlot), _bounds(bounds), _boundCount(boundCount){}
+
+    void observe(int64 value)const;
+
+private:
+    uint32       _firstSlot;
+    const int64* _bounds;
+    uint32       _boundCount;
+};
+
+/**
+ * Process wide registry of counters, gauges and histograms.
+ *
+ * Registering the same name and labels twice returns the same metric, so
+ * handles can be created wherever they are needed, e.g. in a constructor.
+ * Registration takes a lock; updates through the returned handles do not.
+ *
+ * Values that already live elsewhere (MemoryTracker, SlabAllocator) are
+ * reported by collectors, called on every snapshot.
+ *
+ * Sample usage, at file scope (function local statics are not thread safe
+ * on every compiler we build with):
+ *
+ *     static Counter g_packetsReceived = Metrics::counter("viserver_packets_received_total", "Packets received.");
+ *     g_packetsReceived.increment();
+ */
+class Metrics
+{
+public:
+    /** Metric slots per thread shard, a histogram takes its bucket count plus two. */
+    static const uint32 MAX_SLOTS = 2048;
+
+    typedef std::function<void(std::vector<MetricSample>&)> Collector;
+
+    static Counter   counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    static Gauge     gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /** bounds are the inclusive upper bounds of the buckets, ascending; +Inf is implied. */
+    static Histogram histogram(const std::string& name, const std::string& help, const std::vector<int64>& bounds, const std::string& labels = "");
+
+    /**
+     * Latency histogram reported with percentiles. The histogram is owned by
+     * the registry and lives as long as the process; record into it directly.
+     */
+    static LatencyHistogram* latency(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /** Bounds 1, 2, 5, 10, 20, 50 ... up to max, handy for times in microseconds. */
+    static std::vector<int64> exponentialBounds(int64 max);
+
+    static void addCollector(const Collector& collector);
+
+    /** Sums the shards of every thread and runs the collectors. */
+    static void getSnapshot(std::vector<MetricSample>& out);
+
+    /** Adds value to a slot of the calling thread's shard. */
+    static void addToSlot(uint32 slot, int64 value);
+
+    /** Sum of one slot over all shards. */
+    static int64 sumSlot(uint32 slot);
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_METRICS_H
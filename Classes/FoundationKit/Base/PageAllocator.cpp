@@ -0,0 +1,161 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <atomic>
+#include <cstdlib>
+#include "PageAllocator.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+NS_FK_BEGIN
+
+const size_t PageAllocator::HUGE_PAGE_SIZE;
+
+namespace
+{
+    std::atomic<bool> g_hugePagesEnabled(true);
+
+    size_t roundUp(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    // 0 until the first attempt, then 1 if large pages can be used, -1 if not.
+    std::atomic<int> g_largePagesState(0);
+
+    bool enableLargePages()
+    {
+        int state = g_largePagesState.load(std::memory_order_relaxed);
+        if (state != 0)
+            return state > 0;
+
+        bool enabled = false;
+        HANDLE token = nullptr;
+        if (GetLargePageMinimum() > 0 && OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            TOKEN_PRIVILEGES privileges;
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+            if (LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid))
+            {
+                AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr);
+                // AdjustTokenPrivileges succeeds even when the privilege was not granted.
+                enabled = GetLastError() == ERROR_SUCCESS;
+            }
+            CloseHandle(token);
+        }
+        g_largePagesState.store(enabled ? 1 : -1, std::memory_order_relaxed);
+        return enabled;
+    }
+#endif
+}
+
+PageBlock PageAllocator::allocate(size_t size, bool hugePages)
+{
+    PageBlock block = { nullptr, 0, PageKind::Normal };
+    hugePages = hugePages && isHugePagesEnabled();
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    if (hugePages && enableLargePages())
+    {
+        size_t largeSize = roundUp(size, GetLargePageMinimum());
+        block.base = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (block.base != nullptr)
+        {
+            block.size = largeSize;
+            block.kind = PageKind::Huge;
+            return block;
+        }
+    }
+    block.size = roundUp(size, 64 * 1024);
+    block.base = VirtualAlloc(nullptr, block.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    if (hugePages)
+    {
+        size_t hugeSize = roundUp(size, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+        void* base = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            block.base = base;
+            block.size = hugeSize;
+            block.kind = PageKind::Huge;
+            return block;
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        // No reserved huge pages: map one extra huge page, trim the mapping
+        // to a 2MB boundary and let the kernel back it transparently.
+        uint8* raw = static_cast<uint8*>(mmap(nullptr, hugeSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw != MAP_FAILED)
+        {
+            uint8* aligned = reinterpret_cast<uint8*>(roundUp(reinterpret_cast<UPTRINT>(raw), HUGE_PAGE_SIZE));
+            size_t head = aligned - raw;
+            size_t tail = HUGE_PAGE_SIZE - head;
+            if (head > 0)
+                munmap(raw, head);
+            if (tail > 0)
+                munmap(aligned + hugeSize, tail);
+            madvise(aligned, hugeSize, MADV_HUGEPAGE);
+            block.base = aligned;
+            block.size = hugeSize;
+            block.kind = PageKind::TransparentHuge;
+            return block;
+        }
+#endif
+    }
+    block.size = roundUp(size, (size_t)sysconf(_SC_PAGESIZE));
+    void* base = mmap(nullptr, block.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    block.base = base != MAP_FAILED ? base : nullptr;
+#endif
+    return block;
+}
+
+void PageAllocator::free(const PageBlock& block)
+{
+    if (block.base == nullptr)
+        return;
+    if (block.kind == PageKind::Heap)
+    {
+        ::free(block.base);
+        return;
+    }
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    VirtualFree(block.base, 0, MEM_RELEASE);
+#else
+    munmap(block.base, block.size);
+#endif
+}
+
+void PageAllocator::setHugePagesEnabled(bool enabled)
+{
+    g_hugePagesEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool PageAllocator::isHugePagesEnabled()
+{
+    return g_hugePagesEnabled.load(std::memory_order_relaxed);
+}
+
+const char* PageAllocator::getKindName(PageKind kind)
+{
+    switch (kind)
+    {
+    case PageKind::Heap:            return "heap";
+    case PageKind::Normal:          return "normal";
+    case PageKind::TransparentHuge: return "thp";
+    case PageKind::Huge:            return "huge";
+    }
+    return "unknown";
+}
+
+NS_FK_END
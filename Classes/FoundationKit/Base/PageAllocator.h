@@ -0,0 +1,66 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_PAGEALLOCATOR_H
+#define LOSEMYMIND_PAGEALLOCATOR_H
+
+#pragma once
+
+#include <cstddef>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+NS_FK_BEGIN
+
+/** How a PageBlock is backed. */
+enum class PageKind : uint8
+{
+    Heap,             // malloc, used by allocators that did not ask for pages.
+    Normal,           // Regular pages straight from the OS.
+    TransparentHuge,  // Regular mapping advised for transparent huge pages (Linux).
+    Huge,             // Explicit huge/large pages: MAP_HUGETLB or MEM_LARGE_PAGES.
+};
+
+struct PageBlock
+{
+    void*    base;
+    size_t   size;
+    PageKind kind;
+};
+
+/**
+ * Memory straight from the OS, optionally backed by 2MB huge pages to cut
+ * TLB misses on large pools.
+ *
+ * With hugePages set, allocate() tries in order:
+ *   - Linux:   MAP_HUGETLB (needs pages reserved in vm.nr_hugepages), then a
+ *              2MB aligned mapping with madvise(MADV_HUGEPAGE).
+ *   - Windows: VirtualAlloc with MEM_LARGE_PAGES (needs the "Lock pages in
+ *              memory" right, enabled on first use if the account has it).
+ * and falls back to normal pages when none of them is available, so callers
+ * never have to handle a missing feature.
+ */
+class PageAllocator
+{
+public:
+    /** Size huge page backed blocks are rounded up to. */
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    /** Returns a block with base == nullptr when out of memory. */
+    static PageBlock allocate(size_t size, bool hugePages);
+
+    /** Releases a block from allocate(), PageKind::Heap blocks go to free(). */
+    static void      free(const PageBlock& block);
+
+    /** Process wide switch, huge page requests get normal pages while disabled. */
+    static void      setHugePagesEnabled(bool enabled);
+    static bool      isHugePagesEnabled();
+
+    static const char* getKindName(PageKind kind);
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_PAGEALLOCATOR_H
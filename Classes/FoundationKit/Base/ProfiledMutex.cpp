@@ -0,0 +1,82 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <string>
+#include "ProfiledMutex.h"
+#include "FoundationKit/Base/FlatHashMap.h"
+
+NS_FK_BEGIN
+
+std::atomic<bool> ProfiledMutex::s_profiling(false);
+
+#if LOCK_PROFILING
+namespace
+{
+    typedef FlatHashMap<std::string, LockStats*, StringHash, StringEqual> LockStatsMap;
+
+    // ProfiledMutexes are constructed during static initialization of other
+    // translation units too, so the table is created on first use, and the
+    // reference below makes sure that use happens before main() starts any
+    // thread. Never freed, a lock may be destroyed and created again under
+    // its name.
+    struct LockStatsTable
+    {
+        std::mutex   mutex;
+        LockStatsMap stats;
+    };
+
+    LockStatsTable& getLockStatsTable()
+    {
+        static LockStatsTable* s_table = new LockStatsTable();
+        return *s_table;
+    }
+
+    LockStatsTable& g_lockStatsTable = getLockStatsTable();
+
+    // Locks with the same name share their stats.
+    LockStats* getLockStats(const char* name)
+    {
+        LockStatsTable& table = getLockStatsTable();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto iter = table.stats.find(name);
+        if (iter != table.stats.end())
+            return iter->second;
+
+        std::string labels = std::string("lock=\"") + name + "\"";
+        LockStats* stats = new LockStats();
+        stats->acquisitions = Metrics::counter("viserver_lock_acquisitions_total", "Acquisitions of a ProfiledMutex while lock profiling is on.", labels);
+        stats->contentions = Metrics::counter("viserver_lock_contentions_total", "Acquisitions of a ProfiledMutex that found it held.", labels);
+        stats->waitTime = Metrics::latency("viserver_lock_wait_nanoseconds", "Time spent blocked acquiring a contended ProfiledMutex.", labels);
+        stats->holdTime = Metrics::latency("viserver_lock_hold_nanoseconds", "Time a ProfiledMutex was held.", labels);
+        table.stats.insert(std::make_pair(std::string(name), stats));
+        return stats;
+    }
+}
+#endif
+
+ProfiledMutex::ProfiledMutex()
+#if LOCK_PROFILING
+    : _stats(getLockStats("unnamed"))
+    , _acquiredAt(0)
+#endif
+{
+}
+
+ProfiledMutex::ProfiledMutex(const char* name)
+#if LOCK_PROFILING
+    : _stats(getLockStats(name))
+    , _acquiredAt(0)
+#endif
+{
+    (void)name;
+}
+
+void ProfiledMutex::setProfiling(bool enabled)
+{
+    s_profiling.store(enabled, std::memory_order_relaxed);
+}
+
+NS_FK_END
@@ -0,0 +1,156 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include "RequestTracer.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/ProfiledMutex.h"
+#include "FoundationKit/Foundation/unique_id.hpp"
+
+NS_FK_BEGIN
+
+namespace
+{
+    std::atomic<uint32> g_sampleRate(100);
+    std::atomic<uint32> g_sampleCounter(0);
+    Counter             g_clientTracesThrottled = Metrics::counter("viserver_request_traces_throttled_total"
+        , "Client trace ids ignored because the connection sent too many.");
+
+    // Last CAPACITY complete traces, g_recorded % CAPACITY is the next slot.
+    ProfiledMutex       g_tracesMutex("request_traces");
+    RequestTrace        g_traces[RequestTracer::CAPACITY];
+    uint64              g_recorded = 0;
+
+    // One second windows on the connection's Received stamps.
+    bool allowClientTrace(RequestTrace& trace)
+    {
+        int64 now = trace.stages[(uint32)TraceStage::Received];
+        if (now - trace.clientWindowStart >= 1000000000)
+        {
+            trace.clientWindowStart = now;
+            trace.clientWindowCount = 0;
+        }
+        if (trace.clientWindowCount >= RequestTracer::CLIENT_TRACES_PER_SECOND)
+            return false;
+        ++trace.clientWindowCount;
+        return true;
+    }
+
+    void appendStage(std::string& out, const RequestTrace& trace, TraceStage stage)
+    {
+        out += ',';
+        int64 time = trace.stages[(uint32)stage];
+        int64 received = trace.stages[(uint32)TraceStage::Received];
+        if (time != 0 && received != 0)
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%lld", (long long)(time - received));
+            out += buffer;
+        }
+    }
+}
+
+void RequestTracer::setSampleRate(uint32 oneIn)
+{
+    g_sampleRate.store(oneIn, std::memory_order_relaxed);
+}
+
+uint32 RequestTracer::getSampleRate()
+{
+    return g_sampleRate.load(std::memory_order_relaxed);
+}
+
+bool RequestTracer::begin(RequestTrace& trace, uint64 traceId, uint64 clientId, int32 protocolId)
+{
+    uint32 flags = FROM_CLIENT;
+    if (traceId != 0 && !allowClientTrace(trace))
+    {
+        g_clientTracesThrottled.increment();
+        traceId = 0;
+    }
+    if (traceId == 0)
+    {
+        uint32 rate = g_sampleRate.load(std::memory_order_relaxed);
+        if (rate == 0 || g_sampleCounter.fetch_add(1, std::memory_order_relaxed) % rate != 0)
+            return false;
+        traceId = unique_id::create();
+        flags = 0;
+    }
+    trace.traceId = traceId;
+    trace.clientId = clientId;
+    trace.protocolId = protocolId;
+    trace.flags = flags;
+    for (uint32 i = (uint32)TraceStage::Received + 1; i < (uint32)TraceStage::Count; ++i)
+    {
+        trace.stages[i] = 0;
+    }
+    return true;
+}
+
+void RequestTracer::mark(RequestTrace& trace, TraceStage stage, int64 time)
+{
+    if (trace.traceId == 0 || trace.stages[(uint32)stage] != 0)
+        return;
+    trace.stages[(uint32)stage] = time;
+    if (trace.stages[(uint32)TraceStage::Handled] != 0 && trace.stages[(uint32)TraceStage::Sent] != 0)
+        record(trace);
+}
+
+void RequestTracer::finish(RequestTrace& trace)
+{
+    if (trace.traceId != 0)
+        record(trace);
+}
+
+void RequestTracer::record(RequestTrace& trace)
+{
+    {
+        std::lock_guard<ProfiledMutex> lock(g_tracesMutex);
+        g_traces[g_recorded % CAPACITY] = trace;
+        ++g_recorded;
+    }
+    trace.traceId = 0;
+}
+
+void RequestTracer::getTraces(std::vector<RequestTrace>& out, uint64 traceId)
+{
+    out.clear();
+    std::lock_guard<ProfiledMutex> lock(g_tracesMutex);
+    uint64 first = g_recorded > CAPACITY ? g_recorded - CAPACITY : 0;
+    for (uint64 i = first; i < g_recorded; ++i)
+    {
+        const RequestTrace& trace = g_traces[i % CAPACITY];
+        if (traceId == 0 || trace.traceId == traceId)
+            out.push_back(trace);
+    }
+}
+
+uint64 RequestTracer::getRecordedCount()
+{
+    std::lock_guard<ProfiledMutex> lock(g_tracesMutex);
+    return g_recorded;
+}
+
+void RequestTracer::writeCsv(const std::vector<RequestTrace>& traces, std::string& out)
+{
+    out.reserve(out.size() + 64 + traces.size() * 64);
+    out += "trace_id,client_id,protocol,origin,dispatched_ns,handled_ns,sent_ns\n";
+    char buffer[96];
+    for (auto& trace : traces)
+    {
+        snprintf(buffer, sizeof(buffer), "%llu,%llu,%d,%s", (unsigned long long)trace.traceId
+            , (unsigned long long)trace.clientId, trace.protocolId, (trace.flags & FROM_CLIENT) ? "client" : "sampled");
+        out += buffer;
+        appendStage(out, trace, TraceStage::Dispatched);
+        appendStage(out, trace, TraceStage::Handled);
+        appendStage(out, trace, TraceStage::Sent);
+        out += '\n';
+    }
+}
+
+NS_FK_END
@@ -0,0 +1,109 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_REQUESTTRACER_H
+#define LOSEMYMIND_REQUESTTRACER_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+NS_FK_BEGIN
+
+/** Pipeline stages of a request, in the order they are normally reached. */
+enum class TraceStage : uint32
+{
+    Received,    // The bytes came out of Recv.
+    Dispatched,  // The header was decoded and the handler is about to run.
+    Handled,     // The handler returned.
+    Sent,        // The first send on the connection after Received.
+    Count
+};
+
+/**
+ * One request being traced, kept on its connection while in flight and
+ * copied into the trace buffer once it is complete.
+ */
+struct RequestTrace
+{
+    uint64 traceId;      // 0 while the request is not traced.
+    uint64 clientId;
+    int32  protocolId;
+    uint32 flags;        // RequestTracer::FROM_CLIENT
+    int64  stages[(uint32)TraceStage::Count]; // Timer::nowNanoseconds(), 0 if not reached.
+    int64  clientWindowStart;  // Limits the trace ids this connection may send.
+    uint32 clientWindowCount;
+};
+
+/**
+ * Sampled per-request stage timestamps.
+ *
+ * A request is traced when the client put a trace id in the frame header,
+ * and one request in getSampleRate() is traced on top of that with an id
+ * generated here. A connection gets at most CLIENT_TRACES_PER_SECOND of its
+ * trace ids honoured, the others are sampled like any request, so a client
+ * flagging every frame cannot push the sampled traces out of the ring.
+ *
+ * Each stage is stamped once, the first time it is reached; a trace is
+ * complete when it was both handled and answered, or when the next request
+ * on the connection or the connection's end cuts it short. Complete traces
+ * go into a ring of the last CAPACITY traces.
+ *
+ * A RequestTrace belongs to its connection and is stamped by whoever
+ * touches the connection, the same as Socket::MarkRequestReceived. Only
+ * recording a complete trace takes a lock, so requests that are not traced
+ * never do.
+ *
+ * Exported as CSV, one request per line, stage times in nanoseconds after
+ * Received:
+ *
+ *     trace_id,client_id,protocol,origin,dispatched_ns,handled_ns,sent_ns
+ *     7421318734127104,4611,1001,client,2100,48300,45900
+ *
+ * Here the handler took 46.2us and sent its answer before returning. An
+ * empty column is a stage the request never reached.
+ */
+class RequestTracer
+{
+public:
+    static const uint32 CAPACITY = 4096;
+    static const uint32 FROM_CLIENT = 1;
+    static const uint32 CLIENT_TRACES_PER_SECOND = 10;
+
+    /** Traces one request in oneIn besides those carrying a trace id; 0 traces only those. */
+    static void   setSampleRate(uint32 oneIn);
+    static uint32 getSampleRate();
+
+    /**
+     * Starts tracing once the header is decoded, keeping the Received stamp.
+     * traceId is the one from the header, 0 if there was none. Returns
+     * false if the request is not traced.
+     */
+    static bool begin(RequestTrace& trace, uint64 traceId, uint64 clientId, int32 protocolId);
+
+    /** Stamps stage unless it already was; records the trace when it completes. */
+    static void mark(RequestTrace& trace, TraceStage stage, int64 time);
+
+    /** Records what the trace reached so far and stops tracing. */
+    static void finish(RequestTrace& trace);
+
+    /** Recorded traces, oldest first; only the one with traceId if it is not 0. */
+    static void getTraces(std::vector<RequestTrace>& out, uint64 traceId = 0);
+
+    /** Traces recorded since startup, including those the ring dropped. */
+    static uint64 getRecordedCount();
+
+    static void writeCsv(const std::vector<RequestTrace>& traces, std::string& out);
+
+private:
+    static void record(RequestTrace& trace);
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_REQUESTTRACER_H
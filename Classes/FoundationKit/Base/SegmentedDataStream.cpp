@@ -0,0 +1,214 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+#include <mutex>
+#include <algorithm>
+#include "SegmentedDataStream.h"
+
+NS_FK_BEGIN
+
+const SegmentedDataStream::size_type SegmentedDataStream::CHUNK_SIZE;
+
+namespace
+{
+    // Process wide pool of fixed-size chunks shared by every
+    // SegmentedDataStream, so steady state traffic stops allocating.
+    class SegmentPool
+    {
+    public:
+        static const size_t MAX_FREE_CHUNKS = 1024;
+
+        static SegmentPool& getInstance()
+        {
+            static SegmentPool pool;
+            return pool;
+        }
+
+        uint8* acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_freeChunks.empty())
+                {
+                    uint8* chunk = _freeChunks.back();
+                    _freeChunks.pop_back();
+                    return chunk;
+                }
+            }
+            return new uint8[SegmentedDataStream::CHUNK_SIZE];
+        }
+
+        void release(uint8* chunk)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_freeChunks.size() < MAX_FREE_CHUNKS)
+                {
+                    _freeChunks.push_back(chunk);
+                    return;
+                }
+            }
+            delete[] chunk;
+        }
+
+        ~SegmentPool()
+        {
+            for (auto chunk : _freeChunks)
+            {
+                delete[] chunk;
+            }
+        }
+
+    private:
+        std::mutex           _mutex;
+        std::vector<uint8*>  _freeChunks;
+    };
+}
+
+SegmentedDataStream::SegmentedDataStream()
+    : _size(0)
+{
+}
+
+SegmentedDataStream::SegmentedDataStream(SegmentedDataStream&& other)
+    : _segments(std::move(other._segments))
+    , _size(other._size)
+{
+    other._segments.clear();
+    other._size = 0;
+}
+
+SegmentedDataStream& SegmentedDataStream::operator=(SegmentedDataStream&& other)
+{
+    if (this != &other)
+    {
+        releaseSegments();
+        _segments = std::move(other._segments);
+        _size = other._size;
+        other._segments.clear();
+        other._size = 0;
+    }
+    return *this;
+}
+
+SegmentedDataStream::~SegmentedDataStream()
+{
+    releaseSegments();
+}
+
+SegmentedDataStream& SegmentedDataStream::operator << (const uint8* data)
+{
+    *this << ustring(data);
+    return *this;
+}
+
+SegmentedDataStream& SegmentedDataStream::operator << (const std::string& data)
+{
+    this->write((const uint8*)data.c_str(), data.size());
+    return *this;
+}
+
+SegmentedDataStream& SegmentedDataStream::operator << (const ustring& data)
+{
+    *this << data.size();
+    append(data.c_str(), data.size());
+    return *this;
+}
+
+void SegmentedDataStream::write(const uint8* data, size_type size)
+{
+    *this << size;
+    append(data, size);
+}
+
+void SegmentedDataStream::append(const uint8* data, size_t size)
+{
+    while (size > 0)
+    {
+        if (_segments.empty() || _segments.back().end == CHUNK_SIZE)
+        {
+            Segment segment = { SegmentPool::getInstance().acquire(), 0, 0 };
+            _segments.push_back(segment);
+        }
+        Segment& tail = _segments.back();
+        size_t count = std::min<size_t>(size, CHUNK_SIZE - tail.end);
+        memcpy(tail.data + tail.end, data, count);
+        tail.end += static_cast<size_type>(count);
+        _size += count;
+        data  += count;
+        size  -= count;
+    }
+}
+
+void SegmentedDataStream::consume(size_t count)
+{
+    count = std::min(count, _size);
+    size_t drop = 0;
+    while (count > 0)
+    {
+        Segment& head = _segments[drop];
+        size_t available = head.end - head.begin;
+        size_t taken = std::min(available, count);
+        head.begin += static_cast<size_type>(taken);
+        _size -= taken;
+        count -= taken;
+        if (head.begin == head.end)
+        {
+            SegmentPool::getInstance().release(head.data);
+            ++drop;
+        }
+    }
+    _segments.erase(_segments.begin(), _segments.begin() + drop);
+}
+
+void SegmentedDataStream::clear()
+{
+    releaseSegments();
+}
+
+size_t SegmentedDataStream::size()const
+{
+    return _size;
+}
+
+size_t SegmentedDataStream::getSegments(std::vector<IOVec>& outSegments)const
+{
+    outSegments.clear();
+    outSegments.reserve(_segments.size());
+    for (auto& segment : _segments)
+    {
+        if (segment.end > segment.begin)
+        {
+            IOVec vec = { segment.data + segment.begin, segment.end - segment.begin };
+            outSegments.push_back(vec);
+        }
+    }
+    return outSegments.size();
+}
+
+ustring SegmentedDataStream::flatten()const
+{
+    ustring result;
+    result.reserve(_size);
+    for (auto& segment : _segments)
+    {
+        result.append(segment.data + segment.begin, segment.end - segment.begin);
+    }
+    return result;
+}
+
+void SegmentedDataStream::releaseSegments()
+{
+    for (auto& segment : _segments)
+    {
+        SegmentPool::getInstance().release(segment.data);
+    }
+    _segments.clear();
+    _size = 0;
+}
+
+NS_FK_END
@@ -0,0 +1,164 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_SEGMENTEDDATASTREAM_H
+#define LOSEMYMIND_SEGMENTEDDATASTREAM_H
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+/**
+ * A scatter/gather buffer descriptor.
+ * On POSIX platforms the layout matches struct iovec, so an array of
+ * IOVec can be handed to writev/sendmsg directly.
+ */
+struct IOVec
+{
+    void*  base;
+    size_t len;
+};
+
+/**
+ * A write-only stream built from a chain of fixed-size chunks.
+ *
+ * Unlike DataStream, appending never reallocates or copies data that was
+ * already written: when the tail chunk is full a new chunk is taken from
+ * a shared pool. The wire format is identical to DataStream, so a message
+ * written here can be read back by DataStream on the other side.
+ *
+ * Use getSegments() to obtain an IOVec list and send it with
+ * Socket::SendV(), so large messages are never flattened.
+ */
+class SegmentedDataStream : noncopyable
+{
+public:
+    typedef uint32 size_type;
+
+    /** Size of every chunk in the chain. */
+    static const size_type CHUNK_SIZE = 16 * 1024;
+
+    SegmentedDataStream();
+    SegmentedDataStream(SegmentedDataStream&& other);
+    SegmentedDataStream& operator=(SegmentedDataStream&& other);
+    ~SegmentedDataStream();
+
+    template<typename T, typename = typename std::enable_if<std::is_fundamental<T>::value>::type >
+    SegmentedDataStream& operator<<(T data)
+    {
+        append((const uint8*)&data, sizeof(T));
+        return *this;
+    }
+
+    SegmentedDataStream& operator<<(const uint8* data);
+    SegmentedDataStream& operator<<(const std::string& data);
+    SegmentedDataStream& operator<<(const ustring& data);
+
+    template <typename K, typename V>
+    SegmentedDataStream& operator<<(const std::map<K, V>& data)
+    {
+        return writeAssociativeContainer(data);
+    }
+
+    template <typename K, typename V>
+    SegmentedDataStream& operator<<(const std::unordered_map<K, V>& data)
+    {
+        return writeAssociativeContainer(data);
+    }
+
+    template <typename V>
+    SegmentedDataStream& operator<<(const std::vector<V>& data)
+    {
+        return writeSequenceContainer(data);
+    }
+
+    template <typename V>
+    SegmentedDataStream& operator<<(const std::list<V>& data)
+    {
+        return writeSequenceContainer(data);
+    }
+
+    /** Writes a size prefixed block, same as DataStream::write. */
+    void   write(const uint8* data, size_type size);
+
+    /** Appends raw bytes without a size prefix. */
+    void   append(const uint8* data, size_t size);
+
+    /**
+     * Drops bytes from the front of the stream, returning emptied chunks
+     * to the pool. Used after a partial send.
+     */
+    void   consume(size_t count);
+
+    /** Releases all chunks back to the pool. */
+    void   clear();
+
+    /** Total number of readable bytes. */
+    size_t size()const;
+
+    bool   empty()const{ return _size == 0; }
+
+    /** Number of chunks currently in the chain. */
+    size_t segmentCount()const{ return _segments.size(); }
+
+    /**
+     * Fills outSegments with one IOVec per non-empty chunk.
+     * @return The number of segments written.
+     */
+    size_t getSegments(std::vector<IOVec>& outSegments)const;
+
+    /** Copies the whole chain into one contiguous buffer. */
+    ustring flatten()const;
+
+private:
+    struct Segment
+    {
+        uint8*    data;
+        size_type begin;
+        size_type end;
+    };
+
+    template<typename C>
+    SegmentedDataStream& writeSequenceContainer(const C& data)
+    {
+        *this << data.size();
+        for (auto iter : data)
+        {
+            *this << iter;
+        }
+        return *this;
+    }
+
+    template<typename C>
+    SegmentedDataStream& writeAssociativeContainer(const C& data)
+    {
+        *this << data.size();
+        for (auto& iter : data)
+        {
+            *this << iter.first << iter.second;
+        }
+        return *this;
+    }
+
+    void releaseSegments();
+
+protected:
+    std::vector<Segment> _segments;
+    size_t               _size;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_SEGMENTEDDATASTREAM_H
@@ -0,0 +1,176 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <cstdlib>
+#include <cstdio>
+#include "SlabAllocator.h"
+#include "MemoryTracker.h"
+
+NS_FK_BEGIN
+
+const size_t SlabAllocator::DEFAULT_SLAB_SIZE;
+const size_t SlabAllocator::MAX_ALIGNMENT;
+
+namespace
+{
+    std::mutex& getRegistryMutex()
+    {
+        static std::mutex* registryMutex = new std::mutex();
+        return *registryMutex;
+    }
+
+    // Pools are created on several threads; this creates the mutex during
+    // static initialization, before any of them start.
+    std::mutex& g_registryMutex = getRegistryMutex();
+
+    // Live allocators form an intrusive list, guarded by getRegistryMutex().
+    SlabAllocator* g_allocators = nullptr;
+}
+
+SlabAllocator::SlabAllocator(const std::string& name, size_t objectSize, size_t alignment, size_t slabSize, bool hugePages)
+    : _name(name)
+    , _objectSize(0)
+    , _slabSize(slabSize)
+    , _hugePages(hugePages)
+    , _freeList(nullptr)
+    , _inUse(0)
+    , _peakInUse(0)
+    , _allocations(0)
+    , _frees(0)
+    , _prev(nullptr)
+    , _next(nullptr)
+{
+    LOG_ASSERT(alignment <= MAX_ALIGNMENT && (alignment & (alignment - 1)) == 0, "SlabAllocator alignment must be a power of two up to 16.");
+    if (alignment < sizeof(FreeNode))
+        alignment = sizeof(FreeNode);
+    if (objectSize < sizeof(FreeNode))
+        objectSize = sizeof(FreeNode);
+    _objectSize = (objectSize + alignment - 1) & ~(alignment - 1);
+    if (_slabSize < _objectSize)
+        _slabSize = _objectSize;
+
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    _next = g_allocators;
+    if (g_allocators != nullptr)
+        g_allocators->_prev = this;
+    g_allocators = this;
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    {
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        if (_prev != nullptr)
+            _prev->_next = _next;
+        else
+            g_allocators = _next;
+        if (_next != nullptr)
+            _next->_prev = _prev;
+    }
+
+    // Static pools may go away while objects are still referenced during
+    // shutdown, leaking is safer than freeing memory under them.
+    if (_inUse > 0)
+    {
+        fprintf(stderr, "SlabAllocator[%s]: %u objects still in use, slabs are not freed\n", _name.c_str(), (uint32)_inUse);
+        return;
+    }
+    for (auto& slab : _slabs)
+    {
+        MemoryTracker::free(MemoryTag::SlabPool, slab.size);
+        PageAllocator::free(slab);
+    }
+}
+
+void* SlabAllocator::allocate()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_freeList == nullptr)
+        addSlab();
+    FreeNode* node = _freeList;
+    _freeList = node->next;
+    ++_allocations;
+    if (++_inUse > _peakInUse)
+        _peakInUse = _inUse;
+    return node;
+}
+
+void SlabAllocator::deallocate(void* p)
+{
+    if (p == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    FreeNode* node = static_cast<FreeNode*>(p);
+    node->next = _freeList;
+    _freeList = node;
+    ++_frees;
+    --_inUse;
+}
+
+SlabStats SlabAllocator::getStats()const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    SlabStats stats;
+    stats.name        = _name;
+    stats.objectSize  = _objectSize;
+    stats.slabCount   = _slabs.size();
+    stats.capacity    = 0;
+    stats.hugePageSlabs = 0;
+    for (auto& slab : _slabs)
+    {
+        stats.capacity += slab.size / _objectSize;
+        if (slab.kind == PageKind::Huge || slab.kind == PageKind::TransparentHuge)
+            ++stats.hugePageSlabs;
+    }
+    stats.inUse       = _inUse;
+    stats.peakInUse   = _peakInUse;
+    stats.allocations = _allocations;
+    stats.frees       = _frees;
+    return stats;
+}
+
+void SlabAllocator::getAllStats(std::vector<SlabStats>& out)
+{
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    for (SlabAllocator* allocator = g_allocators; allocator != nullptr; allocator = allocator->_next)
+    {
+        out.push_back(allocator->getStats());
+    }
+}
+
+void SlabAllocator::setHugePages(bool hugePages)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _hugePages = hugePages;
+}
+
+void SlabAllocator::addSlab()
+{
+    PageBlock block = { nullptr, _slabSize, PageKind::Heap };
+    if (_hugePages)
+        block = PageAllocator::allocate(_slabSize, true);
+    else
+        block.base = malloc(_slabSize + MAX_ALIGNMENT); // Only 8 bytes aligned on 32 bit targets.
+    if (block.base == nullptr)
+        throw std::bad_alloc();
+    _slabs.push_back(block);
+    MemoryTracker::allocate(MemoryTag::SlabPool, block.size);
+
+    // Objects start at the first MAX_ALIGNMENT boundary, heap slabs carry the
+    // slack for it. Page backed slabs are aligned and rounded up, use all of them.
+    uint8* slab = reinterpret_cast<uint8*>((reinterpret_cast<UPTRINT>(block.base) + MAX_ALIGNMENT - 1) & ~(UPTRINT)(MAX_ALIGNMENT - 1));
+    size_t objectCount = block.size / _objectSize;
+
+    // Thread the new objects in address order, so they are handed out sequentially.
+    for (size_t i = objectCount; i > 0; --i)
+    {
+        FreeNode* node = reinterpret_cast<FreeNode*>(slab + (i - 1) * _objectSize);
+        node->next = _freeList;
+        _freeList = node;
+    }
+}
+
+NS_FK_END
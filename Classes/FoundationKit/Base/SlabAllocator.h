@@ -0,0 +1,286 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_SLABALLOCATOR_H
+#define LOSEMYMIND_SLABALLOCATOR_H
+
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+#include "FoundationKit/Base/PageAllocator.h"
+
+NS_FK_BEGIN
+
+struct SlabStats
+{
+    std::string name;
+    size_t      objectSize;   // Bytes per object, after alignment.
+    size_t      slabCount;
+    size_t      hugePageSlabs; // Slabs backed by huge pages, see PageAllocator.
+    size_t      capacity;     // Objects all slabs can hold.
+    size_t      inUse;
+    size_t      peakInUse;
+    uint64      allocations;  // Since construction.
+    uint64      frees;
+};
+
+/**
+ * Fixed size object allocator.
+ *
+ * Memory is taken from the heap in slabs of slabSize bytes and cut into
+ * equally sized objects. Freed objects go to the front of a free list and
+ * are handed out first, so hot objects stay packed in a few slabs instead
+ * of being spread over the heap by connection churn. Slabs are only given
+ * back when the allocator is destroyed.
+ *
+ * With hugePages set, slabs are at least PageAllocator::HUGE_PAGE_SIZE
+ * bytes and come from PageAllocator, so a pool of a few hundred thousand
+ * objects sits in a handful of TLB entries. Where huge pages are not
+ * available the same slabs use normal pages.
+ *
+ * Thread safe. Every allocator registers itself, getAllStats() reports all
+ * of them (see the "pools" console command).
+ */
+class SlabAllocator : noncopyable
+{
+public:
+    static const size_t DEFAULT_SLAB_SIZE = 64 * 1024;
+    static const size_t MAX_ALIGNMENT     = 16;
+
+    /**
+     * @param name       Shown in the statistics.
+     * @param objectSize Bytes per object.
+     * @param alignment  Power of two, at most MAX_ALIGNMENT.
+     * @param slabSize   Bytes taken from the heap at once, holds at least one object.
+     * @param hugePages  Back slabs with huge pages when possible.
+     */
+    SlabAllocator(const std::string& name, size_t objectSize, size_t alignment = MAX_ALIGNMENT, size_t slabSize = DEFAULT_SLAB_SIZE, bool hugePages = false);
+
+    /** Slabs with live objects are leaked rather than freed under them. */
+    ~SlabAllocator();
+
+    /** Returns objectSize bytes, throws std::bad_alloc when out of memory. */
+    void*     allocate();
+
+    /** p must come from allocate() of this allocator, nullptr is ignored. */
+    void      deallocate(void* p);
+
+    size_t    getObjectSize()const{ return _objectSize; }
+
+    SlabStats getStats()const;
+
+    /** Appends the statistics of every live allocator to out. */
+    static void getAllStats(std::vector<SlabStats>& out);
+
+    /** Affects slabs allocated from now on. */
+    void setHugePages(bool hugePages);
+
+private:
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    void addSlab();
+
+    mutable std::mutex     _mutex;
+    std::string            _name;
+    size_t                 _objectSize;
+    size_t                 _slabSize;
+    bool                   _hugePages;
+    FreeNode*              _freeList;
+    std::vector<PageBlock> _slabs;
+    size_t                 _inUse;
+    size_t                 _peakInUse;
+    uint64                 _allocations;
+    uint64                 _frees;
+    SlabAllocator*         _prev;
+    SlabAllocator*         _next;
+};
+
+/**
+ * Typed front end of a SlabAllocator.
+ *
+ * Sample usage:
+ *
+ *     ObjectPool<Connection> pool("Connection");
+ *     Connection* conn = pool.create(socket, endpoint);
+ *     ...
+ *     pool.destroy(conn);
+ */
+template<typename T>
+class ObjectPool : noncopyable
+{
+public:
+    explicit ObjectPool(const std::string& name, size_t slabSize = SlabAllocator::DEFAULT_SLAB_SIZE)
+        : _slab(name, sizeof(T), std::alignment_of<T>::value, slabSize)
+    {
+    }
+
+    template<typename... Args>
+    T* create(Args&&... args)
+    {
+        void* p = _slab.allocate();
+        try
+        {
+            return ::new(p) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            _slab.deallocate(p);
+            throw;
+        }
+    }
+
+    void destroy(T* object)
+    {
+        if (object == nullptr)
+            return;
+        object->~T();
+        _slab.deallocate(object);
+    }
+
+    SlabStats getStats()const{ return _slab.getStats(); }
+
+private:
+    SlabAllocator _slab;
+};
+
+/**
+ * STL allocator that takes single elements from a SlabAllocator shared by
+ * every PoolAllocator<T> of the same T, which suits node based containers
+ * (list, map, unordered_map nodes). Arrays, like hash buckets, still come
+ * from the heap. HugePages selects a separate, huge page backed pool.
+ */
+template<typename T, bool HugePages = false>
+class PoolAllocator
+{
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef PoolAllocator<U, HugePages> other;
+    };
+
+    PoolAllocator(){}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U, HugePages>&){}
+
+    T* allocate(size_type n, const void* = nullptr)
+    {
+        if (n == 1)
+            return static_cast<T*>(getPool().allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_type n)
+    {
+        if (n == 1)
+            getPool().deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+
+    size_type max_size()const
+    {
+        return (std::numeric_limits<size_type>::max)() / sizeof(T);
+    }
+
+    static SlabAllocator& getPool()
+    {
+        // NOTE: Not safe to construct from two threads at once on compilers
+        // without thread safe statics, first use it from one thread. Never
+        // destroyed, containers freed during static destruction still use it.
+        static SlabAllocator* pool = new SlabAllocator(typeid(T).name(), sizeof(T), std::alignment_of<T>::value
+            , HugePages ? PageAllocator::HUGE_PAGE_SIZE : SlabAllocator::DEFAULT_SLAB_SIZE, HugePages);
+        return *pool;
+    }
+};
+
+template<typename T, typename U, bool HugePages>
+inline bool operator==(const PoolAllocator<T, HugePages>&, const PoolAllocator<U, HugePages>&)
+{
+    return true;
+}
+
+template<typename T, typename U, bool HugePages>
+inline bool operator!=(const PoolAllocator<T, HugePages>&, const PoolAllocator<U, HugePages>&)
+{
+    return false;
+}
+
+/**
+ * Routes new/delete of a class to a SlabAllocator. Put DECLARE_POOLED_ALLOCATION
+ * in a public section of the class body, it does not change the access of
+ * what follows, and IMPLEMENT_POOLED_ALLOCATION in its .cpp, or
+ * IMPLEMENT_POOLED_ALLOCATION_EX to pick the slab size and huge pages. Derived
+ * classes of a different size fall back to the global heap, deleting
+ * through a base pointer needs a virtual destructor as usual.
+ *
+ * The pool is created during static initialization and never destroyed,
+ * so objects deleted after main() returns still find it.
+ */
+#define DECLARE_POOLED_ALLOCATION(CLS)                                      \
+    static void* operator new(size_t size);                                 \
+    static void  operator delete(void* p, size_t size);                     \
+    static FoundationKit::SlabAllocator& getPool();
+
+#define IMPLEMENT_POOLED_ALLOCATION(CLS)                                    \
+    IMPLEMENT_POOLED_ALLOCATION_EX(CLS, FoundationKit::SlabAllocator::DEFAULT_SLAB_SIZE, false)
+
+#define IMPLEMENT_POOLED_ALLOCATION_EX(CLS, SLAB_SIZE, HUGE_PAGES)          \
+    FoundationKit::SlabAllocator& CLS::getPool()                            \
+    {                                                                       \
+        static FoundationKit::SlabAllocator* pool = new FoundationKit::SlabAllocator(#CLS \
+            , sizeof(CLS), FoundationKit::SlabAllocator::MAX_ALIGNMENT, SLAB_SIZE, HUGE_PAGES); \
+        return *pool;                                                       \
+    }                                                                       \
+    static FoundationKit::SlabAllocator& G_POOL_##CLS = CLS::getPool();     \
+    void* CLS::operator new(size_t size)                                    \
+    {                                                                       \
+        return size == sizeof(CLS) ? getPool().allocate() : ::operator new(size); \
+    }                                                                       \
+    void CLS::operator delete(void* p, size_t size)                         \
+    {                                                                       \
+        if (size == sizeof(CLS))                                            \
+            getPool().deallocate(p);                                        \
+        else                                                                \
+            ::operator delete(p);                                           \
+    }
+
+NS_FK_END
+#endif // LOSEMYMIND_SLABALLOCATOR_H
@@ -0,0 +1,157 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_SMALLSTRING_H
+#define LOSEMYMIND_SMALLSTRING_H
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/SmallVector.h"
+
+NS_FK_BEGIN
+
+/**
+ * A string that stores up to N characters inside the object.
+ *
+ * std::string only keeps 15 (libstdc++, MSVC) or 22 (libc++) characters
+ * inline, so most chat lines and names decoded from packets allocate.
+ * SmallString<64> holds them without touching the heap and falls back to
+ * heap storage beyond N. The text is always NUL terminated.
+ */
+template<size_t N>
+class SmallString
+{
+public:
+    typedef size_t      size_type;
+    typedef char*       iterator;
+    typedef const char* const_iterator;
+
+    SmallString()
+    {
+        _chars.push_back('\0');
+    }
+
+    SmallString(const char* str)
+    {
+        assign(str, strlen(str));
+    }
+
+    SmallString(const char* data, size_type size)
+    {
+        assign(data, size);
+    }
+
+    SmallString(const std::string& str)
+    {
+        assign(str.c_str(), str.size());
+    }
+
+    SmallString& operator=(const char* str)
+    {
+        assign(str, strlen(str));
+        return *this;
+    }
+
+    SmallString& operator=(const std::string& str)
+    {
+        assign(str.c_str(), str.size());
+        return *this;
+    }
+
+    void assign(const char* data, size_type size)
+    {
+        _chars.clear();
+        _chars.reserve(size + 1);
+        _chars.append(data, data + size);
+        _chars.push_back('\0');
+    }
+
+    void append(const char* data, size_type size)
+    {
+        _chars.pop_back();
+        _chars.append(data, data + size);
+        _chars.push_back('\0');
+    }
+
+    SmallString& operator+=(const char* str)
+    {
+        append(str, strlen(str));
+        return *this;
+    }
+
+    SmallString& operator+=(const std::string& str)
+    {
+        append(str.c_str(), str.size());
+        return *this;
+    }
+
+    SmallString& operator+=(char ch)
+    {
+        _chars.back() = ch;
+        _chars.push_back('\0');
+        return *this;
+    }
+
+    const char* c_str()const{ return _chars.data(); }
+    const char* data()const{ return _chars.data(); }
+    size_type   size()const{ return _chars.size() - 1; }
+    size_type   length()const{ return _chars.size() - 1; }
+    bool        empty()const{ return _chars.size() == 1; }
+    bool        isInline()const{ return _chars.isInline(); }
+
+    void clear()
+    {
+        _chars.clear();
+        _chars.push_back('\0');
+    }
+
+    char&       operator[](size_type index){ return _chars[index]; }
+    const char& operator[](size_type index)const{ return _chars[index]; }
+
+    iterator       begin(){ return _chars.begin(); }
+    const_iterator begin()const{ return _chars.begin(); }
+    iterator       end(){ return _chars.begin() + size(); }
+    const_iterator end()const{ return _chars.begin() + size(); }
+
+    std::string str()const{ return std::string(data(), size()); }
+
+    int compare(const char* data, size_type size)const
+    {
+        size_type common = size < this->size() ? size : this->size();
+        int result = memcmp(this->data(), data, common);
+        if (result != 0)
+            return result;
+        return this->size() < size ? -1 : (this->size() > size ? 1 : 0);
+    }
+
+    int compare(const char* str)const{ return compare(str, strlen(str)); }
+    int compare(const std::string& str)const{ return compare(str.c_str(), str.size()); }
+
+    template<size_t M>
+    int compare(const SmallString<M>& other)const{ return compare(other.data(), other.size()); }
+
+    bool operator==(const char* str)const{ return compare(str) == 0; }
+    bool operator!=(const char* str)const{ return compare(str) != 0; }
+    bool operator==(const std::string& str)const{ return compare(str) == 0; }
+    bool operator!=(const std::string& str)const{ return compare(str) != 0; }
+    template<size_t M>
+    bool operator==(const SmallString<M>& other)const{ return compare(other) == 0; }
+    template<size_t M>
+    bool operator!=(const SmallString<M>& other)const{ return compare(other) != 0; }
+    template<size_t M>
+    bool operator<(const SmallString<M>& other)const{ return compare(other) < 0; }
+
+private:
+    // Room for N characters and the terminator.
+    SmallVector<char, N + 1> _chars;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_SMALLSTRING_H
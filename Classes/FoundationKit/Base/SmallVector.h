@@ -0,0 +1,328 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_SMALLVECTOR_H
+#define LOSEMYMIND_SMALLVECTOR_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+NS_FK_BEGIN
+
+/**
+ * A vector that keeps its first N elements inside the object.
+ *
+ * Up to N elements no memory is allocated, which makes it a good fit for
+ * short lived values decoded from packets, e.g. small id lists. Past N the
+ * elements move to the heap and it behaves like std::vector. Moving a
+ * SmallVector that is still inline moves the elements one by one.
+ */
+template<typename T, size_t N>
+class SmallVector
+{
+    static_assert(N > 0, "SmallVector needs at least one inline element, use std::vector instead.");
+public:
+    typedef T               value_type;
+    typedef size_t          size_type;
+    typedef std::ptrdiff_t  difference_type;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T*              iterator;
+    typedef const T*        const_iterator;
+
+    SmallVector()
+        : _data(inlineData())
+        , _size(0)
+        , _capacity(N)
+    {
+    }
+
+    explicit SmallVector(size_type count, const T& value = T())
+        : _data(inlineData())
+        , _size(0)
+        , _capacity(N)
+    {
+        resize(count, value);
+    }
+
+    SmallVector(std::initializer_list<T> values)
+        : _data(inlineData())
+        , _size(0)
+        , _capacity(N)
+    {
+        append(values.begin(), values.end());
+    }
+
+    SmallVector(const SmallVector& other)
+        : _data(inlineData())
+        , _size(0)
+        , _capacity(N)
+    {
+        append(other.begin(), other.end());
+    }
+
+    SmallVector(SmallVector&& other)
+        : _data(inlineData())
+        , _size(0)
+        , _capacity(N)
+    {
+        moveFrom(other);
+    }
+
+    ~SmallVector()
+    {
+        clear();
+        freeHeap();
+    }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            append(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    iterator       begin(){ return _data; }
+    const_iterator begin()const{ return _data; }
+    iterator       end(){ return _data + _size; }
+    const_iterator end()const{ return _data + _size; }
+
+    T*       data(){ return _data; }
+    const T* data()const{ return _data; }
+
+    size_type size()const{ return _size; }
+    size_type capacity()const{ return _capacity; }
+    bool      empty()const{ return _size == 0; }
+
+    /** True while the elements still live in the inline storage. */
+    bool      isInline()const{ return _data == inlineData(); }
+
+    T&       operator[](size_type index){ return _data[index]; }
+    const T& operator[](size_type index)const{ return _data[index]; }
+    T&       front(){ return _data[0]; }
+    const T& front()const{ return _data[0]; }
+    T&       back(){ return _data[_size - 1]; }
+    const T& back()const{ return _data[_size - 1]; }
+
+    void push_back(const T& value)
+    {
+        if (_size == _capacity)
+        {
+            // value may refer to an element that grow() is about to move.
+            T copy(value);
+            grow(_size + 1);
+            ::new((void*)(_data + _size)) T(std::move(copy));
+        }
+        else
+        {
+            ::new((void*)(_data + _size)) T(value);
+        }
+        ++_size;
+    }
+
+    void push_back(T&& value)
+    {
+        if (_size == _capacity)
+        {
+            T copy(std::move(value));
+            grow(_size + 1);
+            ::new((void*)(_data + _size)) T(std::move(copy));
+        }
+        else
+        {
+            ::new((void*)(_data + _size)) T(std::move(value));
+        }
+        ++_size;
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (_size == _capacity)
+            grow(_size + 1);
+        ::new((void*)(_data + _size)) T(std::forward<Args>(args)...);
+        return _data[_size++];
+    }
+
+    void pop_back()
+    {
+        _data[--_size].~T();
+    }
+
+    /** Appends [first, last), the range must not point into this vector. */
+    template<typename InputIt>
+    void append(InputIt first, InputIt last)
+    {
+        reserve(_size + static_cast<size_type>(std::distance(first, last)));
+        for (; first != last; ++first)
+        {
+            ::new((void*)(_data + _size)) T(*first);
+            ++_size;
+        }
+    }
+
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last)
+    {
+        clear();
+        append(first, last);
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        iterator it = _data + (pos - _data);
+        std::move(it + 1, end(), it);
+        pop_back();
+        return it;
+    }
+
+    void reserve(size_type count)
+    {
+        if (count > _capacity)
+            grow(count);
+    }
+
+    void resize(size_type count)
+    {
+        reserve(count);
+        while (_size < count)
+            emplace_back();
+        while (_size > count)
+            pop_back();
+    }
+
+    void resize(size_type count, const T& value)
+    {
+        reserve(count);
+        while (_size < count)
+            push_back(value);
+        while (_size > count)
+            pop_back();
+    }
+
+    /** Destroys the elements, heap storage is kept for reuse. */
+    void clear()
+    {
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            for (size_type i = 0; i < _size; ++i)
+                _data[i].~T();
+        }
+        _size = 0;
+    }
+
+    bool operator==(const SmallVector& other)const
+    {
+        if (_size != other._size)
+            return false;
+        for (size_type i = 0; i < _size; ++i)
+        {
+            if (!(_data[i] == other._data[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const SmallVector& other)const
+    {
+        return !(*this == other);
+    }
+
+private:
+    T*       inlineData(){ return reinterpret_cast<T*>(&_inline); }
+    const T* inlineData()const{ return reinterpret_cast<const T*>(&_inline); }
+
+    void grow(size_type minCapacity)
+    {
+        size_type capacity = _capacity * 2;
+        if (capacity < minCapacity)
+            capacity = minCapacity;
+        T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        moveElements(_data, _size, data);
+        freeHeap();
+        _data = data;
+        _capacity = capacity;
+    }
+
+    // Move constructs count elements into uninitialized memory, destroys the sources.
+    static void moveElements(T* from, size_type count, T* to)
+    {
+        if (std::is_trivially_copyable<T>::value)
+        {
+            if (count > 0)
+                memcpy((void*)to, (const void*)from, count * sizeof(T));
+            return;
+        }
+        for (size_type i = 0; i < count; ++i)
+        {
+            ::new((void*)(to + i)) T(std::move(from[i]));
+            from[i].~T();
+        }
+    }
+
+    // Expects this to be empty.
+    void moveFrom(SmallVector& other)
+    {
+        if (other.isInline())
+        {
+            reserve(other._size);
+            moveElements(other._data, other._size, _data);
+            _size = other._size;
+            other._size = 0;
+            return;
+        }
+        freeHeap();
+        _data = other._data;
+        _size = other._size;
+        _capacity = other._capacity;
+        other._data = other.inlineData();
+        other._size = 0;
+        other._capacity = N;
+    }
+
+    void freeHeap()
+    {
+        if (!isInline())
+        {
+            ::operator delete(_data);
+            _data = inlineData();
+            _capacity = N;
+        }
+    }
+
+    T*          _data;
+    size_type   _size;
+    size_type   _capacity;
+    typename std::aligned_storage<sizeof(T) * N, std::alignment_of<T>::value>::type _inline;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_SMALLVECTOR_H
@@ -0,0 +1,290 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "StatsSegment.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+NS_FK_BEGIN
+
+static_assert(sizeof(StatsSegmentHeader) == 64, "StatsSegmentHeader is part of the file format");
+static_assert(sizeof(StatsSegmentEntry) == 160, "StatsSegmentEntry is part of the file format");
+
+namespace
+{
+    uint32 currentProcessId()
+    {
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        return static_cast<uint32>(GetCurrentProcessId());
+#else
+        return static_cast<uint32>(getpid());
+#endif
+    }
+
+    // Upper bound of the bucket holding the percentile, the largest bound
+    // when it falls into +Inf.
+    int64 bucketPercentile(const MetricSample& sample, double percentile)
+    {
+        if (sample.value <= 0 || sample.bucketBounds.empty())
+            return 0;
+        int64 rank = static_cast<int64>(std::ceil(percentile / 100.0 * sample.value));
+        int64 seen = 0;
+        for (size_t i = 0; i < sample.bucketBounds.size(); ++i)
+        {
+            seen += sample.bucketCounts[i];
+            if (seen >= rank)
+                return sample.bucketBounds[i];
+        }
+        return sample.bucketBounds.back();
+    }
+
+    void fillEntry(StatsSegmentEntry& entry, const MetricSample& sample)
+    {
+        memset(&entry, 0, sizeof(entry));
+        std::string name = sample.labels.empty() ? sample.name : sample.name + "{" + sample.labels + "}";
+        size_t length = name.size() < sizeof(entry.name) - 1 ? name.size() : sizeof(entry.name) - 1;
+        memcpy(entry.name, name.data(), length);
+        entry.type = static_cast<uint32>(sample.type);
+        entry.value = sample.value;
+        entry.sum = sample.sum;
+        if (sample.type == MetricType::Summary && sample.quantileValues.size() >= 5)
+        {
+            entry.p50 = sample.quantileValues[0];
+            entry.p90 = sample.quantileValues[1];
+            entry.p99 = sample.quantileValues[2];
+            entry.p999 = sample.quantileValues[3];
+            entry.max = sample.quantileValues[4];
+        }
+        else if (sample.type == MetricType::Histogram)
+        {
+            entry.p50 = bucketPercentile(sample, 50.0);
+            entry.p90 = bucketPercentile(sample, 90.0);
+            entry.p99 = bucketPercentile(sample, 99.0);
+            entry.p999 = bucketPercentile(sample, 99.9);
+            entry.max = bucketPercentile(sample, 100.0);
+        }
+    }
+}
+
+StatsSegment::StatsSegment()
+    : _header(nullptr)
+    , _entries(nullptr)
+    , _size(0)
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    , _file(nullptr)
+    , _mapping(nullptr)
+#else
+    , _file(-1)
+#endif
+{
+}
+
+StatsSegment::~StatsSegment()
+{
+    close();
+}
+
+bool StatsSegment::create(const std::string& path, uint32 capacity)
+{
+    close();
+    size_t size = sizeof(StatsSegmentHeader) + capacity * sizeof(StatsSegmentEntry);
+    if (!map(path, size, true))
+        return false;
+
+    memset(static_cast<void*>(_header), 0, sizeof(StatsSegmentHeader));
+    _header->version = STATS_SEGMENT_VERSION;
+    _header->headerSize = sizeof(StatsSegmentHeader);
+    _header->entrySize = sizeof(StatsSegmentEntry);
+    _header->capacity = capacity;
+    _header->processId = currentProcessId();
+    _header->sequence.store(0, std::memory_order_relaxed);
+    // Readers check the magic first, it goes in last.
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = STATS_SEGMENT_MAGIC;
+    _staging.reserve(capacity);
+    return true;
+}
+
+bool StatsSegment::openReadOnly(const std::string& path)
+{
+    close();
+    if (!map(path, 0, false))
+        return false;
+    if (_size < sizeof(StatsSegmentHeader)
+        || _header->magic != STATS_SEGMENT_MAGIC
+        || _header->version != STATS_SEGMENT_VERSION
+        || _header->headerSize != sizeof(StatsSegmentHeader)
+        || _header->entrySize != sizeof(StatsSegmentEntry)
+        || sizeof(StatsSegmentHeader) + (size_t)_header->capacity * sizeof(StatsSegmentEntry) > _size)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void StatsSegment::publish(const std::vector<MetricSample>& samples)
+{
+    if (_header == nullptr)
+        return;
+
+    // Entries are prepared outside the seqlock, so readers only ever see
+    // the sequence odd for the length of one memcpy.
+    size_t count = samples.size() < _header->capacity ? samples.size() : _header->capacity;
+    _staging.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        fillEntry(_staging[i], samples[i]);
+    }
+    int64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    uint32 sequence = _header->sequence.load(std::memory_order_relaxed);
+    _header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (count > 0)
+    {
+        memcpy(_entries, _staging.data(), count * sizeof(StatsSegmentEntry));
+    }
+    _header->entryCount = static_cast<uint32>(count);
+    _header->publishTime = now;
+    _header->publishCount += 1;
+    _header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool StatsSegment::read(StatsSegmentInfo& info, std::vector<StatsSegmentEntry>& entries, uint32 maxRetries)const
+{
+    if (_header == nullptr)
+        return false;
+
+    for (uint32 attempt = 0; attempt < maxRetries; ++attempt)
+    {
+        uint32 before = _header->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32 count = _header->entryCount;
+        if (count > _header->capacity)
+            count = _header->capacity;
+        entries.resize(count);
+        if (count > 0)
+        {
+            memcpy(entries.data(), _entries, count * sizeof(StatsSegmentEntry));
+        }
+        info.processId = _header->processId;
+        info.capacity = _header->capacity;
+        info.publishTime = _header->publishTime;
+        info.publishCount = _header->publishCount;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_header->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
+
+bool StatsSegment::map(const std::string& path, size_t size, bool writable)
+{
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    HANDLE file = CreateFileA(path.c_str()
+        , writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ
+        , FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE
+        , nullptr
+        , writable ? CREATE_ALWAYS : OPEN_EXISTING
+        , FILE_ATTRIBUTE_NORMAL
+        , nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    if (!writable)
+    {
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY
+        , static_cast<DWORD>((uint64)size >> 32), static_cast<DWORD>(size), nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size) : nullptr;
+    if (view == nullptr)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    _file = file;
+    _mapping = mapping;
+#else
+    int file = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (file < 0)
+        return false;
+    if (writable)
+    {
+        if (ftruncate(file, static_cast<off_t>(size)) != 0)
+        {
+            ::close(file);
+            return false;
+        }
+    }
+    else
+    {
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            ::close(file);
+            return false;
+        }
+        size = static_cast<size_t>(fileStat.st_size);
+    }
+    void* view = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED)
+    {
+        ::close(file);
+        return false;
+    }
+    _file = file;
+#endif
+    _size = size;
+    _header = static_cast<StatsSegmentHeader*>(view);
+    _entries = reinterpret_cast<StatsSegmentEntry*>(_header + 1);
+    return true;
+}
+
+void StatsSegment::close()
+{
+    if (_header == nullptr)
+        return;
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    UnmapViewOfFile(_header);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+    _mapping = nullptr;
+    _file = nullptr;
+#else
+    munmap(_header, _size);
+    ::close(_file);
+    _file = -1;
+#endif
+    _header = nullptr;
+    _entries = nullptr;
+    _size = 0;
+}
+
+NS_FK_END
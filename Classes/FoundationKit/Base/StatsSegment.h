@@ -0,0 +1,123 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_STATSSEGMENT_H
+#define LOSEMYMIND_STATSSEGMENT_H
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+static const uint32 STATS_SEGMENT_MAGIC   = 0x54534956; // "VIST"
+static const uint32 STATS_SEGMENT_VERSION = 1;
+
+/**
+ * First 64 bytes of the segment. Everything after sequence is only
+ * consistent when read under the seqlock, see StatsSegment::read().
+ */
+struct StatsSegmentHeader
+{
+    uint32              magic;
+    uint32              version;
+    uint32              headerSize;
+    uint32              entrySize;
+    uint32              capacity;      // Entries the segment has room for.
+    uint32              processId;     // Of the writer.
+    std::atomic<uint32> sequence;      // Odd while the writer is publishing.
+    uint32              entryCount;
+    int64               publishTime;   // Milliseconds since the Unix epoch.
+    uint64              publishCount;
+    uint8               padding[16];
+};
+
+/** One metric, 160 bytes. Values in the unit the metric was recorded in. */
+struct StatsSegmentEntry
+{
+    char   name[96];    // name{labels}, NUL terminated, cut if longer.
+    uint32 type;        // MetricType
+    uint32 reserved;
+    int64  value;       // Counter and gauge value, histogram and summary count.
+    int64  sum;
+    int64  p50;         // Histograms and summaries only. Fixed bucket
+    int64  p90;         // histograms report the upper bound of the bucket.
+    int64  p99;
+    int64  p999;
+    int64  max;
+};
+
+/** Header fields of a consistent read. */
+struct StatsSegmentInfo
+{
+    uint32 processId;
+    uint32 capacity;
+    int64  publishTime;
+    uint64 publishCount;
+};
+
+/**
+ * Metrics published into a memory mapped file for an external monitor.
+ *
+ * The server creates the segment and publish()es a snapshot now and then;
+ * readers map the file read only and never touch the server. A single
+ * writer and any number of readers synchronize with a seqlock: the writer
+ * makes the sequence odd, writes, and makes it even again; a reader copies
+ * the entries and retries if the sequence was odd or changed meanwhile.
+ * The writer never waits for readers.
+ *
+ * The layout is fixed size and versioned, so a monitor built separately
+ * (Tools/StatsMonitor) can read it.
+ */
+class StatsSegment : noncopyable
+{
+public:
+    StatsSegment();
+    ~StatsSegment();
+
+    /** Creates or truncates the file and maps it for writing. */
+    bool create(const std::string& path, uint32 capacity = 1024);
+
+    /** Maps an existing segment read only. */
+    bool openReadOnly(const std::string& path);
+
+    void close();
+
+    bool isOpen()const{ return _header != nullptr; }
+
+    /** Writer only. Samples past the capacity are dropped. */
+    void publish(const std::vector<MetricSample>& samples);
+
+    /**
+     * Consistent copy of the segment. Returns false if the file is not a
+     * segment of this version, or the writer kept publishing through
+     * maxRetries attempts.
+     */
+    bool read(StatsSegmentInfo& info, std::vector<StatsSegmentEntry>& entries, uint32 maxRetries = 100)const;
+
+private:
+    bool map(const std::string& path, size_t size, bool writable);
+
+    StatsSegmentHeader* _header;
+    StatsSegmentEntry*  _entries;
+    size_t              _size;
+    std::vector<StatsSegmentEntry> _staging;
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    void*               _file;
+    void*               _mapping;
+#else
+    int                 _file;
+#endif
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_STATSSEGMENT_H
@@ -0,0 +1,92 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <vector>
+#include "ThreadExit.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace
+{
+    struct ExitCallback
+    {
+        ThreadExit::Callback callback;
+        void*                data;
+    };
+    typedef std::vector<ExitCallback> ExitCallbackList;
+
+    // Callbacks of the calling thread, also stored in the key so the OS hands it back on exit.
+    THREAD_LOCAL ExitCallbackList* t_exitCallbacks = nullptr;
+
+    void runExitCallbacks(void* data)
+    {
+        ExitCallbackList* callbacks = static_cast<ExitCallbackList*>(data);
+        if (callbacks == nullptr)
+            return;
+        // A callback that registers again starts a fresh list.
+        t_exitCallbacks = nullptr;
+        for (auto iter = callbacks->rbegin(); iter != callbacks->rend(); ++iter)
+        {
+            iter->callback(iter->data);
+        }
+        delete callbacks;
+    }
+}
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+typedef DWORD ExitKey;
+
+static void NTAPI runFlsExitCallbacks(PVOID data)
+{
+    runExitCallbacks(data);
+}
+
+static ExitKey* newExitKey()
+{
+    return new ExitKey(FlsAlloc(&runFlsExitCallbacks));
+}
+#else
+typedef pthread_key_t ExitKey;
+
+static ExitKey* newExitKey()
+{
+    ExitKey* key = new ExitKey;
+    pthread_key_create(key, &runExitCallbacks);
+    return key;
+}
+#endif
+
+static ExitKey& getExitKey()
+{
+    static ExitKey* key = newExitKey();
+    return *key;
+}
+
+// Created during static initialisation, before any thread can race on it.
+static ExitKey& g_exitKey = getExitKey();
+
+void ThreadExit::atExit(Callback callback, void* data)
+{
+    if (t_exitCallbacks == nullptr)
+    {
+        t_exitCallbacks = new ExitCallbackList();
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        FlsSetValue(getExitKey(), t_exitCallbacks);
+#else
+        pthread_setspecific(getExitKey(), t_exitCallbacks);
+#endif
+    }
+    ExitCallback entry = { callback, data };
+    t_exitCallbacks->push_back(entry);
+}
+
+NS_FK_END
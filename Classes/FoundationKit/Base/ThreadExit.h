@@ -0,0 +1,38 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_THREADEXIT_H
+#define LOSEMYMIND_THREADEXIT_H
+
+#pragma once
+
+#include "FoundationKit/GenericPlatformMacros.h"
+
+NS_FK_BEGIN
+
+/**
+ * Runs cleanup when a thread exits.
+ *
+ * THREAD_LOCAL is __declspec(thread) on Win32 and cannot run destructors,
+ * so per-thread buffers register here to be handed back when their thread
+ * ends. Uses a fiber local storage callback on Windows and a pthread key
+ * destructor elsewhere. The main thread's callbacks are not guaranteed to
+ * run at process exit.
+ */
+class ThreadExit
+{
+public:
+    typedef void (*Callback)(void* data);
+
+    /**
+     * Calls callback(data) on the calling thread when it exits. Callbacks
+     * run in reverse order of registration.
+     */
+    static void atExit(Callback callback, void* data);
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_THREADEXIT_H
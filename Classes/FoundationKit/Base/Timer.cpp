@@ -0,0 +1,47 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <atomic>
+#include "Timer.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#endif
+
+NS_FK_BEGIN
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+namespace
+{
+    // Zero until the first call; fixed at boot, so racing writers store the same value.
+    std::atomic<int64> g_performanceFrequency;
+}
+
+int64 Timer::nowNanoseconds()
+{
+    int64 frequency = g_performanceFrequency.load(std::memory_order_relaxed);
+    if (frequency == 0)
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = value.QuadPart;
+        g_performanceFrequency.store(frequency, std::memory_order_relaxed);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // Split so the multiplication cannot overflow however long the machine has been up.
+    int64 seconds = counter.QuadPart / frequency;
+    int64 remainder = counter.QuadPart % frequency;
+    return seconds * 1000000000 + remainder * 1000000000 / frequency;
+}
+#else
+int64 Timer::nowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+NS_FK_END
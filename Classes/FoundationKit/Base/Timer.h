@@ -10,6 +10,14 @@ public:
     typedef std::chrono::high_resolution_clock clock_type;
     Timer() : _begin(clock_type::now()){}
 
+    /**
+     * Monotonic timestamp for stamping events that are compared later, e.g.
+     * latencies. QueryPerformanceCounter on Windows, where the v120
+     * high_resolution_clock is the system clock with 1-15ms steps;
+     * steady_clock elsewhere. Only differences are meaningful.
+     */
+    static int64 nowNanoseconds();
+
     void reset()
     {
         _begin = clock_type::now();
@@ -0,0 +1,217 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include "BinaryLog.h"
+
+NS_FK_BEGIN
+
+const size_t BinaryLog::MAX_STRING_LENGTH;
+
+namespace
+{
+    std::mutex& getFormatMutex()
+    {
+        static std::mutex* formatMutex = new std::mutex();
+        return *formatMutex;
+    }
+
+    // Call sites first run on many threads at once; this creates the mutex
+    // during static initialization, before any of them start.
+    std::mutex& g_formatMutex = getFormatMutex();
+
+    // Index 0 is reserved so a zero slot means "not registered".
+    std::vector<const char*>& getFormatTable()
+    {
+        static std::vector<const char*> formats(1, nullptr);
+        return formats;
+    }
+
+    template<typename V>
+    bool readValue(const uint8*& args, const uint8* end, V& value)
+    {
+        if (end - args < (ptrdiff_t)sizeof(V))
+            return false;
+        memcpy(&value, args, sizeof(V));
+        args += sizeof(V);
+        return true;
+    }
+}
+
+uint32 BinaryLog::registerFormat(std::atomic<uint32>* slot, const char* format)
+{
+    std::lock_guard<std::mutex> lock(getFormatMutex());
+    // Another thread may have registered the same call site meanwhile.
+    uint32 id = slot->load(std::memory_order_relaxed);
+    if (id != 0)
+        return id;
+    std::vector<const char*>& formats = getFormatTable();
+    formats.push_back(format);
+    id = static_cast<uint32>(formats.size() - 1);
+    slot->store(id, std::memory_order_release);
+    return id;
+}
+
+const char* BinaryLog::getFormat(uint32 id)
+{
+    std::lock_guard<std::mutex> lock(getFormatMutex());
+    std::vector<const char*>& formats = getFormatTable();
+    return id < formats.size() ? formats[id] : nullptr;
+}
+
+uint8* BinaryLog::writeArg(uint8* out, const char* value)
+{
+    uint16 length = static_cast<uint16>(stringLength(value));
+    *out++ = AT_STRING;
+    memcpy(out, &length, sizeof(length));
+    out += sizeof(length);
+    if (length > 0)
+        memcpy(out, value, length);
+    return out + length;
+}
+
+void BinaryLog::format(const char* format, const uint8* args, size_t size, std::string& out)
+{
+    const uint8* end = args + size;
+    char buffer[128];
+    std::string spec;
+    std::string text;
+
+    for (const char* p = format; *p != '\0'; ++p)
+    {
+        if (*p != '%')
+        {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out += '%';
+            ++p;
+            continue;
+        }
+
+        // Parse one conversion: %[flags][width][.precision][length]conversion
+        const char* start = p++;
+        while (*p && strchr("-+ #0", *p)) ++p;
+        while (*p >= '0' && *p <= '9') ++p;
+        if (*p == '.')
+        {
+            ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+        }
+        const char* lengthStart = p;
+        while (*p && strchr("hlLqjzt", *p)) ++p;
+        if (*p == 'I')
+        {
+            ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+        }
+        char conversion = *p;
+        if (conversion == '\0')
+        {
+            out.append(start);
+            break;
+        }
+
+        // Rebuild the spec with the length modifier of the recorded type,
+        // so a %d fed an int64 can never read past its argument.
+        spec.assign(start, lengthStart);
+        uint8 type = 0;
+        bool valid = readValue(args, end, type);
+        int written = -1;
+        if (valid)
+        {
+            bool isInteger = strchr("diouxXc", conversion) != nullptr;
+            bool isFloat = strchr("fFeEgGaA", conversion) != nullptr;
+            switch (type)
+            {
+            case AT_INT32:
+            case AT_UINT32:
+            {
+                uint32 value = 0;
+                valid = readValue(args, end, value) && isInteger;
+                if (valid)
+                {
+                    spec += conversion;
+                    written = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+                }
+                break;
+            }
+            case AT_INT64:
+            case AT_UINT64:
+            {
+                uint64 value = 0;
+                valid = readValue(args, end, value) && isInteger && conversion != 'c';
+                if (valid)
+                {
+                    spec += "ll";
+                    spec += conversion;
+                    written = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+                }
+                break;
+            }
+            case AT_DOUBLE:
+            {
+                double value = 0;
+                valid = readValue(args, end, value) && isFloat;
+                if (valid)
+                {
+                    spec += conversion;
+                    written = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+                }
+                break;
+            }
+            case AT_POINTER:
+            {
+                uint64 value = 0;
+                valid = readValue(args, end, value) && conversion == 'p';
+                if (valid)
+                {
+                    spec += conversion;
+                    written = snprintf(buffer, sizeof(buffer), spec.c_str(), (void*)(UPTRINT)value);
+                }
+                break;
+            }
+            case AT_STRING:
+            {
+                uint16 length = 0;
+                valid = readValue(args, end, length) && (end - args) >= length && conversion == 's';
+                if (valid)
+                {
+                    text.assign((const char*)args, length);
+                    args += length;
+                    spec += conversion;
+                    std::vector<char> wide(text.size() + sizeof(buffer));
+                    int count = snprintf(&wide[0], wide.size(), spec.c_str(), text.c_str());
+                    if (count > 0)
+                        out.append(&wide[0], count < (int)wide.size() ? count : wide.size() - 1);
+                    written = 0;
+                }
+                break;
+            }
+            default:
+                valid = false;
+                break;
+            }
+        }
+
+        if (!valid)
+        {
+            // The argument list is no longer trustworthy, stop consuming it.
+            args = end;
+            out += "<bad arg>";
+        }
+        else if (written > 0)
+        {
+            out.append(buffer, written < (int)sizeof(buffer) ? written : sizeof(buffer) - 1);
+        }
+    }
+}
+
+NS_FK_END
@@ -0,0 +1,169 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_BINARYLOG_H
+#define LOSEMYMIND_BINARYLOG_H
+
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <string>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+
+NS_FK_BEGIN
+
+/**
+ * Record layout shared by the Logger rings and binary log files.
+ * A record is a RecordHeader followed by length bytes of payload,
+ * padded to a multiple of 8 bytes (size includes header and padding).
+ */
+enum RecordKind
+{
+    RK_TEXT = 0,   // Payload is a formatted line.
+    RK_PADDING,    // Ring filler, no payload.
+    RK_BINARY,     // Payload is uint32 format id followed by encoded arguments.
+    RK_FORMAT,     // Payload is uint32 format id followed by the format string (binary files only).
+};
+
+struct RecordHeader
+{
+    uint32 size;   // Whole record in bytes, header included, 8 bytes aligned.
+    uint8  kind;
+    uint8  level;
+    uint16 length; // Payload bytes.
+};
+
+/**
+ * Encoding and decoding of deferred log lines.
+ *
+ * A deferred line stores the id of its static format string and the raw
+ * bytes of its arguments, each prefixed with a one byte type tag. The
+ * expensive vsnprintf work happens later, on the Logger backend thread or
+ * offline in the LogDecoder tool.
+ */
+class BinaryLog
+{
+public:
+    enum ArgType
+    {
+        AT_INT32 = 1,
+        AT_UINT32,
+        AT_INT64,
+        AT_UINT64,
+        AT_DOUBLE,
+        AT_POINTER,
+        AT_STRING,
+    };
+
+    /** Strings longer than this are truncated when they are recorded. */
+    static const size_t MAX_STRING_LENGTH = 1024;
+
+    /**
+     * Returns the id of a call site's format string, registering it on first use.
+     * @param slot   A static atomic owned by the call site, 0 until registered.
+     * @param format The format string, must have static storage duration.
+     */
+    static uint32 getFormatId(std::atomic<uint32>* slot, const char* format)
+    {
+        uint32 id = slot->load(std::memory_order_acquire);
+        return id != 0 ? id : registerFormat(slot, format);
+    }
+
+    /** Returns the format string registered under id, or nullptr. */
+    static const char* getFormat(uint32 id);
+
+    /** Number of bytes encode() writes for args. */
+    static size_t measure()
+    {
+        return 0;
+    }
+
+    template<typename T, typename... Args>
+    static size_t measure(const T& first, const Args&... rest)
+    {
+        return argSize(first) + measure(rest...);
+    }
+
+    /** Encodes args into out, returns the end of the written bytes. */
+    static uint8* encode(uint8* out)
+    {
+        return out;
+    }
+
+    template<typename T, typename... Args>
+    static uint8* encode(uint8* out, const T& first, const Args&... rest)
+    {
+        return encode(writeArg(out, first), rest...);
+    }
+
+    /**
+     * Formats encoded arguments with a printf style format string and appends
+     * the result to out. Arguments that do not match their conversion are
+     * printed as <bad arg> instead of being passed to snprintf.
+     */
+    static void format(const char* format, const uint8* args, size_t size, std::string& out);
+
+private:
+    static uint32 registerFormat(std::atomic<uint32>* slot, const char* format);
+
+    template<typename V>
+    static uint8* writeValue(uint8* out, uint8 type, V value)
+    {
+        *out++ = type;
+        memcpy(out, &value, sizeof(V));
+        return out + sizeof(V);
+    }
+
+    static size_t argSize(bool)               { return 1 + sizeof(int32); }
+    static size_t argSize(char)               { return 1 + sizeof(int32); }
+    static size_t argSize(signed char)        { return 1 + sizeof(int32); }
+    static size_t argSize(unsigned char)      { return 1 + sizeof(uint32); }
+    static size_t argSize(short)              { return 1 + sizeof(int32); }
+    static size_t argSize(unsigned short)     { return 1 + sizeof(uint32); }
+    static size_t argSize(int)                { return 1 + sizeof(int32); }
+    static size_t argSize(unsigned int)       { return 1 + sizeof(uint32); }
+    static size_t argSize(long)               { return 1 + sizeof(int64); }
+    static size_t argSize(unsigned long)      { return 1 + sizeof(uint64); }
+    static size_t argSize(long long)          { return 1 + sizeof(int64); }
+    static size_t argSize(unsigned long long) { return 1 + sizeof(uint64); }
+    static size_t argSize(float)              { return 1 + sizeof(double); }
+    static size_t argSize(double)             { return 1 + sizeof(double); }
+    static size_t argSize(const char* value)  { return 1 + sizeof(uint16) + stringLength(value); }
+    static size_t argSize(char* value)        { return argSize((const char*)value); }
+    template<typename T>
+    static size_t argSize(T*)                 { return 1 + sizeof(uint64); }
+
+    static uint8* writeArg(uint8* out, bool value)               { return writeValue(out, AT_INT32, (int32)value); }
+    static uint8* writeArg(uint8* out, char value)               { return writeValue(out, AT_INT32, (int32)value); }
+    static uint8* writeArg(uint8* out, signed char value)        { return writeValue(out, AT_INT32, (int32)value); }
+    static uint8* writeArg(uint8* out, unsigned char value)      { return writeValue(out, AT_UINT32, (uint32)value); }
+    static uint8* writeArg(uint8* out, short value)              { return writeValue(out, AT_INT32, (int32)value); }
+    static uint8* writeArg(uint8* out, unsigned short value)     { return writeValue(out, AT_UINT32, (uint32)value); }
+    static uint8* writeArg(uint8* out, int value)                { return writeValue(out, AT_INT32, (int32)value); }
+    static uint8* writeArg(uint8* out, unsigned int value)       { return writeValue(out, AT_UINT32, (uint32)value); }
+    static uint8* writeArg(uint8* out, long value)               { return writeValue(out, AT_INT64, (int64)value); }
+    static uint8* writeArg(uint8* out, unsigned long value)      { return writeValue(out, AT_UINT64, (uint64)value); }
+    static uint8* writeArg(uint8* out, long long value)          { return writeValue(out, AT_INT64, (int64)value); }
+    static uint8* writeArg(uint8* out, unsigned long long value) { return writeValue(out, AT_UINT64, (uint64)value); }
+    static uint8* writeArg(uint8* out, float value)              { return writeValue(out, AT_DOUBLE, (double)value); }
+    static uint8* writeArg(uint8* out, double value)             { return writeValue(out, AT_DOUBLE, value); }
+    static uint8* writeArg(uint8* out, char* value)              { return writeArg(out, (const char*)value); }
+    static uint8* writeArg(uint8* out, const char* value);
+    template<typename T>
+    static uint8* writeArg(uint8* out, T* value)                 { return writeValue(out, AT_POINTER, (uint64)(UPTRINT)value); }
+
+    static size_t stringLength(const char* value)
+    {
+        if (value == nullptr)
+            return 0;
+        size_t length = strlen(value);
+        return length < MAX_STRING_LENGTH ? length : MAX_STRING_LENGTH;
+    }
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_BINARYLOG_H
@@ -0,0 +1,244 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include "FrameProfiler.h"
+#include "TaskScheduler.h"
+#include "Logger.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+NS_FK_BEGIN
+
+std::atomic<bool> FrameProfiler::s_capturing(false);
+
+namespace
+{
+    // One per thread that ever named itself or recorded. The owner is the
+    // only writer of events and head; readers only look at events below
+    // the head they loaded.
+    struct ThreadBuffer
+    {
+        std::atomic<ProfileEvent*> events;   // Allocated on the first record.
+        std::atomic<uint64>        head;     // Events ever written.
+        uint32                     threadId;
+        char                       name[32]; // Guarded by g_nameMutex once linked.
+        ThreadBuffer*              next;
+    };
+
+    // Buffers are never freed, a trace may still reference exited threads.
+    std::atomic<ThreadBuffer*> g_buffers(nullptr);
+    std::atomic<uint32>        g_nextThreadId(1);
+    THREAD_LOCAL ThreadBuffer* t_buffer = nullptr;
+    // Threads may be renamed while a trace is written, both are rare.
+    std::mutex                 g_nameMutex;
+
+    std::atomic<uint64>        g_overruns(0);
+
+    // Capture state, touched by startCapture() and update() only.
+    std::atomic<bool>          g_writing(false);
+    int64                      g_captureStart = 0;
+    int64                      g_captureEnd = 0;
+    std::string                g_filePrefix;
+
+    ThreadBuffer* getThreadBuffer()
+    {
+        ThreadBuffer* buffer = t_buffer;
+        if (buffer == nullptr)
+        {
+            buffer = new ThreadBuffer();
+            buffer->events.store(nullptr, std::memory_order_relaxed);
+            buffer->head.store(0, std::memory_order_relaxed);
+            buffer->threadId = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+            snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->threadId);
+            buffer->next = g_buffers.load(std::memory_order_relaxed);
+            while (!g_buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed));
+            t_buffer = buffer;
+        }
+        return buffer;
+    }
+
+    void append(const char* name, int64 start, int64 duration)
+    {
+        ThreadBuffer* buffer = getThreadBuffer();
+        ProfileEvent* events = buffer->events.load(std::memory_order_relaxed);
+        if (events == nullptr)
+        {
+            events = new ProfileEvent[FrameProfiler::EVENTS_PER_THREAD];
+            buffer->events.store(events, std::memory_order_release);
+        }
+        uint64 head = buffer->head.load(std::memory_order_relaxed);
+        ProfileEvent& event = events[head % FrameProfiler::EVENTS_PER_THREAD];
+        event.name = name;
+        event.start = start;
+        event.duration = duration;
+        buffer->head.store(head + 1, std::memory_order_release);
+    }
+
+    uint32 currentProcessId()
+    {
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        return static_cast<uint32>(GetCurrentProcessId());
+#else
+        return static_cast<uint32>(getpid());
+#endif
+    }
+
+    void writeJsonString(FILE* file, const char* value)
+    {
+        fputc('"', file);
+        for (const char* c = value; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            if ((unsigned char)*c >= 0x20)
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+bool FrameProfiler::startCapture(double seconds, const std::string& filePrefix)
+{
+    if (isCapturing() || g_writing.load(std::memory_order_acquire))
+        return false;
+    g_filePrefix = filePrefix;
+    g_captureStart = Timer::nowNanoseconds();
+    g_captureEnd = g_captureStart + static_cast<int64>(seconds * 1e9);
+    s_capturing.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void FrameProfiler::update()
+{
+    if (!isCapturing() || Timer::nowNanoseconds() < g_captureEnd)
+        return;
+
+    s_capturing.store(false, std::memory_order_relaxed);
+    g_writing.store(true, std::memory_order_relaxed);
+    std::string path = g_filePrefix + "_" + std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()) + ".json";
+    int64 from = g_captureStart;
+    int64 to = g_captureEnd;
+    auto writeTrace = [path, from, to]()
+    {
+        if (writeChromeTrace(path, from, to))
+            LOG_INFO(">>Profile written to %s", path.c_str());
+        else
+            LOG_ERROR("***** Cannot write profile %s", path.c_str());
+        g_writing.store(false, std::memory_order_release);
+    };
+    // Formatting tens of thousands of events would show up as an overrun
+    // of its own, keep it off the main loop when there is a worker.
+    TaskScheduler* scheduler = TaskScheduler::getInstance();
+    if (scheduler->isRunning() && scheduler->getWorkerCount() > 0)
+        scheduler->submit(writeTrace);
+    else
+        writeTrace();
+}
+
+void FrameProfiler::setThreadName(const char* name)
+{
+    ThreadBuffer* buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(g_nameMutex);
+    snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+void FrameProfiler::record(const char* name, int64 start, int64 end)
+{
+    // A scope that began before the capture ended may finish after it.
+    if (!isCapturing())
+        return;
+    append(name, start, end - start);
+}
+
+void FrameProfiler::recordInstant(const char* name, int64 time)
+{
+    if (!isCapturing())
+        return;
+    append(name, time, -1);
+}
+
+bool FrameProfiler::endFrame(int64 frameStart, int64 frameEnd, int64 budget)
+{
+    bool overrun = frameEnd - frameStart > budget;
+    if (overrun)
+        g_overruns.fetch_add(1, std::memory_order_relaxed);
+    if (isCapturing())
+    {
+        append("frame", frameStart, frameEnd - frameStart);
+        if (overrun)
+            append("frame overrun", frameEnd, -1);
+    }
+    return overrun;
+}
+
+uint64 FrameProfiler::getOverrunCount()
+{
+    return g_overruns.load(std::memory_order_relaxed);
+}
+
+bool FrameProfiler::writeChromeTrace(const std::string& path, int64 from, int64 to)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    uint32 pid = currentProcessId();
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (ThreadBuffer* buffer = g_buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", pid, buffer->threadId);
+        char name[sizeof(buffer->name)];
+        {
+            std::lock_guard<std::mutex> lock(g_nameMutex);
+            memcpy(name, buffer->name, sizeof(name));
+        }
+        writeJsonString(file, name);
+        fprintf(file, "}}");
+        first = false;
+
+        ProfileEvent* events = buffer->events.load(std::memory_order_acquire);
+        if (events == nullptr)
+            continue;
+        uint64 head = buffer->head.load(std::memory_order_acquire);
+        // When the ring is full the oldest slot is the next one written,
+        // leave it out in case a late scope is writing it right now.
+        uint64 begin = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD + 1 : 0;
+        for (uint64 i = begin; i < head; ++i)
+        {
+            const ProfileEvent& event = events[i % EVENTS_PER_THREAD];
+            if (event.start < from || event.start >= to)
+                continue;
+            fprintf(file, ",\n{\"name\":");
+            writeJsonString(file, event.name);
+            if (event.duration >= 0)
+            {
+                fprintf(file, ",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}"
+                    , pid, buffer->threadId, (event.start - from) / 1000.0, event.duration / 1000.0);
+            }
+            else
+            {
+                fprintf(file, ",\"ph\":\"i\",\"s\":\"g\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f}"
+                    , pid, buffer->threadId, (event.start - from) / 1000.0);
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+NS_FK_END
@@ -0,0 +1,115 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_FRAMEPROFILER_H
+#define LOSEMYMIND_FRAMEPROFILER_H
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/Timer.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+/** One recorded scope. duration is -1 for instant events such as overruns. */
+struct ProfileEvent
+{
+    const char* name;      // String literal, only the pointer is kept.
+    int64       start;     // Timer::nowNanoseconds()
+    int64       duration;
+};
+
+/**
+ * Scoped phase markers recorded into per-thread ring buffers, written out
+ * as Chrome trace JSON (chrome://tracing, Perfetto).
+ *
+ * Nothing is recorded until a capture is started; until then a marker
+ * costs one relaxed load. During a capture every thread appends to its own
+ * ring of EVENTS_PER_THREAD events, the owner is the only writer, so
+ * recording takes no lock. When the capture ends update() writes the
+ * events of the capture window on the task scheduler.
+ *
+ * Frame overruns are detected by endFrame() whether or not a capture
+ * runs, and show up in a capture as instant events.
+ *
+ * Sample usage:
+ *
+ *     void ConnectionManager::update(float deltaTime)
+ *     {
+ *         PROFILE_SCOPE("ConnectionManager::update");
+ *         ...
+ *     }
+ */
+class FrameProfiler
+{
+public:
+    /** 24 bytes each, 1.5MB per thread that records while a capture runs. */
+    static const uint32 EVENTS_PER_THREAD = 64 * 1024;
+
+    static bool isCapturing(){ return s_capturing.load(std::memory_order_relaxed); }
+
+    /**
+     * Records for seconds, then writes filePrefix_<time>.json. Returns false
+     * if a capture is still running or being written.
+     */
+    static bool startCapture(double seconds, const std::string& filePrefix = "profile");
+
+    /** Call once per frame from the main loop; ends and writes captures. */
+    static void update();
+
+    /** Name shown for the calling thread in the trace. */
+    static void setThreadName(const char* name);
+
+    static void record(const char* name, int64 start, int64 end);
+    static void recordInstant(const char* name, int64 time);
+
+    /**
+     * Records the frame as an event and checks it against budget, all in
+     * nanoseconds. Returns true if the frame overran.
+     */
+    static bool endFrame(int64 frameStart, int64 frameEnd, int64 budget);
+
+    /** Frames that went over budget since startup. */
+    static uint64 getOverrunCount();
+
+    /** Writes the recorded events that started in [from, to) of all threads. */
+    static bool writeChromeTrace(const std::string& path, int64 from, int64 to);
+
+private:
+    static std::atomic<bool> s_capturing;
+};
+
+/** Records the lifetime of the scope when a capture is running. */
+class ProfileScope : noncopyable
+{
+public:
+    explicit ProfileScope(const char* name)
+        : _name(name)
+        , _start(FrameProfiler::isCapturing() ? Timer::nowNanoseconds() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (_start != 0)
+            FrameProfiler::record(_name, _start, Timer::nowNanoseconds());
+    }
+
+private:
+    const char* _name;
+    int64       _start;
+};
+
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(NAME) FoundationKit::ProfileScope PROFILE_SCOPE_CONCAT(profileScope, __LINE__)(NAME)
+
+NS_FK_END
+#endif // LOSEMYMIND_FRAMEPROFILER_H
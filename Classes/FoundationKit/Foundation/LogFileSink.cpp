@@ -0,0 +1,284 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "LogFileSink.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace
+{
+    int64 nowMilliseconds()
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+LogFileSink::Segment::Segment()
+    : data(nullptr)
+    , capacity(0)
+    , used(0)
+    , synced(0)
+    , openTime(0)
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    , file(INVALID_HANDLE_VALUE)
+    , mapping(nullptr)
+#else
+    , fd(-1)
+#endif
+{
+}
+
+LogFileSink::LogFileSink()
+    : _segmentSize(0)
+    , _rotateSeconds(0)
+    , _maxSegments(0)
+    , _syncInterval(1000)
+    , _syncBytes(4 * 1024 * 1024)
+    , _lastSync(0)
+    , _sequence(0)
+{
+}
+
+LogFileSink::~LogFileSink()
+{
+    close();
+}
+
+bool LogFileSink::open(const std::string& basePath, size_t segmentSize, uint32 rotateSeconds, uint32 maxSegments)
+{
+    close();
+
+    char stamp[32] = { 0 };
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    _basePath      = basePath;
+    _startTime     = stamp;
+    _segmentSize   = segmentSize;
+    _rotateSeconds = rotateSeconds;
+    _maxSegments   = maxSegments;
+    _sequence      = 0;
+    _lastSync      = nowMilliseconds();
+
+    if (!createSegment(_active))
+        return false;
+    _active.openTime = _lastSync;
+    // Failing here is not fatal, rotate() retries when the segment is needed.
+    createSegment(_next);
+    return true;
+}
+
+void LogFileSink::close()
+{
+    if (_active.data != nullptr)
+        closeSegment(_active, true);
+    if (_next.data != nullptr)
+        closeSegment(_next, false);
+    _closedSegments.clear();
+}
+
+bool LogFileSink::isOpen()const
+{
+    return _active.data != nullptr;
+}
+
+void LogFileSink::write(const char* data, size_t length)
+{
+    while (length > 0 && _active.data != nullptr)
+    {
+        if (_rotateSeconds > 0 && _active.used > 0
+            && nowMilliseconds() - _active.openTime >= (int64)_rotateSeconds * 1000)
+        {
+            if (!rotate())
+                return;
+        }
+
+        size_t room = _active.capacity - _active.used;
+        size_t count = length;
+        if (count > room)
+        {
+            // Split at the last complete line that fits, unless a single
+            // line is longer than what is left.
+            count = room;
+            while (count > 0 && data[count - 1] != '\n')
+                --count;
+            if (count == 0 && _active.used == 0)
+                count = room;
+        }
+
+        memcpy(_active.data + _active.used, data, count);
+        _active.used += count;
+        data += count;
+        length -= count;
+        if (length > 0 && !rotate())
+            return;
+    }
+}
+
+void LogFileSink::sync(bool force)
+{
+    if (_active.data == nullptr || _active.used == _active.synced)
+        return;
+    int64 now = nowMilliseconds();
+    if (!force && now - _lastSync < (int64)_syncInterval && _active.used - _active.synced < _syncBytes)
+        return;
+    syncSegment(_active);
+    _lastSync = now;
+}
+
+void LogFileSink::setSyncPolicy(uint32 syncInterval, size_t syncBytes)
+{
+    _syncInterval = syncInterval;
+    _syncBytes = syncBytes;
+}
+
+uint32 LogFileSink::getSegmentCount()const
+{
+    // The preallocated segment is not counted until it becomes active.
+    return _next.data != nullptr ? _sequence - 1 : _sequence;
+}
+
+bool LogFileSink::createSegment(Segment& segment)
+{
+    char suffix[32] = { 0 };
+    snprintf(suffix, sizeof(suffix), ".%04u.log", _sequence);
+    segment = Segment();
+    segment.path = _basePath + "_" + _startTime + suffix;
+    segment.capacity = _segmentSize;
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    HANDLE file = CreateFileA(segment.path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ
+        , nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    // The mapping extends the file to its full size.
+    ULARGE_INTEGER size;
+    size.QuadPart = _segmentSize;
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, _segmentSize) : nullptr;
+    if (data == nullptr)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        DeleteFileA(segment.path.c_str());
+        return false;
+    }
+    segment.file = file;
+    segment.mapping = mapping;
+#else
+    int fd = ::open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    // Allocate the blocks up front: writing through a mapping of a sparse
+    // file raises SIGBUS instead of an error when the disk is full.
+#if (TARGET_PLATFORM == PLATFORM_MAC) || (TARGET_PLATFORM == PLATFORM_IOS)
+    bool allocated = ftruncate(fd, _segmentSize) == 0;
+#else
+    bool allocated = posix_fallocate(fd, 0, _segmentSize) == 0;
+#endif
+    void* data = allocated ? mmap(nullptr, _segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (data == MAP_FAILED)
+    {
+        ::close(fd);
+        unlink(segment.path.c_str());
+        return false;
+    }
+    segment.fd = fd;
+#endif
+    segment.data = static_cast<uint8*>(data);
+    ++_sequence;
+    return true;
+}
+
+void LogFileSink::closeSegment(Segment& segment, bool keep)
+{
+    if (keep)
+        syncSegment(segment);
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    UnmapViewOfFile(segment.data);
+    CloseHandle(segment.mapping);
+    if (keep)
+    {
+        LARGE_INTEGER used;
+        used.QuadPart = segment.used;
+        SetFilePointerEx(segment.file, used, nullptr, FILE_BEGIN);
+        SetEndOfFile(segment.file);
+    }
+    CloseHandle(segment.file);
+    if (!keep)
+        DeleteFileA(segment.path.c_str());
+#else
+    munmap(segment.data, segment.capacity);
+    if (keep && ftruncate(segment.fd, segment.used) != 0)
+        fprintf(stderr, "LogFileSink: cannot truncate %s\n", segment.path.c_str());
+    ::close(segment.fd);
+    if (!keep)
+        unlink(segment.path.c_str());
+#endif
+
+    if (keep)
+    {
+        _closedSegments.push_back(segment.path);
+        // The active segment counts towards the limit too.
+        while (_maxSegments > 0 && _closedSegments.size() >= _maxSegments)
+        {
+            remove(_closedSegments.front().c_str());
+            _closedSegments.pop_front();
+        }
+    }
+    segment = Segment();
+}
+
+void LogFileSink::syncSegment(Segment& segment)
+{
+    if (segment.used == segment.synced)
+        return;
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    FlushViewOfFile(segment.data, segment.used);
+    FlushFileBuffers(segment.file);
+#elif (TARGET_PLATFORM == PLATFORM_MAC) || (TARGET_PLATFORM == PLATFORM_IOS)
+    msync(segment.data, segment.used, MS_SYNC);
+#else
+    // Pages dirtied through a shared mapping live in the page cache,
+    // fdatasync writes them back without touching unrelated metadata.
+    fdatasync(segment.fd);
+#endif
+    segment.synced = segment.used;
+}
+
+bool LogFileSink::rotate()
+{
+    closeSegment(_active, true);
+    if (_next.data != nullptr)
+    {
+        _active = _next;
+        _next = Segment();
+    }
+    else if (!createSegment(_active))
+    {
+        fprintf(stderr, "LogFileSink: cannot create segment %04u of %s\n", _sequence, _basePath.c_str());
+        return false;
+    }
+    _active.openTime = nowMilliseconds();
+    createSegment(_next);
+    return true;
+}
+
+NS_FK_END
@@ -0,0 +1,108 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_LOGFILESINK_H
+#define LOSEMYMIND_LOGFILESINK_H
+
+#pragma once
+#include <deque>
+#include <string>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+
+NS_FK_BEGIN
+
+/**
+ * Log file output made of preallocated, memory mapped segments.
+ *
+ * Lines are copied straight into the mapping of the active segment. The
+ * next segment is created, allocated on disk and mapped as soon as the
+ * active one opens, so rotating is a pointer swap. Dirty pages are written
+ * back with fdatasync (FlushViewOfFile on Windows) in batches, at most once
+ * per syncInterval milliseconds or every syncBytes bytes.
+ *
+ * Segments are named <basePath>_<start time>.<sequence>.log. When a segment
+ * is closed it is truncated to the bytes actually written.
+ *
+ * Not thread safe, Logger calls it from its backend thread only.
+ */
+class LogFileSink : noncopyable
+{
+public:
+    LogFileSink();
+    ~LogFileSink();
+
+    /**
+     * Opens the first segment.
+     *
+     * @param basePath      Path prefix of the segment files, the directory must exist.
+     * @param segmentSize   Bytes preallocated per segment, a segment rotates when full.
+     * @param rotateSeconds Rotates a segment this old on the next write, 0 disables.
+     * @param maxSegments   Deletes the oldest segments beyond this count, 0 keeps all.
+     * @return false if the first segment could not be created.
+     */
+    bool open(const std::string& basePath, size_t segmentSize, uint32 rotateSeconds = 0, uint32 maxSegments = 0);
+
+    /** Flushes and truncates the active segment, removes the unused preallocated one. */
+    void close();
+
+    bool isOpen()const;
+
+    /** Appends data, rotating as often as needed. */
+    void write(const char* data, size_t length);
+
+    /**
+     * Writes dirty pages back to disk if the batch limits are reached.
+     * @param force Sync now regardless of the limits.
+     */
+    void sync(bool force = false);
+
+    /** Batch limits of sync(). */
+    void setSyncPolicy(uint32 syncInterval, size_t syncBytes);
+
+    /** Number of segments opened so far, the first one included. */
+    uint32 getSegmentCount()const;
+
+private:
+    struct Segment
+    {
+        Segment();
+        std::string path;
+        uint8*      data;
+        size_t      capacity;
+        size_t      used;
+        size_t      synced;
+        int64       openTime;
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        void*       file;
+        void*       mapping;
+#else
+        int         fd;
+#endif
+    };
+
+    bool createSegment(Segment& segment);
+    void closeSegment(Segment& segment, bool keep);
+    void syncSegment(Segment& segment);
+    bool rotate();
+
+    std::string             _basePath;
+    std::string             _startTime;
+    size_t                  _segmentSize;
+    uint32                  _rotateSeconds;
+    uint32                  _maxSegments;
+    uint32                  _syncInterval;
+    size_t                  _syncBytes;
+    int64                   _lastSync;
+    uint32                  _sequence;
+    Segment                 _active;
+    Segment                 _next;
+    std::deque<std::string> _closedSegments;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_LOGFILESINK_H
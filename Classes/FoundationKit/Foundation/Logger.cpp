@@ -5,8 +5,13 @@
 
 ****************************************************************************/
 #include <vector>
+#include <chrono>
+#include <functional>
 #include <stdarg.h>
 #include "Logger.h"
+#include "LogFileSink.h"
+#include "FoundationKit/Base/MemoryTracker.h"
+#include "FoundationKit/Base/ThreadExit.h"
 #include "FoundationKit/Foundation/StringUtils.h"
 
 #if (TARGET_PLATFORM == PLATFORM_WIN32)
@@ -23,70 +28,593 @@ NS_FK_BEGIN
 static const size_t MAX_LOG_LENGTH = 1024;
 static const char*  LevelMsg[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
 
+// Longest line a ring record can hold, longer lines are truncated.
+static const size_t MAX_RECORD_LENGTH = 4 * 1024;
 
-Logger::State::State():enabled(true){}
+/**
+ * Single producer single consumer ring of variable sized records.
+ * A record never wraps: when it does not fit before the end of the
+ * buffer a padding record fills the gap and the record starts at 0.
+ */
+class LogRing
+{
+public:
+    explicit LogRing(size_t capacity)
+        : _buffer(capacity)
+        , _capacity(capacity)
+        , _mask(capacity - 1)
+        , _head(0)
+        , _tail(0)
+        , _retired(false)
+    {
+        LOG_ASSERT((capacity & (capacity - 1)) == 0, "LogRing capacity must be a power of two.");
+        MemoryTracker::allocate(MemoryTag::Logger, capacity);
+    }
+
+    ~LogRing()
+    {
+        MemoryTracker::free(MemoryTag::Logger, _capacity);
+    }
+
+    static uint32 recordSize(size_t length)
+    {
+        return static_cast<uint32>((sizeof(RecordHeader) + length + 7) & ~size_t(7));
+    }
+
+    // Producer side, returns nullptr when the ring is full.
+    RecordHeader* prepare(size_t length)
+    {
+        size_t total = recordSize(length);
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        size_t pos = head & _mask;
+        size_t contiguous = _capacity - pos;
+        size_t need = total <= contiguous ? total : contiguous + total;
+        if (_capacity - (head - tail) < need)
+            return nullptr;
+
+        if (total > contiguous)
+        {
+            RecordHeader* padding = reinterpret_cast<RecordHeader*>(&_buffer[pos]);
+            padding->size = static_cast<uint32>(contiguous);
+            padding->kind = RK_PADDING;
+            _head.store(head + contiguous, std::memory_order_release);
+            pos = 0;
+        }
+        return reinterpret_cast<RecordHeader*>(&_buffer[pos]);
+    }
+
+    void commit(RecordHeader* record)
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+    }
+
+    // Consumer side, returns nullptr when the ring is empty.
+    const RecordHeader* peek()
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return nullptr;
+        return reinterpret_cast<const RecordHeader*>(&_buffer[tail & _mask]);
+    }
+
+    void release(const RecordHeader* record)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+    }
+
+    bool empty()const
+    {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+    // Called by the owning thread as it exits; nothing is written after this.
+    void retire()
+    {
+        _retired.store(true, std::memory_order_release);
+    }
+
+    bool isRetired()const
+    {
+        return _retired.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<uint8>  _buffer;
+    const size_t        _capacity;
+    const size_t        _mask;
+    char                _pad0[64];
+    std::atomic<size_t> _head;
+    char                _pad1[64];
+    std::atomic<size_t> _tail;
+    char                _pad2[64];
+    std::atomic<bool>   _retired;
+};
+
+// Ring of the calling thread, created on its first log line.
+static THREAD_LOCAL LogRing* t_logRing = nullptr;
+
+// The backend drains a retired ring one last time and then frees it.
+static void retireThreadRing(void* ring)
+{
+    static_cast<LogRing*>(ring)->retire();
+    t_logRing = nullptr;
+}
+
+// Set while the calling thread holds the synchronous record.
+static THREAD_LOCAL bool t_syncRecord = false;
+
+// All six levels start enabled.
+std::atomic<uint32> Logger::s_levelMask(0x3F);
+
+namespace
+{
+    struct SiteRule
+    {
+        std::string file;
+        int         line;
+        bool        enabled;
+    };
+
+    std::mutex& getSiteMutex()
+    {
+        static std::mutex* siteMutex = new std::mutex();
+        return *siteMutex;
+    }
+
+    // Sites first run on many threads at once; this creates the mutex during
+    // static initialization, before any of them start.
+    std::mutex& g_siteMutex = getSiteMutex();
+
+    // Registered sites form an intrusive list, guarded by getSiteMutex().
+    LogSite* g_logSites = nullptr;
+
+    std::vector<SiteRule>& getSiteRules()
+    {
+        static std::vector<SiteRule> rules;
+        return rules;
+    }
+
+    bool siteMatches(const LogSite* site, const std::string& file, int line)
+    {
+        if (line != 0 && site->line != line)
+            return false;
+        size_t length = strlen(site->file);
+        return length >= file.size() && file.compare(0, file.size(), site->file + length - file.size()) == 0;
+    }
+
+    // Later rules win, so re-enabling a line after disabling its file works.
+    void applySiteRules(LogSite* site)
+    {
+        for (auto& rule : getSiteRules())
+        {
+            if (siteMatches(site, rule.file, rule.line))
+                site->disabled.store(!rule.enabled, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::registerSite(LogSite* site, const char* file, int line)
+{
+    std::lock_guard<std::mutex> lock(getSiteMutex());
+    if (site->registered.load(std::memory_order_relaxed))
+        return;
+    site->file = file;
+    site->line = line;
+    applySiteRules(site);
+    site->next = g_logSites;
+    g_logSites = site;
+    site->registered.store(true, std::memory_order_release);
+}
+
+void Logger::setSiteEnabled(const char* file, int line, bool enabled)
+{
+    std::lock_guard<std::mutex> lock(getSiteMutex());
+    SiteRule rule = { file, line, enabled };
+    getSiteRules().push_back(rule);
+    for (LogSite* site = g_logSites; site != nullptr; site = site->next)
+    {
+        if (siteMatches(site, rule.file, rule.line))
+            site->disabled.store(!enabled, std::memory_order_relaxed);
+    }
+}
+
+bool Logger::rateLimit(LogSite& site, uint32 perSecond, uint32& suppressed)
+{
+    using namespace std::chrono;
+    int64 now = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    int64 start = site.windowStart.load(std::memory_order_relaxed);
+    suppressed = 0;
+    if (now - start >= 1000 && site.windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+    {
+        // This thread opened the new window, it reports what the last one dropped.
+        site.windowCount.store(0, std::memory_order_relaxed);
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    }
+    if (site.windowCount.fetch_add(1, std::memory_order_relaxed) < perSecond)
+        return true;
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+Logger::Logger()
+    : _async(true)
+    , _overflowPolicy(OverflowPolicy::Drop)
+    , _droppedCount(0)
+    , _running(true)
+    , _writing(false)
+    , _binaryFile(nullptr)
+    , _fileSink(nullptr)
+{
+    _backendThread = std::thread(std::bind(&Logger::backendLoop, this));
+}
+
+Logger::~Logger()
+{
+    _running = false;
+    if (_backendThread.joinable())
+        _backendThread.join();
+
+    std::string batch;
+    drainRings(batch);
+    output(batch);
+
+    // Rings of threads that are still running stay alive, they may log again.
+    // Retired rings were freed by drainRings.
+    _rings.clear();
+
+    if (_binaryFile != nullptr)
+        fclose(_binaryFile);
+    delete _fileSink;
+}
 
 void Logger::log( Level level, const char* message, ... )
 {
-    Logger::State& state = _states[level];
-    if (!state.enabled)
+    if (!isLevelEnabled(level))
         return;
-    std::string strPreMsg = LevelMsg[level];
-    strPreMsg += ":";
     va_list args;
 
-    // Declare a moderately sized buffer on the stack that should be
-    // large enough to accommodate most log requests.
-    int size = MAX_LOG_LENGTH;
-    //char stackBuffer[MAX_LOG_LENGTH] = { 0 };
-    std::vector<char> dynamicBuffer(MAX_LOG_LENGTH);
-    char* str = &dynamicBuffer[0];
+    // Format on the stack, only lines longer than MAX_LOG_LENGTH touch the heap.
+    char stackBuffer[MAX_LOG_LENGTH];
+    va_start(args, message);
+    int needed = vsnprintf(stackBuffer, MAX_LOG_LENGTH, message, args);
+    va_end(args);
+    // NOTE: Some platforms return -1 when vsnprintf runs out of room, while others return
+    // the number of characters actually needed to fill the buffer.
+    if (needed >= 0 && needed < (int)MAX_LOG_LENGTH)
+    {
+        write(level, stackBuffer, needed);
+        return;
+    }
+
+    int size = needed > 0 ? (needed + 1) : (MAX_LOG_LENGTH * 2);
+    std::vector<char> dynamicBuffer;
     for (;;)
     {
+        dynamicBuffer.resize(size);
         va_start(args, message);
-        // Pass one less than size to leave room for NULL terminator
-        int needed = vsnprintf(str, size - 1, message, args);
+        needed = vsnprintf(&dynamicBuffer[0], size, message, args);
         va_end(args);
-        // NOTE: Some platforms return -1 when vsnprintf runs out of room, while others return
-        // the number of characters actually needed to fill the buffer.
         if (needed >= 0 && needed < size)
+            break;
+        size = needed > 0 ? (needed + 1) : (size * 2);
+    }
+    write(level, &dynamicBuffer[0], needed);
+}
+
+bool Logger::isEnabled( Level level )
+{
+    return isLevelEnabled(level);
+}
+
+void Logger::setEnabled( Level level, bool enabled )
+{
+    if (enabled)
+        s_levelMask.fetch_or(1u << level, std::memory_order_relaxed);
+    else
+        s_levelMask.fetch_and(~(1u << level), std::memory_order_relaxed);
+}
+
+void Logger::setAsync(bool async)
+{
+    flush();
+    _async.store(async, std::memory_order_relaxed);
+}
+
+void Logger::flush()
+{
+    for (;;)
+    {
+        // Rings first: the backend marks itself writing before it drains,
+        // so empty rings followed by !_writing means the output is done.
+        bool idle = true;
         {
-            // Successfully wrote buffer. Added a NULL terminator in case it wasn't written.
-            str[needed] = '\0';
+            std::lock_guard<std::mutex> lock(_ringsMutex);
+            for (auto ring : _rings)
+            {
+                if (!ring->empty())
+                {
+                    idle = false;
+                    break;
+                }
+            }
+        }
+        if (idle)
+            idle = !_writing.load(std::memory_order_acquire);
+        if (idle || !_running)
             break;
+        std::this_thread::yield();
+    }
+}
+
+void Logger::write(Level level, const char* str, size_t length)
+{
+    if (length > MAX_RECORD_LENGTH)
+        length = MAX_RECORD_LENGTH;
+
+    RecordHeader* record = prepareRecord(level, RK_TEXT, length);
+    if (record == nullptr)
+        return;
+    memcpy(record + 1, str, length);
+    commitRecord(record);
+}
+
+RecordHeader* Logger::prepareRecord(Level level, RecordKind kind, size_t length)
+{
+    if (length > MAX_RECORD_LENGTH)
+    {
+        _droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    RecordHeader* record = nullptr;
+    if (_async.load(std::memory_order_relaxed))
+    {
+        LogRing* ring = getThreadRing();
+        record = ring->prepare(length);
+        while (record == nullptr)
+        {
+            if (_overflowPolicy.load(std::memory_order_relaxed) == OverflowPolicy::Drop || !_running)
+            {
+                _droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::this_thread::yield();
+            record = ring->prepare(length);
+        }
+    }
+    else
+    {
+        // Synchronous mode formats in commitRecord, released there.
+        _syncMutex.lock();
+        t_syncRecord = true;
+        _syncRecord.resize(LogRing::recordSize(length));
+        record = reinterpret_cast<RecordHeader*>(&_syncRecord[0]);
+    }
+    record->size   = LogRing::recordSize(length);
+    record->kind   = static_cast<uint8>(kind);
+    record->level  = static_cast<uint8>(level);
+    record->length = static_cast<uint16>(length);
+    return record;
+}
+
+void Logger::commitRecord(RecordHeader* record)
+{
+    Level level = static_cast<Level>(record->level);
+    if (t_syncRecord)
+    {
+        std::string line;
+        formatRecord(record, line);
+        t_syncRecord = false;
+        _syncMutex.unlock();
+        output(line);
+        if (level == LV_FATAL)
+            syncLogFile(true);
+        return;
+    }
+
+    t_logRing->commit(record);
+    // Fatal lines must reach the output before the process goes down.
+    if (level == LV_FATAL)
+    {
+        flush();
+        syncLogFile(true);
+    }
+}
+
+void Logger::formatRecord(const RecordHeader* record, std::string& out)
+{
+    const char* payload = reinterpret_cast<const char*>(record + 1);
+    out += LevelMsg[record->level];
+    out += ":";
+    if (record->kind == RK_TEXT)
+    {
+        out.append(payload, record->length);
+    }
+    else if (record->kind == RK_BINARY && record->length >= sizeof(uint32))
+    {
+        uint32 formatId = 0;
+        memcpy(&formatId, payload, sizeof(uint32));
+        const char* format = BinaryLog::getFormat(formatId);
+        if (format != nullptr)
+            BinaryLog::format(format, (const uint8*)payload + sizeof(uint32), record->length - sizeof(uint32), out);
+    }
+    out += "\n";
+}
+
+bool Logger::setBinaryLogFile(const std::string& path)
+{
+    FILE* file = nullptr;
+    if (!path.empty())
+    {
+        file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+    }
+
+    flush();
+    std::lock_guard<std::mutex> lock(_ringsMutex);
+    if (_binaryFile != nullptr)
+        fclose(_binaryFile);
+    _binaryFile = file;
+    _binaryFormats.clear();
+    return true;
+}
+
+bool Logger::setLogFile(const std::string& basePath, size_t segmentSize, uint32 rotateSeconds, uint32 maxSegments)
+{
+    LogFileSink* sink = nullptr;
+    if (!basePath.empty())
+    {
+        sink = new LogFileSink();
+        if (!sink->open(basePath, segmentSize, rotateSeconds, maxSegments))
+        {
+            delete sink;
+            return false;
+        }
+    }
+
+    flush();
+    std::lock_guard<std::mutex> lock(_fileMutex);
+    delete _fileSink;
+    _fileSink = sink;
+    return true;
+}
+
+void Logger::syncLogFile(bool force)
+{
+    std::lock_guard<std::mutex> lock(_fileMutex);
+    if (_fileSink != nullptr)
+        _fileSink->sync(force);
+}
+
+LogRing* Logger::getThreadRing()
+{
+    if (t_logRing == nullptr)
+    {
+        t_logRing = new LogRing(RING_CAPACITY);
+        ThreadExit::atExit(&retireThreadRing, t_logRing);
+        std::lock_guard<std::mutex> lock(_ringsMutex);
+        _rings.push_back(t_logRing);
+    }
+    return t_logRing;
+}
+
+void Logger::backendLoop()
+{
+    std::string batch;
+    while (_running)
+    {
+        _writing.store(true, std::memory_order_release);
+        bool drained = drainRings(batch);
+        if (drained)
+        {
+            output(batch);
+            batch.clear();
+        }
+        _writing.store(false, std::memory_order_release);
+
+        if (!drained)
+        {
+            // Idle, a good moment for the batched file sync.
+            syncLogFile(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        size = needed > 0 ? (needed + 1) : (size * 2);
-        dynamicBuffer.resize(size);
-        str = &dynamicBuffer[0];
     }
-    strPreMsg += str;
-    strPreMsg += "\n";
+}
+
+bool Logger::drainRings(std::string& batch)
+{
+    std::lock_guard<std::mutex> lock(_ringsMutex);
+    std::string binaryBatch;
+    bool drained = false;
+    for (size_t i = 0; i < _rings.size();)
+    {
+        LogRing* ring = _rings[i];
+        // Read the flag before draining: once it is set the owner has
+        // committed its last record, so the ring is empty after this pass.
+        bool retired = ring->isRetired();
+        const RecordHeader* record = nullptr;
+        while ((record = ring->peek()) != nullptr)
+        {
+            if (record->kind == RK_PADDING)
+            {
+                ring->release(record);
+                continue;
+            }
 
+            if (_binaryFile == nullptr)
+            {
+                formatRecord(record, batch);
+                drained = true;
+            }
+            else
+            {
+                // The first record of every format id is preceded by its format string,
+                // so the file can be decoded on its own.
+                uint32 formatId = 0;
+                if (record->kind == RK_BINARY)
+                    memcpy(&formatId, record + 1, sizeof(uint32));
+                if (formatId != 0 && (formatId >= _binaryFormats.size() || !_binaryFormats[formatId]))
+                {
+                    const char* format = BinaryLog::getFormat(formatId);
+                    size_t length = sizeof(uint32) + (format ? strlen(format) : 0);
+                    RecordHeader header = { LogRing::recordSize(length), RK_FORMAT, 0, static_cast<uint16>(length) };
+                    binaryBatch.append((const char*)&header, sizeof(header));
+                    binaryBatch.append((const char*)&formatId, sizeof(uint32));
+                    binaryBatch.append(format ? format : "");
+                    binaryBatch.append(header.size - sizeof(header) - length, '\0');
+                    if (formatId >= _binaryFormats.size())
+                        _binaryFormats.resize(formatId + 1, false);
+                    _binaryFormats[formatId] = true;
+                }
+                binaryBatch.append((const char*)record, record->size);
+            }
+            ring->release(record);
+        }
+
+        if (retired)
+        {
+            delete ring;
+            _rings[i] = _rings.back();
+            _rings.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (!binaryBatch.empty())
+    {
+        fwrite(binaryBatch.c_str(), 1, binaryBatch.size(), _binaryFile);
+        fflush(_binaryFile);
+    }
+    return drained;
+}
+
+void Logger::output(const std::string& batch)
+{
+    if (batch.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_fileMutex);
+        if (_fileSink != nullptr)
+            _fileSink->write(batch.c_str(), batch.size());
+    }
 #if (TARGET_PLATFORM == PLATFORM_ANDROID)
-    __android_log_print(ANDROID_LOG_DEBUG, "FoundationKit", "%s", strPreMsg.c_str());
+    __android_log_print(ANDROID_LOG_DEBUG, "FoundationKit", "%s", batch.c_str());
 #elif TARGET_PLATFORM ==  PLATFORM_WIN32
-    std::wstring wstr = StringUtils::string2UTF8wstring(strPreMsg);
+    std::wstring wstr = StringUtils::string2UTF8wstring(batch);
     OutputDebugStringW(wstr.c_str());
-    printf("%s", strPreMsg.c_str());
+    fwrite(batch.c_str(), 1, batch.size(), stdout);
     fflush(stdout);
 #else
     // Linux, Mac, iOS, etc
-    fprintf(stdout, "%s", strPreMsg.c_str());
+    fwrite(batch.c_str(), 1, batch.size(), stdout);
     fflush(stdout);
 #endif
 }
 
-bool Logger::isEnabled( Level level )
-{
-    return _states[level].enabled;
-}
-
-void Logger::setEnabled( Level level, bool enabled )
-{
-    _states[level].enabled = enabled;
-}
-
 
 NS_FK_END
-
-
@@ -5,14 +5,65 @@
 
 ****************************************************************************/
 #pragma once
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include "Singleton.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Foundation/BinaryLog.h"
 
 NS_FK_BEGIN
 
+class LogRing;
+class LogFileSink;
+
+/**
+ * Per call site state of the LOG_* macros.
+ *
+ * Every macro expansion owns one static LogSite. It registers itself with
+ * the Logger the first time it runs, after which it can be switched off by
+ * file and line with Logger::setSiteEnabled(). It also carries the counters
+ * of LOG_EVERY_N and LOG_RATE_LIMITED.
+ *
+ * It has no constructor and every member means "default" when zero, so a
+ * static LogSite is zero initialized before any code runs. VS2013 neither
+ * honours constexpr nor guards function local statics, a constructor would
+ * run on first use and could run on two threads at once.
+ */
+struct LogSite
+{
+    /** True if this site and level are enabled, registers the site on first use. */
+    inline bool check(int level, const char* inFile, int inLine);
+
+    const char*          file;        // Set when the site registers.
+    int                  line;
+    std::atomic<bool>    disabled;
+    std::atomic<bool>    registered;
+    std::atomic<uint32>  hits;
+    std::atomic<int64>   windowStart;
+    std::atomic<uint32>  windowCount;
+    std::atomic<uint32>  suppressed;
+    LogSite*             next;
+};
+
+/**
+ * Asynchronous logger.
+ *
+ * Producers format the line and push it into a ring owned by the calling
+ * thread (single producer, single consumer, no locks). A backend thread
+ * drains every ring and writes the lines in batches, so the caller never
+ * touches stdout. A thread's ring is retired when the thread exits and
+ * freed once the backend has drained it. Call setAsync(false) to write on
+ * the calling thread instead.
+ */
 class Logger : public Singleton<Logger>
 {
     friend class Singleton < Logger >;
-    Logger(){};
+    Logger();
 public:
     /** 
      * Enumeration of valid log levels.
@@ -26,13 +77,20 @@ public:
         LV_ERROR,
         LV_FATAL,
     };
-private:
-    struct State
+    /**
+     * What a producer does when its ring is full.
+     */
+    enum class OverflowPolicy
     {
-        State();
-        bool enabled;
+        /** Drop the line and count it, see getDroppedCount(). */
+        Drop,
+        /** Wait for the backend thread to make room. */
+        Block,
     };
 
+    /** Bytes of ring buffer owned by each producer thread. */
+    static const size_t RING_CAPACITY = 64 * 1024;
+
 public:
     /**
      * Logs a message at the specified log level.
@@ -62,22 +120,247 @@ public:
      * @param enabled True to enable the logger for the given level, false to disable it.
      */
     void setEnabled(Level level, bool enabled);
+
+    /**
+     * Same as isEnabled() but does not need the instance, so the LOG_* macros
+     * can skip Logger::getInstance() and their arguments when a level is off.
+     */
+    static bool isLevelEnabled(int level)
+    {
+        return ((s_levelMask.load(std::memory_order_relaxed) >> level) & 1) != 0;
+    }
+
+    /**
+     * Enables or disables the call sites of file (matched as a path suffix).
+     * line 0 matches every line of the file. Applies to sites that have not
+     * run yet as well.
+     */
+    static void setSiteEnabled(const char* file, int line, bool enabled);
+
+    /** Called by LogSite::check() the first time a site runs. */
+    static void registerSite(LogSite* site, const char* file, int line);
+
+    /**
+     * Fixed one second window limiter used by LOG_RATE_LIMITED.
+     *
+     * @param suppressed Set to the number of lines dropped in the previous
+     *                   window when a new window starts, 0 otherwise.
+     * @return true if the line may be logged.
+     */
+    static bool rateLimit(LogSite& site, uint32 perSecond, uint32& suppressed);
+
+    ~Logger();
+
+    /**
+     * Switches between asynchronous (default) and synchronous output.
+     * Pending lines are flushed before the mode changes.
+     */
+    void setAsync(bool async);
+
+    bool isAsync()const{ return _async.load(std::memory_order_relaxed); }
+
+    void setOverflowPolicy(OverflowPolicy policy){ _overflowPolicy.store(policy, std::memory_order_relaxed); }
+
+    OverflowPolicy getOverflowPolicy()const{ return _overflowPolicy.load(std::memory_order_relaxed); }
+
+    /** Number of lines dropped because a ring was full. */
+    uint64 getDroppedCount()const{ return _droppedCount.load(std::memory_order_relaxed); }
+
+    /** Blocks until every line logged so far has been written. */
+    void flush();
+
+    /**
+     * Records a deferred line, see LOG_INFO_DEFERRED.
+     *
+     * Only the format id and the raw argument bytes are copied into the ring;
+     * vsnprintf runs later on the backend thread, or offline when a binary
+     * log file is set.
+     */
+    template<typename... Args>
+    void logDeferred(Level level, uint32 formatId, const Args&... args)
+    {
+        if (!isLevelEnabled(level))
+            return;
+        size_t length = sizeof(uint32) + BinaryLog::measure(args...);
+        RecordHeader* record = prepareRecord(level, RK_BINARY, length);
+        if (record == nullptr)
+            return;
+        uint8* payload = reinterpret_cast<uint8*>(record + 1);
+        memcpy(payload, &formatId, sizeof(uint32));
+        BinaryLog::encode(payload + sizeof(uint32), args...);
+        commitRecord(record);
+    }
+
+    /**
+     * Makes the backend write raw records to path instead of formatting them.
+     * Decode the file with the LogDecoder tool. An empty path switches back
+     * to formatted output.
+     *
+     * @return false if the file could not be opened.
+     */
+    bool setBinaryLogFile(const std::string& path);
+
+    /**
+     * Also writes formatted lines to rotating, memory mapped segment files,
+     * see LogFileSink. The backend thread does all file work, producers only
+     * ever touch their rings. An empty basePath closes the file.
+     *
+     * @param basePath      Path prefix of the segment files.
+     * @param segmentSize   Bytes preallocated per segment, rotates when full.
+     * @param rotateSeconds Also rotates segments older than this, 0 disables.
+     * @param maxSegments   Keeps only the newest segments, 0 keeps all.
+     * @return false if the first segment could not be created.
+     */
+    bool setLogFile(const std::string& basePath, size_t segmentSize = 64 * 1024 * 1024
+        , uint32 rotateSeconds = 0, uint32 maxSegments = 0);
+
 private:
-    State _states[6];
+    void          write(Level level, const char* str, size_t length);
+    RecordHeader* prepareRecord(Level level, RecordKind kind, size_t length);
+    void          commitRecord(RecordHeader* record);
+    void          formatRecord(const RecordHeader* record, std::string& out);
+    LogRing*      getThreadRing();
+    void          backendLoop();
+    bool          drainRings(std::string& batch);
+    void          output(const std::string& batch);
+    void          syncLogFile(bool force);
+
+    static std::atomic<uint32> s_levelMask;
+    std::atomic<bool>          _async;
+    std::atomic<OverflowPolicy> _overflowPolicy;
+    std::atomic<uint64>        _droppedCount;
+    std::atomic<bool>          _running;
+    std::atomic<bool>          _writing;
+    std::mutex                 _ringsMutex;
+    std::vector<LogRing*>      _rings;
+    std::thread                _backendThread;
+    std::mutex                 _syncMutex;
+    std::vector<uint8>         _syncRecord;
+    FILE*                      _binaryFile;
+    std::vector<bool>          _binaryFormats;
+    std::mutex                 _fileMutex;
+    LogFileSink*               _fileSink;
 };
+
+bool LogSite::check(int level, const char* inFile, int inLine)
+{
+    if (!registered.load(std::memory_order_acquire))
+        Logger::registerSite(this, inFile, inLine);
+    return !disabled.load(std::memory_order_relaxed) && Logger::isLevelEnabled(level);
+}
+
 NS_FK_END
 
 extern void _log_(const char* message, ...);
 
-#ifdef FK_DEBUG
-#define LOG_DEBUG(format, ...) Logger::getInstance()->log(Logger::Level::LV_DEBUG, format, ##__VA_ARGS__)
+// Log levels usable in preprocessor conditions, they mirror Logger::Level.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_FATAL 5
+
+// Lines below LOG_MIN_LEVEL are compiled out, arguments included.
+// e.g. add LOG_MIN_LEVEL=2 to the preprocessor definitions to strip TRACE and DEBUG.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// The arguments are only evaluated when the site and level are enabled.
+#define LOG_AT(level, format, ...) \
+    do{ \
+        static LogSite _logSite; \
+        if (_logSite.check(level, __FILE__, __LINE__)) \
+            Logger::getInstance()->log(level, format, ##__VA_ARGS__); \
+    } while (false)
+
+// Logs the 1st, (n+1)th, (2n+1)th... execution of this line.
+#define LOG_EVERY_N(level, n, format, ...) \
+    do{ \
+        static LogSite _logSite; \
+        if (_logSite.check(level, __FILE__, __LINE__) && _logSite.hits.fetch_add(1, std::memory_order_relaxed) % (n) == 0) \
+            Logger::getInstance()->log(level, format, ##__VA_ARGS__); \
+    } while (false)
+
+// Logs at most perSecond lines per second from this line and reports how many were dropped.
+#define LOG_RATE_LIMITED(level, perSecond, format, ...) \
+    do{ \
+        static LogSite _logSite; \
+        uint32 _logSuppressed = 0; \
+        if (_logSite.check(level, __FILE__, __LINE__) && Logger::rateLimit(_logSite, perSecond, _logSuppressed)) \
+        { \
+            if (_logSuppressed > 0) \
+                Logger::getInstance()->log(level, "***** %u similar lines suppressed at %s:%d", _logSuppressed, __FILE__, __LINE__); \
+            Logger::getInstance()->log(level, format, ##__VA_ARGS__); \
+        } \
+    } while (false)
+
+#if defined(FK_DEBUG) && (LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(format, ...) LOG_AT(Logger::Level::LV_DEBUG, format, ##__VA_ARGS__)
 #else
-#define LOG_DEBUG(format, ...)
+#define LOG_DEBUG(format, ...) do{}while(false)
 #endif
-#define LOG_TRACE(format, ...) Logger::getInstance()->log(Logger::Level::LV_TRACE, format, ##__VA_ARGS__)
-#define LOG_INFO( format, ...) Logger::getInstance()->log(Logger::Level::LV_INFO, format, ##__VA_ARGS__)
-#define LOG_WARN( format, ...) Logger::getInstance()->log(Logger::Level::LV_WARN, format, ##__VA_ARGS__)
-#define LOG_ERROR(format, ...) Logger::getInstance()->log(Logger::Level::LV_ERROR, format, ##__VA_ARGS__)
-#define LOG_FATAL(format, ...) Logger::getInstance()->log(Logger::Level::LV_FATAL, format, ##__VA_ARGS__)
 
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(format, ...) LOG_AT(Logger::Level::LV_TRACE, format, ##__VA_ARGS__)
+#else
+#define LOG_TRACE(format, ...) do{}while(false)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO( format, ...) LOG_AT(Logger::Level::LV_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO( format, ...) do{}while(false)
+#endif
 
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN( format, ...) LOG_AT(Logger::Level::LV_WARN, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN( format, ...) do{}while(false)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) LOG_AT(Logger::Level::LV_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do{}while(false)
+#endif
+
+#define LOG_FATAL(format, ...) LOG_AT(Logger::Level::LV_FATAL, format, ##__VA_ARGS__)
+
+// Deferred variants: format must be a string literal, arguments are copied
+// as raw bytes and formatted on the backend thread. Strings passed to %s are
+// copied (up to BinaryLog::MAX_STRING_LENGTH bytes), other pointers are not
+// dereferenced. '*' widths are not supported. The format id has no
+// initializer on purpose: static storage is zeroed before any code runs.
+#define LOG_DEFERRED(level, format, ...) \
+    do{ \
+        static LogSite _logSite; \
+        static std::atomic<uint32> _logFormatId; \
+        if (_logSite.check(level, __FILE__, __LINE__)) \
+            Logger::getInstance()->logDeferred(level, BinaryLog::getFormatId(&_logFormatId, format), ##__VA_ARGS__); \
+    } while (false)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE_DEFERRED(format, ...) LOG_DEFERRED(Logger::Level::LV_TRACE, format, ##__VA_ARGS__)
+#else
+#define LOG_TRACE_DEFERRED(format, ...) do{}while(false)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO_DEFERRED( format, ...) LOG_DEFERRED(Logger::Level::LV_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO_DEFERRED( format, ...) do{}while(false)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN_DEFERRED( format, ...) LOG_DEFERRED(Logger::Level::LV_WARN, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN_DEFERRED( format, ...) do{}while(false)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR_DEFERRED(format, ...) LOG_DEFERRED(Logger::Level::LV_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR_DEFERRED(format, ...) do{}while(false)
+#endif
@@ -0,0 +1,564 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "SamplingProfiler.h"
+#include "FoundationKit/Base/FlatHashMap.h"
+#include "FoundationKit/Base/LockFreeQueue.h"
+#include "Logger.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#include <MMSystem.h>
+#include <TlHelp32.h>
+#include <DbgHelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#pragma comment(lib, "winmm.lib")
+#else
+#include <cerrno>
+#include <csignal>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unwind.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace
+{
+    enum : uint32
+    {
+        STATE_IDLE,
+        STATE_RUNNING,
+        STATE_STOPPING,    // The collector writes the profile, then goes idle.
+        STATE_DISCARDING,  // The collector exits without writing.
+    };
+
+    const uint32 QUEUE_CAPACITY = 4096;
+    const uint32 DRAIN_INTERVAL_MS = 20;
+
+    struct StackSample
+    {
+        uint32 depth;
+        void*  frames[SamplingProfiler::MAX_STACK_DEPTH]; // Leaf first.
+    };
+
+    // Raw frame addresses as the key, symbols are looked up once per
+    // address when the profile is written.
+    typedef FlatHashMap<std::string, uint64, StringHash, StringEqual> StackCounts;
+
+    // Created by the first start() and never freed, a signal raised just
+    // before stop() may still push into it.
+    std::atomic<MpmcBoundedQueue<StackSample>*> g_queue(nullptr);
+    std::atomic<uint32> g_samplesPerSecond(0);
+    std::atomic<uint64> g_samples(0);
+    std::atomic<uint64> g_dropped(0);
+    std::atomic<uint32> g_stacks(0);
+
+    void pushSample(const StackSample& sample)
+    {
+        MpmcBoundedQueue<StackSample>* queue = g_queue.load(std::memory_order_acquire);
+        if (queue != nullptr && queue->push(sample))
+            g_samples.fetch_add(1, std::memory_order_relaxed);
+        else
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void drain(StackCounts& counts)
+    {
+        MpmcBoundedQueue<StackSample>* queue = g_queue.load(std::memory_order_acquire);
+        StackSample sample;
+        while (queue->tryPop(sample))
+        {
+            std::string key(reinterpret_cast<const char*>(sample.frames), sample.depth * sizeof(void*));
+            counts[key] += 1;
+        }
+        g_stacks.store(static_cast<uint32>(counts.size()), std::memory_order_relaxed);
+    }
+
+    // Folded stacks separate frames with ';' and the count with the last space.
+    void appendFrameName(std::string& line, const std::string& name)
+    {
+        for (char c : name)
+        {
+            line += (c == ';' || c == '\n' || c == '\r') ? ':' : c;
+        }
+    }
+
+    std::string offsetName(const char* module, const void* base, const void* address)
+    {
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+0x%llx", (unsigned long long)((uintptr_t)address - (uintptr_t)base));
+        return std::string(module) + offset;
+    }
+
+    std::string addressName(const void* address)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "0x%llx", (unsigned long long)(uintptr_t)address);
+        return name;
+    }
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    struct SampledThread
+    {
+        DWORD   id;
+        HANDLE  handle;
+        ULONG64 cycles;   // At the last tick, threads that did not run are skipped.
+        bool    alive;
+    };
+
+    void refreshThreads(std::vector<SampledThread>& threads)
+    {
+        DWORD processId = GetCurrentProcessId();
+        DWORD selfId = GetCurrentThreadId();
+        for (auto& thread : threads)
+            thread.alive = false;
+
+        HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (snapshot != INVALID_HANDLE_VALUE)
+        {
+            THREADENTRY32 entry;
+            entry.dwSize = sizeof(entry);
+            for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+            {
+                if (entry.th32OwnerProcessID != processId || entry.th32ThreadID == selfId)
+                    continue;
+                bool known = false;
+                for (auto& thread : threads)
+                {
+                    if (thread.id == entry.th32ThreadID)
+                    {
+                        thread.alive = known = true;
+                        break;
+                    }
+                }
+                if (known)
+                    continue;
+                HANDLE handle = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, entry.th32ThreadID);
+                if (handle == nullptr)
+                    continue;
+                SampledThread thread = { entry.th32ThreadID, handle, 0, true };
+                QueryThreadCycleTime(handle, &thread.cycles);
+                threads.push_back(thread);
+            }
+            CloseHandle(snapshot);
+        }
+
+        for (size_t i = 0; i < threads.size();)
+        {
+            if (threads[i].alive)
+            {
+                ++i;
+                continue;
+            }
+            CloseHandle(threads[i].handle);
+            threads[i] = threads.back();
+            threads.pop_back();
+        }
+    }
+
+    // The thread may hold the heap lock or any other, nothing between
+    // SuspendThread and ResumeThread may allocate or log. The x64 unwinder
+    // breaks that rule for code outside the loaded images, see the header.
+    bool captureStack(HANDLE thread, StackSample& sample)
+    {
+        sample.depth = 0;
+        if (SuspendThread(thread) == (DWORD)-1)
+            return false;
+
+        CONTEXT context;
+        memset(&context, 0, sizeof(context));
+        context.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
+        if (GetThreadContext(thread, &context))
+        {
+#if defined(_M_X64)
+            while (sample.depth < SamplingProfiler::MAX_STACK_DEPTH && context.Rip != 0)
+            {
+                sample.frames[sample.depth++] = reinterpret_cast<void*>(context.Rip);
+                DWORD64 imageBase = 0;
+                PRUNTIME_FUNCTION function = RtlLookupFunctionEntry(context.Rip, &imageBase, nullptr);
+                if (function == nullptr)
+                {
+                    // Leaf function without unwind data, the return address is on top of the stack.
+                    context.Rip = *reinterpret_cast<DWORD64*>(context.Rsp);
+                    context.Rsp += sizeof(DWORD64);
+                }
+                else
+                {
+                    void* handlerData = nullptr;
+                    DWORD64 establisherFrame = 0;
+                    RtlVirtualUnwind(UNW_FLAG_NHANDLER, imageBase, context.Rip, function, &context, &handlerData, &establisherFrame, nullptr);
+                }
+            }
+#else
+            sample.frames[sample.depth++] = reinterpret_cast<void*>(context.Eip);
+            // Everything from the stack pointer up to the stack base is
+            // committed, frames outside of it are garbage in ebp.
+            MEMORY_BASIC_INFORMATION region;
+            if (VirtualQuery(reinterpret_cast<void*>(context.Esp), &region, sizeof(region)) != 0)
+            {
+                uintptr_t low = context.Esp;
+                uintptr_t high = reinterpret_cast<uintptr_t>(region.BaseAddress) + region.RegionSize;
+                uintptr_t frame = context.Ebp;
+                while (sample.depth < SamplingProfiler::MAX_STACK_DEPTH
+                    && frame >= low && frame + 2 * sizeof(uintptr_t) <= high && (frame & 3) == 0)
+                {
+                    const uintptr_t* slots = reinterpret_cast<const uintptr_t*>(frame);
+                    if (slots[1] == 0)
+                        break;
+                    sample.frames[sample.depth++] = reinterpret_cast<void*>(slots[1]);
+                    // Callers live further up the stack.
+                    low = frame + 2 * sizeof(uintptr_t);
+                    frame = slots[0];
+                }
+            }
+#endif
+        }
+        ResumeThread(thread);
+        return sample.depth > 0;
+    }
+
+    std::string symbolName(const void* address)
+    {
+        char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+        SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+        memset(symbol, 0, sizeof(SYMBOL_INFO));
+        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+        symbol->MaxNameLen = MAX_SYM_NAME;
+        DWORD64 displacement = 0;
+        if (SymFromAddr(GetCurrentProcess(), (DWORD64)(uintptr_t)address, &displacement, symbol))
+            return std::string(symbol->Name, symbol->NameLen);
+
+        HMODULE module = nullptr;
+        char path[MAX_PATH];
+        if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT
+            , reinterpret_cast<LPCSTR>(address), &module)
+            && GetModuleFileNameA(module, path, MAX_PATH) != 0)
+        {
+            const char* name = strrchr(path, '\\');
+            return offsetName(name ? name + 1 : path, module, address);
+        }
+        return addressName(address);
+    }
+#else
+    _Unwind_Reason_Code unwindFrame(struct _Unwind_Context* context, void* argument)
+    {
+        StackSample* sample = static_cast<StackSample*>(argument);
+        uintptr_t ip = _Unwind_GetIP(context);
+        if (ip == 0 || sample->depth >= SamplingProfiler::MAX_STACK_DEPTH)
+            return _URC_END_OF_STACK;
+        sample->frames[sample->depth++] = reinterpret_cast<void*>(ip);
+        return _URC_NO_REASON;
+    }
+
+    void* interruptedAddress(void* ucontext)
+    {
+        ucontext_t* context = static_cast<ucontext_t*>(ucontext);
+        (void)context;
+#if defined(__linux__) && defined(__x86_64__)
+        return reinterpret_cast<void*>(context->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__linux__) && defined(__i386__)
+        return reinterpret_cast<void*>(context->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__linux__) && defined(__aarch64__)
+        return reinterpret_cast<void*>(context->uc_mcontext.pc);
+#elif defined(__APPLE__) && defined(__x86_64__)
+        return reinterpret_cast<void*>(context->uc_mcontext->__ss.__rip);
+#elif defined(__APPLE__) && defined(__aarch64__)
+        return reinterpret_cast<void*>(context->uc_mcontext->__ss.__pc);
+#else
+        return nullptr;
+#endif
+    }
+
+    // Runs on whichever thread was using the CPU, only async signal safe
+    // calls here: the unwinder, lock free atomics and the queue.
+    void onProfileSignal(int, siginfo_t*, void* ucontext)
+    {
+        if (g_samplesPerSecond.load(std::memory_order_relaxed) == 0)
+            return;
+        int savedErrno = errno;
+        StackSample sample;
+        sample.depth = 0;
+        _Unwind_Backtrace(unwindFrame, &sample);
+
+        // The first frames are this handler and the signal trampoline,
+        // the stack starts at the interrupted instruction.
+        uint32 skip = sample.depth < 2 ? sample.depth : 2;
+        void* interrupted = interruptedAddress(ucontext);
+        for (uint32 i = 0; i < sample.depth && i < 8; ++i)
+        {
+            if (sample.frames[i] == interrupted)
+            {
+                skip = i;
+                break;
+            }
+        }
+        sample.depth -= skip;
+        memmove(sample.frames, sample.frames + skip, sample.depth * sizeof(void*));
+        if (sample.depth > 0)
+            pushSample(sample);
+        errno = savedErrno;
+    }
+
+    void setProfileTimer(uint32 samplesPerSecond)
+    {
+        uint32 interval = samplesPerSecond > 0 ? 1000000 / samplesPerSecond : 0;
+        struct itimerval timer;
+        timer.it_interval.tv_sec = interval / 1000000;
+        timer.it_interval.tv_usec = interval % 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+
+    std::string symbolName(const void* address)
+    {
+        Dl_info info;
+        if (dladdr(address, &info) != 0)
+        {
+            if (info.dli_sname != nullptr)
+            {
+                int status = 0;
+                char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                std::string name = (status == 0 && demangled != nullptr) ? demangled : info.dli_sname;
+                free(demangled);
+                return name;
+            }
+            if (info.dli_fname != nullptr)
+            {
+                const char* name = strrchr(info.dli_fname, '/');
+                return offsetName(name ? name + 1 : info.dli_fname, info.dli_fbase, address);
+            }
+        }
+        return addressName(address);
+    }
+#endif
+
+    bool writeFoldedStacks(const std::string& path, const StackCounts& counts)
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == nullptr)
+            return false;
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        HANDLE process = GetCurrentProcess();
+        SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+        SymInitialize(process, nullptr, TRUE);
+#endif
+        // Stacks that differ only in the instruction within a function
+        // fold into one line.
+        std::unordered_map<const void*, std::string> names;
+        StackCounts folded;
+        std::string line;
+        for (auto& entry : counts)
+        {
+            size_t depth = entry.first.size() / sizeof(void*);
+            line.clear();
+            // Folded stacks go from the root to the leaf.
+            for (size_t i = depth; i-- > 0;)
+            {
+                const void* address;
+                memcpy(&address, entry.first.data() + i * sizeof(void*), sizeof(void*));
+                auto iter = names.find(address);
+                if (iter == names.end())
+                    iter = names.insert(std::make_pair(address, symbolName(address))).first;
+                if (!line.empty())
+                    line += ';';
+                appendFrameName(line, iter->second);
+            }
+            folded[line] += entry.second;
+        }
+        for (auto& entry : folded)
+        {
+            fprintf(file, "%s %llu\n", entry.first.c_str(), (unsigned long long)entry.second);
+        }
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        SymCleanup(process);
+#endif
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+}
+
+SamplingProfiler::SamplingProfiler()
+    : _state(STATE_IDLE)
+{
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+    uint32 expected = STATE_RUNNING;
+    if (_state.compare_exchange_strong(expected, STATE_DISCARDING))
+    {
+#if (TARGET_PLATFORM != PLATFORM_WIN32)
+        setProfileTimer(0);
+#endif
+        g_samplesPerSecond.store(0, std::memory_order_relaxed);
+    }
+    if (_collector.joinable())
+        _collector.join();
+}
+
+bool SamplingProfiler::start(uint32 samplesPerSecond)
+{
+    uint32 expected = STATE_IDLE;
+    if (!_state.compare_exchange_strong(expected, STATE_RUNNING))
+        return false;
+    // The collector of the last profile went idle as its very last step.
+    if (_collector.joinable())
+        _collector.join();
+
+    if (samplesPerSecond == 0)
+        samplesPerSecond = 1;
+    if (samplesPerSecond > MAX_SAMPLES_PER_SECOND)
+        samplesPerSecond = MAX_SAMPLES_PER_SECOND;
+
+    MpmcBoundedQueue<StackSample>* queue = g_queue.load(std::memory_order_acquire);
+    if (queue == nullptr)
+    {
+        queue = new MpmcBoundedQueue<StackSample>(QUEUE_CAPACITY);
+        g_queue.store(queue, std::memory_order_release);
+    }
+    // Samples of signals that arrived after the last stop.
+    StackSample sample;
+    while (queue->tryPop(sample))
+    {
+    }
+    g_samples.store(0, std::memory_order_relaxed);
+    g_dropped.store(0, std::memory_order_relaxed);
+    g_stacks.store(0, std::memory_order_relaxed);
+    g_samplesPerSecond.store(samplesPerSecond, std::memory_order_release);
+
+#if (TARGET_PLATFORM != PLATFORM_WIN32)
+    // The unwinder loads and caches what it needs on first use, which is
+    // not safe in a signal handler; do that here.
+    sample.depth = 0;
+    _Unwind_Backtrace(unwindFrame, &sample);
+
+    // Stays installed after stop(), a SIGPROF still in flight would
+    // otherwise terminate the process.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onProfileSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+    setProfileTimer(samplesPerSecond);
+#endif
+
+    _collector = std::thread(std::bind(&SamplingProfiler::collect, this, samplesPerSecond));
+    return true;
+}
+
+bool SamplingProfiler::stop(const std::string& filePrefix)
+{
+    if (_state.load(std::memory_order_acquire) != STATE_RUNNING)
+        return false;
+    _path = filePrefix + "_" + std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()) + ".folded";
+#if (TARGET_PLATFORM != PLATFORM_WIN32)
+    setProfileTimer(0);
+#endif
+    g_samplesPerSecond.store(0, std::memory_order_relaxed);
+    _state.store(STATE_STOPPING, std::memory_order_release);
+    return true;
+}
+
+bool SamplingProfiler::isRunning()const
+{
+    return _state.load(std::memory_order_acquire) == STATE_RUNNING;
+}
+
+SamplingProfilerStats SamplingProfiler::getStats()const
+{
+    SamplingProfilerStats stats;
+    stats.samplesPerSecond = g_samplesPerSecond.load(std::memory_order_relaxed);
+    stats.samples = g_samples.load(std::memory_order_relaxed);
+    stats.dropped = g_dropped.load(std::memory_order_relaxed);
+    stats.stacks = g_stacks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SamplingProfiler::collect(uint32 samplesPerSecond)
+{
+    StackCounts counts;
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    uint32 interval = 1000 / samplesPerSecond;
+    timeBeginPeriod(1);
+    std::vector<SampledThread> threads;
+    auto lastRefresh = std::chrono::steady_clock::now();
+    auto lastDrain = lastRefresh;
+    refreshThreads(threads);
+    while (_state.load(std::memory_order_acquire) == STATE_RUNNING)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRefresh >= std::chrono::seconds(1))
+        {
+            refreshThreads(threads);
+            lastRefresh = now;
+        }
+        for (auto& thread : threads)
+        {
+            ULONG64 cycles = 0;
+            if (!QueryThreadCycleTime(thread.handle, &cycles) || cycles == thread.cycles)
+                continue;
+            thread.cycles = cycles;
+            StackSample sample;
+            if (captureStack(thread.handle, sample))
+                pushSample(sample);
+        }
+        if (now - lastDrain >= std::chrono::milliseconds(DRAIN_INTERVAL_MS))
+        {
+            drain(counts);
+            lastDrain = now;
+        }
+        Sleep(interval > 0 ? interval : 1);
+    }
+    for (auto& thread : threads)
+        CloseHandle(thread.handle);
+    timeEndPeriod(1);
+#else
+    // ITIMER_PROF was armed with the rate by start().
+    UNUSED_ARG(samplesPerSecond);
+    // The collector is not what the profile is about.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    while (_state.load(std::memory_order_acquire) == STATE_RUNNING)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+        drain(counts);
+    }
+#endif
+    drain(counts);
+
+    if (_state.load(std::memory_order_acquire) == STATE_STOPPING)
+    {
+        if (writeFoldedStacks(_path, counts))
+        {
+            LOG_INFO(">>Samples written to %s: samples[%llu] dropped[%llu] stacks[%u]", _path.c_str()
+                , g_samples.load(std::memory_order_relaxed), g_dropped.load(std::memory_order_relaxed), (uint32)counts.size());
+        }
+        else
+        {
+            LOG_ERROR("***** Cannot write samples %s", _path.c_str());
+        }
+    }
+    _state.store(STATE_IDLE, std::memory_order_release);
+}
+
+NS_FK_END
@@ -0,0 +1,100 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_SAMPLINGPROFILER_H
+#define LOSEMYMIND_SAMPLINGPROFILER_H
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Foundation/Singleton.h"
+
+NS_FK_BEGIN
+
+struct SamplingProfilerStats
+{
+    uint32 samplesPerSecond; // 0 while not running.
+    uint64 samples;          // Stacks captured by the current or last run.
+    uint64 dropped;          // Lost because the collector fell behind.
+    uint32 stacks;           // Distinct stacks among the samples collected so far.
+};
+
+/**
+ * Statistical CPU profiler that needs no external tool attached.
+ *
+ * While running, the stack of every thread that is using the CPU is
+ * captured about samplesPerSecond times a second and pushed into a lock
+ * free ring. A collector thread drains the ring every few milliseconds and
+ * counts identical stacks; stop() has it write them as folded stacks, one
+ * "root;caller;...;leaf count" line per stack, which flamegraph.pl and
+ * speedscope read directly.
+ *
+ * Windows: the collector wakes every 1000/samplesPerSecond ms and, for each
+ * thread of the process that used cycles since the last tick, suspends it,
+ * walks its stack and resumes it. x86 follows the frame pointer chain, so
+ * functions built with frame pointer omission are missing from the stacks;
+ * nothing that may take a lock runs while a thread is suspended. x64 uses
+ * the unwind tables, and RtlLookupFunctionEntry takes the loader's dynamic
+ * function table lock when it looks outside the loaded images: a thread
+ * suspended while holding that lock (registering JIT code, loading a DLL)
+ * deadlocks the collector. Known risk of x64 builds, the server registers
+ * no dynamic function tables itself. The Windows overhead has not been
+ * measured yet.
+ *
+ * POSIX: ITIMER_PROF sends SIGPROF to the running thread for every
+ * 1/samplesPerSecond second of CPU the process uses, the handler unwinds
+ * with _Unwind_Backtrace. Blocking system calls may return EINTR more often
+ * while sampling. Functions of the executable only get names when it is
+ * linked with -rdynamic, other frames are written as module+offset for
+ * addr2line.
+ *
+ * The rate is capped at MAX_SAMPLES_PER_SECOND; the 1ms timer resolution on
+ * Windows and the kernel tick on Linux do not allow more.
+ *
+ * Sample usage:
+ *
+ *     SamplingProfiler::getInstance()->start(1000);
+ *     ...
+ *     SamplingProfiler::getInstance()->stop();   // samples_<time>.folded
+ */
+class SamplingProfiler : public Singleton<SamplingProfiler>
+{
+    friend class Singleton<SamplingProfiler>;
+    SamplingProfiler();
+public:
+    static const uint32 MAX_STACK_DEPTH = 64;
+    static const uint32 MAX_SAMPLES_PER_SECOND = 1000;
+
+    /** Stops a running profile without writing it. */
+    ~SamplingProfiler();
+
+    /** Returns false if already running or still writing the last profile. */
+    bool start(uint32 samplesPerSecond = MAX_SAMPLES_PER_SECOND);
+
+    /**
+     * Stops sampling and has the collector write filePrefix_<time>.folded.
+     * Returns false if not running.
+     */
+    bool stop(const std::string& filePrefix = "samples");
+
+    bool isRunning()const;
+
+    SamplingProfilerStats getStats()const;
+
+private:
+    void collect(uint32 samplesPerSecond);
+
+    std::atomic<uint32> _state;
+    std::string         _path;      // Set by stop() before the state changes.
+    std::thread         _collector;
+};
+
+NS_FK_END
+#endif // LOSEMYMIND_SAMPLINGPROFILER_H
@@ -0,0 +1,542 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include "TaskScheduler.h"
+#include "FrameProfiler.h"
+#include "Logger.h"
+
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+#include <Windows.h>
+#elif (TARGET_PLATFORM == PLATFORM_LINUX) || (TARGET_PLATFORM == PLATFORM_ANDROID)
+#include <sched.h>
+#endif
+
+NS_FK_BEGIN
+
+namespace
+{
+    /**
+     * Chase-Lev work stealing deque, with the memory orders of
+     * "Correct and Efficient Work-Stealing for Weak Memory Models"
+     * (Le, Pop, Cohen, Zappa Nardelli, 2013).
+     *
+     * The owner pushes and pops at the bottom, thieves take from the top.
+     * Arrays replaced by a larger one are kept until the deque is destroyed,
+     * a thief may still be reading from them.
+     */
+    class WorkStealingQueue
+    {
+    public:
+        WorkStealingQueue()
+            : _top(0)
+            , _bottom(0)
+            , _array(new Array(1024))
+        {
+        }
+
+        ~WorkStealingQueue()
+        {
+            delete _array.load(std::memory_order_relaxed);
+            for (Array* array : _retired)
+                delete array;
+        }
+
+        // Owner only.
+        void push(Task* task)
+        {
+            int64 bottom = _bottom.load(std::memory_order_relaxed);
+            int64 top = _top.load(std::memory_order_acquire);
+            Array* array = _array.load(std::memory_order_relaxed);
+            if (bottom - top > array->mask)
+                array = grow(array, top, bottom);
+            array->put(bottom, task);
+            // Release store rather than fence + relaxed store, same code on
+            // x86 and visible to thread sanitizers.
+            _bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        // Owner only, LIFO so the most recently split work stays hot in cache.
+        Task* pop()
+        {
+            int64 bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            Array* array = _array.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64 top = _top.load(std::memory_order_relaxed);
+            if (top > bottom)
+            {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task* task = array->get(bottom);
+            if (top == bottom)
+            {
+                // Last element, race the thieves for it.
+                if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    task = nullptr;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        // Any thread, FIFO.
+        Task* steal()
+        {
+            int64 top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64 bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+                return nullptr;
+            Array* array = _array.load(std::memory_order_acquire);
+            Task* task = array->get(top);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return task;
+        }
+
+        bool empty()const
+        {
+            return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Array
+        {
+            explicit Array(int64 capacity)
+                : mask(capacity - 1)
+                , slots(new std::atomic<Task*>[(size_t)capacity])
+            {
+            }
+
+            ~Array()
+            {
+                delete[] slots;
+            }
+
+            Task* get(int64 index)const{ return slots[index & mask].load(std::memory_order_relaxed); }
+            void  put(int64 index, Task* task){ slots[index & mask].store(task, std::memory_order_relaxed); }
+
+            int64               mask;
+            std::atomic<Task*>* slots;
+        };
+
+        Array* grow(Array* array, int64 top, int64 bottom)
+        {
+            Array* larger = new Array((array->mask + 1) * 2);
+            for (int64 i = top; i < bottom; ++i)
+                larger->put(i, array->get(i));
+            _retired.push_back(array);
+            _array.store(larger, std::memory_order_release);
+            return larger;
+        }
+
+        // top is written by thieves, bottom by the owner: keep them on separate lines.
+        std::atomic<int64>  _top;
+        char                _padding0[64 - sizeof(std::atomic<int64>)];
+        std::atomic<int64>  _bottom;
+        char                _padding1[64 - sizeof(std::atomic<int64>)];
+        std::atomic<Array*> _array;
+        std::vector<Array*> _retired;
+    };
+
+    // Worker identity of the calling thread.
+    THREAD_LOCAL TaskScheduler* t_scheduler = nullptr;
+    THREAD_LOCAL int32          t_workerIndex = -1;
+
+    // Busy polls before a worker goes to sleep.
+    const uint32 SPIN_COUNT = 64;
+
+    // Bits of TaskGroup::_pending: the high bit marks queued continuations.
+    const uint32 CONTINUATION_FLAG = 0x80000000u;
+}
+
+struct TaskScheduler::Worker
+{
+    Worker() : random(0), executed(0), stolen(0){}
+
+    WorkStealingQueue   queue;
+    std::thread         thread;
+    uint32              random;
+    // Written by the worker only, read by getStats().
+    std::atomic<uint64> executed;
+    std::atomic<uint64> stolen;
+};
+
+TaskScheduler::TaskScheduler()
+    : _pinWorkers(false)
+    , _running(false)
+    , _stopping(false)
+    , _injectedCount(0)
+    , _injectedTotal(0)
+    , _externalExecuted(0)
+    , _sleepers(0)
+    , _wakeEpoch(0)
+{
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    stop();
+}
+
+void TaskScheduler::start(uint32 workerCount, bool pinWorkers)
+{
+    if (isRunning())
+        return;
+    if (workerCount == 0)
+    {
+        uint32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+    _pinWorkers = pinWorkers;
+    _stopping.store(false, std::memory_order_relaxed);
+    for (uint32 i = 0; i < workerCount; ++i)
+    {
+        Worker* worker = new Worker();
+        worker->random = i * 2654435761u + 1;
+        _workers.push_back(worker);
+    }
+    // Every worker must exist before any of them starts stealing.
+    for (uint32 i = 0; i < workerCount; ++i)
+    {
+        _workers[i]->thread = std::thread(std::bind(&TaskScheduler::workerLoop, this, i));
+    }
+    _running.store(true, std::memory_order_release);
+}
+
+void TaskScheduler::stop()
+{
+    if (!isRunning())
+        return;
+    _stopping.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        ++_wakeEpoch;
+    }
+    _sleepCondition.notify_all();
+    for (Worker* worker : _workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+    _running.store(false, std::memory_order_release);
+    for (Worker* worker : _workers)
+        delete worker;
+    _workers.clear();
+    // Tasks submitted while the workers were exiting.
+    while (runPendingTask())
+    {
+    }
+}
+
+int32 TaskScheduler::getCurrentWorkerIndex()
+{
+    return t_workerIndex;
+}
+
+void TaskScheduler::submit(std::function<void()> function)
+{
+    Task* task = new Task();
+    task->function = std::move(function);
+    task->group = nullptr;
+    schedule(task);
+}
+
+bool TaskScheduler::runPendingTask()
+{
+    Worker* self = (t_scheduler == this && t_workerIndex >= 0) ? _workers[t_workerIndex] : nullptr;
+    Task* task = findTask(self);
+    if (task == nullptr)
+        return false;
+    execute(task);
+    return true;
+}
+
+TaskSchedulerStats TaskScheduler::getStats()const
+{
+    TaskSchedulerStats stats;
+    stats.workerCount = getWorkerCount();
+    stats.executed = _externalExecuted.load(std::memory_order_relaxed);
+    stats.stolen = 0;
+    stats.injected = _injectedTotal.load(std::memory_order_relaxed);
+    for (Worker* worker : _workers)
+    {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void TaskScheduler::schedule(Task* task)
+{
+    if (t_scheduler == this && t_workerIndex >= 0)
+    {
+        _workers[t_workerIndex]->queue.push(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_injectMutex);
+        _injected.push_back(task);
+        _injectedCount.fetch_add(1, std::memory_order_release);
+        _injectedTotal.fetch_add(1, std::memory_order_relaxed);
+    }
+    wakeWorker();
+}
+
+Task* TaskScheduler::findTask(Worker* self)
+{
+    if (self != nullptr)
+    {
+        Task* task = self->queue.pop();
+        if (task != nullptr)
+            return task;
+    }
+
+    Task* task = popInjected();
+    if (task != nullptr)
+        return task;
+
+    size_t count = _workers.size();
+    if (count == 0)
+        return nullptr;
+    // Random start so thieves do not all hit the same victim.
+    uint32 start = 0;
+    if (self != nullptr)
+    {
+        self->random ^= self->random << 13;
+        self->random ^= self->random >> 17;
+        self->random ^= self->random << 5;
+        start = self->random;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        Worker* victim = _workers[(start + i) % count];
+        if (victim == self)
+            continue;
+        task = victim->queue.steal();
+        if (task != nullptr)
+        {
+            if (self != nullptr)
+                self->stolen.store(self->stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+Task* TaskScheduler::popInjected()
+{
+    if (_injectedCount.load(std::memory_order_acquire) == 0)
+        return nullptr;
+    std::lock_guard<std::mutex> lock(_injectMutex);
+    if (_injected.empty())
+        return nullptr;
+    Task* task = _injected.front();
+    _injected.pop_front();
+    _injectedCount.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+void TaskScheduler::execute(Task* task)
+{
+    {
+        PROFILE_SCOPE("TaskScheduler::task");
+        // An escaping exception would leak the task and leave its group
+        // pending forever, so wait() would never return.
+        try
+        {
+            task->function();
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("***** Task threw an exception: %s", e.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("***** Task threw an unknown exception.");
+        }
+    }
+    TaskGroup* group = task->group;
+    delete task;
+
+    if (t_scheduler == this && t_workerIndex >= 0)
+    {
+        Worker* self = _workers[t_workerIndex];
+        self->executed.store(self->executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    else
+    {
+        _externalExecuted.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (group != nullptr)
+        group->taskFinished();
+}
+
+void TaskScheduler::workerLoop(uint32 index)
+{
+    t_scheduler = this;
+    t_workerIndex = static_cast<int32>(index);
+    Worker* self = _workers[index];
+
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "worker %u", index);
+    FrameProfiler::setThreadName(threadName);
+
+    if (_pinWorkers)
+    {
+        // Core 0 is left to the main loop.
+        uint32 core = (index + 1) % std::thread::hardware_concurrency();
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#elif (TARGET_PLATFORM == PLATFORM_LINUX) || (TARGET_PLATFORM == PLATFORM_ANDROID)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+#endif
+    }
+
+    uint32 idle = 0;
+    for (;;)
+    {
+        Task* task = findTask(self);
+        if (task != nullptr)
+        {
+            execute(task);
+            idle = 0;
+            continue;
+        }
+        if (_stopping.load(std::memory_order_acquire))
+            break;
+        if (++idle < SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Announce the sleep before the last look at the queues, schedule()
+        // checks _sleepers after publishing its task (see wakeWorker()).
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        uint64 epoch = _wakeEpoch;
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        lock.unlock();
+        task = findTask(self);
+        lock.lock();
+        if (task == nullptr && !_stopping.load(std::memory_order_acquire))
+        {
+            // The timeout only bounds the damage of a missed wakeup.
+            _sleepCondition.wait_for(lock, std::chrono::milliseconds(10), [this, epoch]()
+            {
+                return _wakeEpoch != epoch;
+            });
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        lock.unlock();
+        if (task != nullptr)
+            execute(task);
+        idle = 0;
+    }
+
+    t_scheduler = nullptr;
+    t_workerIndex = -1;
+}
+
+void TaskScheduler::wakeWorker()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleepers.load(std::memory_order_relaxed) == 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        ++_wakeEpoch;
+    }
+    _sleepCondition.notify_one();
+}
+
+TaskGroup::TaskGroup(TaskScheduler* scheduler)
+    : _scheduler(scheduler)
+    , _pending(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> function)
+{
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    Task* task = new Task();
+    task->function = std::move(function);
+    task->group = this;
+    _scheduler->schedule(task);
+}
+
+void TaskGroup::then(std::function<void()> continuation)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _continuations.push_back(std::move(continuation));
+    uint32 previous = _pending.fetch_or(CONTINUATION_FLAG, std::memory_order_acq_rel);
+    if (previous != 0)
+        return; // Tasks are running, or the last one is already handing over.
+
+    std::vector<std::function<void()> > continuations;
+    continuations.swap(_continuations);
+    // Clears the flag and counts the continuations in one step.
+    _pending.fetch_add(static_cast<uint32>(continuations.size()) - CONTINUATION_FLAG, std::memory_order_acq_rel);
+    lock.unlock();
+    scheduleContinuations(_scheduler, this, continuations);
+}
+
+void TaskGroup::wait()
+{
+    while (_pending.load(std::memory_order_acquire) != 0)
+    {
+        if (!_scheduler->runPendingTask())
+            std::this_thread::yield();
+    }
+}
+
+bool TaskGroup::isDone()const
+{
+    return _pending.load(std::memory_order_acquire) == 0;
+}
+
+void TaskGroup::scheduleContinuations(TaskScheduler* scheduler, TaskGroup* group, std::vector<std::function<void()> >& continuations)
+{
+    // The group is not touched here: once a continuation finishes the
+    // group may be gone while the others are still being scheduled.
+    for (auto& function : continuations)
+    {
+        Task* task = new Task();
+        task->function = std::move(function);
+        task->group = group;
+        scheduler->schedule(task);
+    }
+}
+
+void TaskGroup::taskFinished()
+{
+    uint32 previous = _pending.fetch_sub(1, std::memory_order_acq_rel);
+    // Without continuations the decrement is the last access, a waiter may
+    // destroy the group right after it.
+    if (previous != (CONTINUATION_FLAG | 1))
+        return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    TaskScheduler* scheduler = _scheduler;
+    std::vector<std::function<void()> > continuations;
+    continuations.swap(_continuations);
+    _pending.fetch_add(static_cast<uint32>(continuations.size()) - CONTINUATION_FLAG, std::memory_order_acq_rel);
+    lock.unlock();
+    scheduleContinuations(scheduler, this, continuations);
+}
+
+NS_FK_END
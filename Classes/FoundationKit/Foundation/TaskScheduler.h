@@ -0,0 +1,202 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+#ifndef LOSEMYMIND_TASKSCHEDULER_H
+#define LOSEMYMIND_TASKSCHEDULER_H
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/noncopyable.hpp"
+#include "Singleton.h"
+
+NS_FK_BEGIN
+
+class TaskGroup;
+
+/** A unit of work, owned by the scheduler between submit and completion. */
+struct Task
+{
+    std::function<void()> function;
+    TaskGroup*            group;
+};
+
+struct TaskSchedulerStats
+{
+    uint32 workerCount;
+    uint64 executed;   // Tasks run by workers and by helping threads.
+    uint64 stolen;     // Tasks a worker took from another worker's deque.
+    uint64 injected;   // Tasks submitted from threads that are not workers.
+};
+
+/**
+ * Work stealing thread pool.
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops its own tasks at
+ * the bottom without locks, idle workers steal from the top of a random
+ * victim. Tasks submitted from other threads (the main loop, the listener)
+ * go through a shared injection queue. Workers sleep on a condition
+ * variable after a short spin when there is nothing to run.
+ *
+ * A thread that waits on a TaskGroup runs pending tasks meanwhile, so
+ * waiting from inside a task does not deadlock and a scheduler without
+ * workers still completes everything on the waiting thread.
+ *
+ * An exception that escapes a task is logged and the task counts as
+ * finished; it is not rethrown from wait().
+ *
+ * Sample usage:
+ *
+ *     TaskScheduler::getInstance()->start();
+ *     TaskGroup group;
+ *     group.run([]{ loadFile("a"); });
+ *     group.run([]{ loadFile("b"); });
+ *     group.then([]{ LOG_INFO("files loaded"); });
+ *     group.wait();
+ *
+ *     parallel_for(0, items.size(), 256, [&](size_t i){ hash(items[i]); });
+ */
+class TaskScheduler : public Singleton<TaskScheduler>
+{
+    friend class Singleton < TaskScheduler >;
+    friend class TaskGroup;
+    TaskScheduler();
+public:
+    ~TaskScheduler();
+
+    /**
+     * Starts the workers, does nothing if already running.
+     *
+     * @param workerCount  Number of worker threads, 0 means one less than the
+     *                     hardware threads, leaving a core for the main loop.
+     * @param pinWorkers   Pins worker i to core i + 1 so caches stay warm.
+     *                     Not supported on Mac and iOS, ignored there.
+     */
+    void start(uint32 workerCount = 0, bool pinWorkers = false);
+
+    /** Runs the tasks still queued, then joins the workers. */
+    void stop();
+
+    bool   isRunning()const{ return _running.load(std::memory_order_acquire); }
+    uint32 getWorkerCount()const{ return static_cast<uint32>(_workers.size()); }
+
+    /** Index of the calling worker, or -1 when called from another thread. */
+    static int32 getCurrentWorkerIndex();
+
+    /** Queues a function that is not part of any group. */
+    void submit(std::function<void()> function);
+
+    /** Runs one pending task on the calling thread, returns false if none was found. */
+    bool runPendingTask();
+
+    TaskSchedulerStats getStats()const;
+
+private:
+    struct Worker;
+
+    void   schedule(Task* task);
+    Task*  findTask(Worker* self);
+    Task*  popInjected();
+    void   execute(Task* task);
+    void   workerLoop(uint32 index);
+    void   wakeWorker();
+
+    std::vector<Worker*>     _workers;
+    bool                     _pinWorkers;
+    std::atomic<bool>        _running;
+    std::atomic<bool>        _stopping;
+    std::mutex               _injectMutex;
+    std::deque<Task*>        _injected;
+    std::atomic<uint32>      _injectedCount;
+    std::atomic<uint64>      _injectedTotal;
+    std::atomic<uint64>      _externalExecuted;
+    std::mutex               _sleepMutex;
+    std::condition_variable  _sleepCondition;
+    std::atomic<uint32>      _sleepers;
+    uint64                   _wakeEpoch;
+};
+
+/**
+ * Set of tasks that can be waited on together.
+ *
+ * Continuations added with then() are submitted when every task of the
+ * group has finished, and count as tasks of the group themselves, so
+ * wait() also waits for them. A group must outlive its tasks; the
+ * destructor waits.
+ */
+class TaskGroup : noncopyable
+{
+public:
+    explicit TaskGroup(TaskScheduler* scheduler = TaskScheduler::getInstance());
+    ~TaskGroup();
+
+    void run(std::function<void()> function);
+
+    /** Runs continuation once the tasks submitted so far are done. */
+    void then(std::function<void()> continuation);
+
+    /** Blocks until every task and continuation has run, executing pending tasks meanwhile. */
+    void wait();
+
+    bool isDone()const;
+
+private:
+    friend class TaskScheduler;
+    void taskFinished();
+    static void scheduleContinuations(TaskScheduler* scheduler, TaskGroup* group, std::vector<std::function<void()> >& continuations);
+
+    TaskScheduler*                      _scheduler;
+    std::atomic<uint32>                 _pending;
+    mutable std::mutex                  _mutex;
+    std::vector<std::function<void()> > _continuations;
+};
+
+namespace detail
+{
+    template<typename Function>
+    void parallel_for_split(TaskGroup& group, size_t first, size_t last, size_t grainSize, const Function& function)
+    {
+        while (last - first > grainSize)
+        {
+            size_t middle = first + (last - first) / 2;
+            group.run([&group, middle, last, grainSize, &function]()
+            {
+                parallel_for_split(group, middle, last, grainSize, function);
+            });
+            last = middle;
+        }
+        for (size_t i = first; i < last; ++i)
+            function(i);
+    }
+}
+
+/**
+ * Calls function(i) for every i in [begin, end) on the scheduler.
+ *
+ * The range is split in halves until a piece is at most grainSize long, so
+ * idle workers steal large pieces first. Pick grainSize so one piece takes
+ * at least a few microseconds, otherwise scheduling costs dominate.
+ */
+template<typename Function>
+void parallel_for(size_t begin, size_t end, size_t grainSize, const Function& function, TaskScheduler* scheduler = TaskScheduler::getInstance())
+{
+    if (begin >= end)
+        return;
+    TaskGroup group(scheduler);
+    detail::parallel_for_split(group, begin, end, grainSize > 0 ? grainSize : 1, function);
+    group.wait();
+}
+
+NS_FK_END
+#endif // LOSEMYMIND_TASKSCHEDULER_H
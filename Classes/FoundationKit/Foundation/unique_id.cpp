@@ -1,9 +1,109 @@
-
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
 #include "unique_id.hpp"
+#include "FoundationKit/Platform/Platform.h"
 NS_FK_BEGIN
-uint64_t unique_id::sequence = 0;
-uint64_t unique_id::machineid = 0;
 
-NS_FK_END
+namespace
+{
+    const uint32 SEQUENCE_COUNT = 1u << unique_id::SEQUENCE_BITS;
+    const uint64 TIMESTAMP_MASK = (1ULL << unique_id::TIMESTAMP_BITS) - 1;
+    const uint32 MACHINE_MASK   = (1u << unique_id::MACHINE_BITS) - 1;
+
+    // Sequence numbers a thread takes at once.
+    const uint32 BLOCK_SIZE = 64;
+
+    uint32 detectMachineId()
+    {
+        std::vector<uint8> mac = Platform::getMacAddressRaw();
+        uint64 value = 0;
+        for (auto byte : mac)
+        {
+            value = (value << 8) | byte;
+        }
+        if (value == 0)
+        {
+            // No network adapter, a random id is better than a shared one.
+            std::random_device device;
+            value = device();
+        }
+        return static_cast<uint32>(value & MACHINE_MASK);
+    }
+
+    // Initialized before main(), so create() never pays for the lookup.
+    std::atomic<uint32> g_machineId(detectMachineId());
+
+    // Last handed out block: milliseconds << 13 | next free sequence (0..4096).
+    std::atomic<uint64> g_state(0);
+
+    THREAD_LOCAL uint64 t_blockTime = 0;
+    THREAD_LOCAL uint32 t_blockNext = 0;
+    THREAD_LOCAL uint32 t_blockEnd  = 0;
 
+    uint64 currentMilliseconds()
+    {
+        using namespace std::chrono;
+        int64 now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        return now > (int64)unique_id::EPOCH ? (now - unique_id::EPOCH) & TIMESTAMP_MASK : 0;
+    }
 
+    void claimBlock(uint64 now)
+    {
+        uint64 state = g_state.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            uint64 last = state >> (unique_id::SEQUENCE_BITS + 1);
+            uint32 next = static_cast<uint32>(state & ((SEQUENCE_COUNT << 1) - 1));
+            uint64 time = last;
+            uint32 begin = next;
+            if (now > last)
+            {
+                time = now;
+                begin = 0;
+            }
+            else if (next + BLOCK_SIZE > SEQUENCE_COUNT)
+            {
+                // Same millisecond (or the clock went back) and nothing left.
+                time = last + 1;
+                begin = 0;
+            }
+
+            uint64 desired = (time << (unique_id::SEQUENCE_BITS + 1)) | (begin + BLOCK_SIZE);
+            if (g_state.compare_exchange_weak(state, desired, std::memory_order_relaxed))
+            {
+                t_blockTime = time;
+                t_blockNext = begin;
+                t_blockEnd  = begin + BLOCK_SIZE;
+                return;
+            }
+        }
+    }
+}
+
+uint64 unique_id::create()
+{
+    // A block stays valid until the clock passes its millisecond, so ids
+    // keep following the wall clock under light load.
+    uint64 now = currentMilliseconds();
+    if (t_blockNext == t_blockEnd || now > t_blockTime)
+        claimBlock(now);
+
+    uint64 uniqueid = t_blockTime << (SEQUENCE_BITS + MACHINE_BITS);
+    uniqueid |= (uint64)g_machineId.load(std::memory_order_relaxed) << SEQUENCE_BITS;
+    uniqueid |= t_blockNext++;
+    return uniqueid;
+}
+
+void unique_id::setMachineId(uint32 machineid)
+{
+    g_machineId.store(machineid & MACHINE_MASK, std::memory_order_relaxed);
+}
+
+uint32 unique_id::getMachineId()
+{
+    return g_machineId.load(std::memory_order_relaxed);
+}
+
+NS_FK_END
@@ -1,52 +1,45 @@
-
 #pragma once
-#include <chrono>
-#include <sstream>
-#include <iomanip>
-#include <type_traits>
 #include "FoundationKit/Base/Types.h"
-#include "FoundationKit/Platform/Platform.h"
 
 NS_FK_BEGIN
 
 const uint64 INVALID_UNIQUE_ID = -1;
-static const  uint64_t sequence_max = (std::numeric_limits<uint64_t>::max)();
+
+/**
+ * 63 bit time ordered ids, laid out as
+ *
+ *     | 41 bits milliseconds since 2016-01-01 | 10 bits machine | 12 bits sequence |
+ *
+ * create() is lock free and thread safe. Every thread takes a block of
+ * sequence numbers of the current millisecond from a shared atomic and
+ * hands them out without touching shared state again, so threads only meet
+ * once per block. The timestamp never goes backwards: if the system clock
+ * is set back, ids keep the last millisecond handed out, and a millisecond
+ * whose 4096 sequence numbers are used up borrows the next one. Above
+ * 4096 ids per millisecond the timestamps therefore run ahead of the clock,
+ * they fall back in step once the load drops.
+ *
+ * The machine id is taken from the MAC address before main() runs. Call
+ * setMachineId() at startup to pick it explicitly.
+ */
 struct unique_id
 {
-    static uint64_t sequence;
-    static uint64_t machineid;
-    static uint64 create()
-    {
-        int64 uniqueid = 0;
-        int64 timestamp = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-
-        if (machineid == 0)
-        {
-            std::vector<uint8> machineid_arr = Platform::getMacAddressRaw();
-            std::stringstream ss;
-            ss << std::hex << std::setfill('0');
-
-            for (unsigned i = 0; i < 6; ++i)
-                ss << std::setw(2) << int(machineid_arr[i]);
+    static const uint32 SEQUENCE_BITS  = 12;
+    static const uint32 MACHINE_BITS   = 10;
+    static const uint32 TIMESTAMP_BITS = 41;
+    static const uint64 EPOCH          = 1451606400000ULL; // 2016-01-01 00:00:00 UTC in milliseconds.
 
-            ss >> machineid;
+    static uint64 create();
 
-            if (machineid == 0)
-                return INVALID_UNIQUE_ID;
-        }
+    /** Only the low MACHINE_BITS bits are used. */
+    static void   setMachineId(uint32 machineid);
+    static uint32 getMachineId();
 
-        uniqueid  = timestamp << 22;
-        uniqueid |= (machineid & 0x3FF) << 12;
-        uniqueid |= sequence++ & 0xFFF;
-        if (sequence == sequence_max)
-        {
-            sequence = 0;
-        }
-        return uniqueid;
+    /** Milliseconds since 1970-01-01 UTC at which id was created. */
+    static uint64 getTimestamp(uint64 id)
+    {
+        return (id >> (SEQUENCE_BITS + MACHINE_BITS)) + EPOCH;
     }
 };
 
-
-
 NS_FK_END
-
@@ -259,7 +259,8 @@ Data FileUtils::readDataFromZip(const std::string& zipFilePath, const std::strin
 
         ret = unzOpenCurrentFile(file);
         BREAK_IF(UNZ_OK != ret);
-        unsigned char * buffer = (unsigned char*)malloc(fileInfo.uncompressed_size);
+        // Data releases owned buffers with delete[].
+        unsigned char * buffer = new unsigned char[fileInfo.uncompressed_size];
         int readedSize = unzReadCurrentFile(file, buffer, static_cast<unsigned>(fileInfo.uncompressed_size));
         LOG_ASSERT(readedSize == 0 || readedSize == (int)fileInfo.uncompressed_size, "the file size is wrong");
         UNUSED_ARG(readedSize);
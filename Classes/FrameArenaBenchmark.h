@@ -0,0 +1,134 @@
+#ifndef LOSEMYMIND_FRAMEARENABENCHMARK_H
+#define LOSEMYMIND_FRAMEARENABENCHMARK_H
+
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "FoundationKit/Base/DataStream.h"
+#include "FoundationKit/Base/FrameArena.h"
+
+USING_NS_FK;
+
+/** std::allocator that counts the blocks it hands out. */
+template<typename T>
+struct CountingAllocator : std::allocator<T>
+{
+    template<typename U> struct rebind { typedef CountingAllocator<U> other; };
+
+    CountingAllocator(uint64* inCount) :count(inCount){}
+    template<typename U> CountingAllocator(const CountingAllocator<U>& other) :count(other.count){}
+
+    T* allocate(size_t n)
+    {
+        ++*count;
+        return std::allocator<T>::allocate(n);
+    }
+
+    uint64* count;
+};
+
+template<typename T, typename U>
+inline bool operator==(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs){ return lhs.count == rhs.count; }
+template<typename T, typename U>
+inline bool operator!=(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs){ return lhs.count != rhs.count; }
+
+/**
+ * Reproduces the receive loop of ConnectionManager::update for clientCount
+ * clients with one datagram of datagramSize bytes each, the way it was
+ * before the frame arena and the way it is now:
+ *
+ *   heap   copy of the client map, a vector per datagram, a DataStream per client
+ *   frame  FrameVector snapshot, one shared receive buffer, one shared DataStream
+ *
+ * Prints heap allocations per tick (containers and DataStream buffers),
+ * arena bytes per tick and the time per tick. Arena blocks are counted as
+ * heap allocations too; after the first tick there are none.
+ */
+void BenchmarkFrameArenaTick(uint32 clientCount = 1000, uint32 ticks = 1000, uint32 datagramSize = 64)
+{
+    typedef std::chrono::steady_clock clock;
+    std::unordered_map<uint64, std::vector<uint8> > clients;
+    for (uint32 i = 0; i < clientCount; ++i)
+    {
+        clients[i + 1].assign(datagramSize, (uint8)i);
+    }
+
+    uint64 heapAllocations = 0;
+    uint64 checksum = 0;
+    clock::time_point start = clock::now();
+    for (uint32 tick = 0; tick < ticks; ++tick)
+    {
+        typedef std::pair<uint64, const std::vector<uint8>*> ClientEntry;
+        std::vector<ClientEntry, CountingAllocator<ClientEntry> > tempClients((CountingAllocator<ClientEntry>(&heapAllocations)));
+        for (auto& client : clients)
+        {
+            tempClients.push_back(ClientEntry(client.first, &client.second));
+        }
+        for (auto& client : tempClients)
+        {
+            std::vector<uint8, CountingAllocator<uint8> > datagram(client.second->size(), 0, CountingAllocator<uint8>(&heapAllocations));
+            memcpy(datagram.data(), client.second->data(), datagram.size());
+            DataStream dataStream;
+            size_t capacity = dataStream.getBuffer().capacity();
+            dataStream.reset(datagram.data(), (DataStream::size_type)datagram.size());
+            if (dataStream.getBuffer().capacity() != capacity)
+                ++heapAllocations;
+            checksum += dataStream.getBuffer()[0];
+        }
+    }
+    double heapSeconds = std::chrono::duration<double>(clock::now() - start).count();
+    double heapAllocationsPerTick = (double)heapAllocations / ticks;
+
+    FrameArena arena;
+    std::vector<uint8> receiveBuffer;
+    DataStream dataStream;
+    heapAllocations = 0;
+    size_t arenaBytes = 0;
+    start = clock::now();
+    for (uint32 tick = 0; tick < ticks; ++tick)
+    {
+        typedef std::pair<uint64, const std::vector<uint8>*> ClientEntry;
+        FrameVector<ClientEntry> tempClients((FrameAllocator<ClientEntry>(arena)));
+        tempClients.reserve(clients.size());
+        for (auto& client : clients)
+        {
+            tempClients.push_back(ClientEntry(client.first, &client.second));
+        }
+        for (auto& client : tempClients)
+        {
+            size_t size = client.second->size();
+            if (receiveBuffer.size() < size)
+            {
+                receiveBuffer.resize(size);
+                ++heapAllocations;
+            }
+            memcpy(receiveBuffer.data(), client.second->data(), size);
+            size_t capacity = dataStream.getBuffer().capacity();
+            dataStream.reset(receiveBuffer.data(), (DataStream::size_type)size);
+            if (dataStream.getBuffer().capacity() != capacity)
+                ++heapAllocations;
+            checksum += dataStream.getBuffer()[0];
+        }
+        heapAllocations += arena.getBlockAllocationCount();
+        arenaBytes = arena.getUsedBytes();
+        arena.reset();
+    }
+    double frameSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    printf("BenchmarkFrameArenaTick: %u clients, heap %.1f allocations %.0fus per tick, frame %.3f allocations %u arena bytes %.0fus per tick, checksum %llu\n"
+        , clientCount
+        , heapAllocationsPerTick, heapSeconds * 1e6 / ticks
+        , (double)heapAllocations / ticks, (uint32)arenaBytes, frameSeconds * 1e6 / ticks
+        , checksum);
+}
+
+
+#endif // LOSEMYMIND_FRAMEARENABENCHMARK_H
@@ -0,0 +1,123 @@
+#ifndef LOSEMYMIND_HUGEPAGEBENCHMARK_H
+#define LOSEMYMIND_HUGEPAGEBENCHMARK_H
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "FoundationKit/Base/SlabAllocator.h"
+
+#if (TARGET_PLATFORM == PLATFORM_LINUX)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+USING_NS_FK;
+
+/**
+ * Compares scanning connection records kept in normal and in huge page
+ * backed slabs.
+ *
+ * recordCount records of recordSize bytes are allocated from a SlabAllocator
+ * and visited in random order, the way a hash table of connections is
+ * walked. Prints the time per record and, on Linux where perf events are
+ * allowed, dTLB load misses per record.
+ */
+void BenchmarkHugePageScan(uint32 recordCount = 500000, uint32 recordSize = 256, uint32 passes = 10)
+{
+    struct TlbCounter
+    {
+        int fd;
+        TlbCounter() :fd(-1)
+        {
+#if (TARGET_PLATFORM == PLATFORM_LINUX)
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+        }
+        ~TlbCounter()
+        {
+#if (TARGET_PLATFORM == PLATFORM_LINUX)
+            if (fd >= 0)
+                close(fd);
+#endif
+        }
+        void start()
+        {
+#if (TARGET_PLATFORM == PLATFORM_LINUX)
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+        int64 stop()
+        {
+            int64 count = -1;
+#if (TARGET_PLATFORM == PLATFORM_LINUX)
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fd, &count, sizeof(count)) != sizeof(count))
+                    count = -1;
+            }
+#endif
+            return count;
+        }
+    };
+
+    for (int huge = 0; huge < 2; ++huge)
+    {
+        SlabAllocator slab(huge ? "HugePageScan" : "NormalPageScan", recordSize, SlabAllocator::MAX_ALIGNMENT
+            , huge ? PageAllocator::HUGE_PAGE_SIZE : SlabAllocator::DEFAULT_SLAB_SIZE, huge != 0);
+        std::vector<uint64*> records(recordCount);
+        for (auto& record : records)
+        {
+            record = static_cast<uint64*>(slab.allocate());
+            memset(record, 1, recordSize);
+        }
+        std::shuffle(records.begin(), records.end(), std::mt19937(1));
+
+        TlbCounter counter;
+        uint64 sum = 0;
+        counter.start();
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32 pass = 0; pass < passes; ++pass)
+        {
+            for (auto record : records)
+            {
+                sum += record[0];
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        int64 misses = counter.stop();
+
+        SlabStats stats = slab.getStats();
+        double visits = (double)recordCount * passes;
+        printf("BenchmarkHugePageScan[%s]: %u records, %u/%u huge page slabs, %.2fns per record, dTLB misses per record %s%.3f (sum %llu)\n"
+            , huge ? "huge" : "normal", recordCount, (uint32)stats.hugePageSlabs, (uint32)stats.slabCount
+            , seconds * 1e9 / visits, misses < 0 ? "n/a " : "", misses < 0 ? 0.0 : misses / visits, sum);
+
+        for (auto record : records)
+        {
+            slab.deallocate(record);
+        }
+    }
+}
+
+
+#endif // LOSEMYMIND_HUGEPAGEBENCHMARK_H
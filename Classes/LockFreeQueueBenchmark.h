@@ -0,0 +1,127 @@
+#ifndef LOSEMYMIND_LOCKFREEQUEUEBENCHMARK_H
+#define LOSEMYMIND_LOCKFREEQUEUEBENCHMARK_H
+
+
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FoundationKit/Base/LockFreeQueue.h"
+
+USING_NS_FK;
+
+// The pattern VIServer used for _commandList: producers lock and append,
+// the consumer swaps the whole list out under the lock.
+class BenchmarkMutexListQueue
+{
+public:
+    typedef uint64 value_type;
+
+    bool push(uint64 value)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _list.push_back(value);
+        return true;
+    }
+
+    bool tryPop(uint64& value)
+    {
+        if (_local.empty())
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _local.swap(_list);
+        }
+        if (_local.empty())
+            return false;
+        value = _local.front();
+        _local.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex        _mutex;
+    std::list<uint64> _list;
+    std::list<uint64> _local;
+};
+
+// Many producers, one consumer; returns million values per second.
+template<typename Queue>
+static double BenchmarkQueueRun(Queue& queue, uint32 producers, uint32 valuesPerProducer)
+{
+    typedef std::chrono::steady_clock clock;
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (uint32 p = 0; p < producers; ++p)
+    {
+        threads.push_back(std::thread([&queue, &go, valuesPerProducer]()
+        {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (uint32 i = 0; i < valuesPerProducer; ++i)
+            {
+                while (!queue.push((uint64)i))
+                    std::this_thread::yield();
+            }
+        }));
+    }
+
+    uint64 total = (uint64)producers * valuesPerProducer;
+    uint64 received = 0;
+    uint64 value = 0;
+    clock::time_point start = clock::now();
+    go.store(true, std::memory_order_release);
+    while (received < total)
+    {
+        if (queue.tryPop(value))
+            ++received;
+        else
+            std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return total / seconds / 1e6;
+}
+
+/**
+ * Contention benchmark of the lock free queues against mutex + std::list.
+ *
+ * 1 to 32 producers push into a single consumer, which is how the server
+ * uses cross thread queues (console commands, listener to main loop). The
+ * total volume is kept constant so rows are comparable. SpscQueue only
+ * takes part with one producer.
+ */
+void BenchmarkLockFreeQueues(uint32 totalValues = 4000000)
+{
+    printf("BenchmarkLockFreeQueues: %u values, million values/s\n", totalValues);
+    printf("  producers  mutex+list      MpscQueue  MpmcBounded    SpscQueue\n");
+    for (uint32 producers = 1; producers <= 32; producers *= 2)
+    {
+        uint32 perProducer = totalValues / producers;
+        BenchmarkMutexListQueue mutexList;
+        MpscQueue<uint64> mpsc;
+        MpmcBoundedQueue<uint64> mpmc(64 * 1024);
+        double mutexRate = BenchmarkQueueRun(mutexList, producers, perProducer);
+        double mpscRate = BenchmarkQueueRun(mpsc, producers, perProducer);
+        double mpmcRate = BenchmarkQueueRun(mpmc, producers, perProducer);
+        if (producers == 1)
+        {
+            SpscQueue<uint64> spsc(64 * 1024);
+            double spscRate = BenchmarkQueueRun(spsc, producers, perProducer);
+            printf("  %9u  %10.2f  %13.2f  %11.2f  %11.2f\n", producers, mutexRate, mpscRate, mpmcRate, spscRate);
+        }
+        else
+        {
+            printf("  %9u  %10.2f  %13.2f  %11.2f            -\n", producers, mutexRate, mpscRate, mpmcRate);
+        }
+    }
+}
+
+
+#endif // LOSEMYMIND_LOCKFREEQUEUEBENCHMARK_H
@@ -0,0 +1,149 @@
+#ifndef LOSEMYMIND_LOGGERBENCHMARK_H
+#define LOSEMYMIND_LOGGERBENCHMARK_H
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "FoundationKit/Foundation/Logger.h"
+
+USING_NS_FK;
+
+/**
+ * Measures producer side cost of the file sink while segments rotate.
+ *
+ * Every thread logs linesPerThread lines through LOG_INFO and times each
+ * call. segmentSize is kept small so the run crosses many rotations. The
+ * ring overflow policy is switched to Block for the run, so a backend that
+ * cannot keep up shows up as producer latency instead of dropped lines.
+ * Console output is part of the backend cost, redirect stdout to /dev/null
+ * (or NUL) to measure the file path alone.
+ */
+void BenchmarkLogFileSink(const std::string& basePath, uint32 threadCount = 4, uint32 linesPerThread = 250000, size_t segmentSize = 4 * 1024 * 1024)
+{
+    typedef std::chrono::steady_clock clock;
+    Logger* logger = Logger::getInstance();
+    if (!logger->setLogFile(basePath, segmentSize))
+    {
+        fprintf(stderr, "BenchmarkLogFileSink: cannot open %s\n", basePath.c_str());
+        return;
+    }
+    Logger::OverflowPolicy policy = logger->getOverflowPolicy();
+    logger->setOverflowPolicy(Logger::OverflowPolicy::Block);
+
+    std::vector<std::vector<uint32> > latencies(threadCount);
+    std::vector<std::thread> threads;
+    clock::time_point start = clock::now();
+    for (uint32 t = 0; t < threadCount; ++t)
+    {
+        threads.push_back(std::thread([&latencies, t, linesPerThread]()
+        {
+            std::vector<uint32>& samples = latencies[t];
+            samples.reserve(linesPerThread);
+            for (uint32 i = 0; i < linesPerThread; ++i)
+            {
+                clock::time_point begin = clock::now();
+                LOG_INFO("benchmark thread[%u] line[%u] payload[%s]", t, i, "0123456789abcdef0123456789abcdef");
+                samples.push_back((uint32)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count());
+            }
+        }));
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    logger->flush();
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::vector<uint32> all;
+    for (auto& samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    uint64 lines = (uint64)threadCount * linesPerThread;
+    printf("BenchmarkLogFileSink: %llu lines in %.3fs, %.0f lines/s, producer p50 %uns p99 %uns max %uns, dropped %llu\n"
+        , lines, seconds, lines / seconds
+        , all[all.size() / 2], all[all.size() * 99 / 100], all.back()
+        , logger->getDroppedCount());
+
+    logger->setOverflowPolicy(policy);
+    logger->setLogFile("");
+}
+
+
+/**
+ * Measures producer side cost of LOG_INFO against LOG_INFO_DEFERRED with
+ * the same arguments. Each call is timed; the cost of the two clock reads
+ * is measured on its own and printed so it can be subtracted. Records go
+ * to a binary log file so the backend only copies bytes, and the ring
+ * policy is Block for the run.
+ */
+void BenchmarkDeferredLog(const std::string& binaryPath, uint32 threadCount = 4, uint32 linesPerThread = 250000)
+{
+    typedef std::chrono::steady_clock clock;
+    Logger* logger = Logger::getInstance();
+    if (!logger->setBinaryLogFile(binaryPath))
+    {
+        fprintf(stderr, "BenchmarkDeferredLog: cannot open %s\n", binaryPath.c_str());
+        return;
+    }
+    Logger::OverflowPolicy policy = logger->getOverflowPolicy();
+    logger->setOverflowPolicy(Logger::OverflowPolicy::Block);
+
+    std::vector<uint32> clockCost(linesPerThread);
+    for (auto& sample : clockCost)
+    {
+        clock::time_point begin = clock::now();
+        sample = (uint32)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+    }
+    std::sort(clockCost.begin(), clockCost.end());
+
+    for (int deferred = 0; deferred < 2; ++deferred)
+    {
+        std::vector<std::vector<uint32> > latencies(threadCount);
+        std::vector<std::thread> threads;
+        for (uint32 t = 0; t < threadCount; ++t)
+        {
+            threads.push_back(std::thread([&latencies, t, linesPerThread, deferred]()
+            {
+                std::vector<uint32>& samples = latencies[t];
+                samples.reserve(linesPerThread);
+                for (uint32 i = 0; i < linesPerThread; ++i)
+                {
+                    clock::time_point begin = clock::now();
+                    if (deferred)
+                        LOG_INFO_DEFERRED("benchmark thread[%u] line[%u] value[%f] name[%s]", t, i, i * 0.5, "losemymind");
+                    else
+                        LOG_INFO("benchmark thread[%u] line[%u] value[%f] name[%s]", t, i, i * 0.5, "losemymind");
+                    samples.push_back((uint32)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count());
+                }
+            }));
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        logger->flush();
+
+        std::vector<uint32> all;
+        for (auto& samples : latencies)
+        {
+            all.insert(all.end(), samples.begin(), samples.end());
+        }
+        std::sort(all.begin(), all.end());
+        printf("BenchmarkDeferredLog: %s %u threads, producer p50 %uns p99 %uns (clock reads p50 %uns)\n"
+            , deferred ? "LOG_INFO_DEFERRED" : "LOG_INFO         "
+            , threadCount, all[all.size() / 2], all[all.size() * 99 / 100], clockCost[clockCost.size() / 2]);
+    }
+
+    logger->setOverflowPolicy(policy);
+    logger->setBinaryLogFile("");
+}
+
+
+#endif // LOSEMYMIND_LOGGERBENCHMARK_H
@@ -0,0 +1,429 @@
+#include "MetricsExporter.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include "FoundationKit/Base/FlatHashMap.h"
+#include "FoundationKit/Base/Timer.h"
+#include "FoundationKit/Base/RequestTracer.h"
+#include "FoundationKit/Foundation/FrameProfiler.h"
+#include "FoundationKit/Foundation/TaskScheduler.h"
+#include "ConnectionManager.h"
+
+#define METRICSEXPORTER_DEFAULT_PORT 4160
+#define METRICSEXPORTER_DEFAULT_ENDPOINT IPv4Endpoint(IPv4Address(127, 0, 0, 1), METRICSEXPORTER_DEFAULT_PORT)
+
+// 同时处理的抓取连接上限，多出来的直接关闭
+static const size_t MAX_CONNECTIONS = 8;
+// 请求头的上限，超过就关闭连接
+static const size_t MAX_REQUEST_SIZE = 8 * 1024;
+// 每帧最多发送的字节数，大的应答分几帧发完
+static const size_t SEND_BUDGET_PER_FRAME = 64 * 1024;
+// 连接最长存活时间
+static const int64  CONNECTION_TIMEOUT = 5LL * 1000 * 1000 * 1000;
+
+static Counter g_exporterRequests = Metrics::counter("viserver_exporter_requests_total", "HTTP requests served by the metrics exporter.");
+
+// 帮助函数，追加格式化的字符串
+static void appendFormat(std::string& out, const char* format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0)
+    {
+        out.append(buffer, length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+    }
+}
+
+// 帮助函数，拼接 Prometheus 标签
+static void appendLabels(std::string& out, const std::string& labels, const char* extraName = nullptr, const std::string& extraValue = "")
+{
+    if (labels.empty() && extraName == nullptr)
+        return;
+    out += '{';
+    out += labels;
+    if (extraName != nullptr)
+    {
+        if (!labels.empty())
+            out += ',';
+        out += extraName;
+        out += "=\"";
+        out += extraValue;
+        out += '"';
+    }
+    out += '}';
+}
+
+// 帮助函数，JSON 字符串转义
+static void appendJsonString(std::string& out, const std::string& value)
+{
+    out += '"';
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20)
+                appendFormat(out, "\\u%04x", (unsigned char)c);
+            else
+                out += c;
+        }
+    }
+    out += '"';
+}
+
+MetricsExporter::MetricsExporter()
+    :_tcpListener(nullptr)
+    , _bStartup(false)
+{
+
+}
+
+MetricsExporter::~MetricsExporter()
+{
+
+}
+
+// 启动抓取请求监听器
+bool MetricsExporter::Startup()
+{
+    if (_bStartup)return true;
+    _tcpListener = new TcpListener(METRICSEXPORTER_DEFAULT_ENDPOINT);
+    _tcpListener->OnConnectionAccepted() = std::bind(&MetricsExporter::HandleListenerConnectionAccepted, this, std::placeholders::_1, std::placeholders::_2);
+    _bStartup = true;
+    LOG_INFO(">>Metrics listen endpoint[%s]", _tcpListener->GetLocalEndpoint().ToString().c_str());
+    return true;
+}
+
+// 关闭监听器和所有抓取连接
+void MetricsExporter::Shutdown()
+{
+    if (!_bStartup)return;
+    _tcpListener->Stop();
+    SAFE_DELETE(_tcpListener);
+    Socket* socket = nullptr;
+    while (_acceptedSockets.tryPop(socket))
+    {
+        SAFE_DELETE(socket);
+    }
+    for (auto& connection : _connections)
+    {
+        SAFE_DELETE(connection.socket);
+    }
+    _connections.clear();
+    _bStartup = false;
+}
+
+// 运行在 TcpListener 线程，只把连接交给主线程
+bool MetricsExporter::HandleListenerConnectionAccepted(Socket* ClientSocket, const IPv4Endpoint& ClientEndpoint)
+{
+    _acceptedSockets.push(ClientSocket);
+    return true;
+}
+
+// 每帧处理抓取连接
+void MetricsExporter::update()
+{
+    if (!_bStartup)return;
+    PROFILE_SCOPE("MetricsExporter::update");
+
+    int64 now = Timer::nowNanoseconds();
+    Socket* socket = nullptr;
+    while (_acceptedSockets.tryPop(socket))
+    {
+        if (_connections.size() >= MAX_CONNECTIONS)
+        {
+            SAFE_DELETE(socket);
+            continue;
+        }
+        // 主循环不能被抓取连接阻塞
+        socket->SetNonBlocking(true);
+        HttpConnection connection;
+        connection.socket = socket;
+        connection.sent = 0;
+        connection.acceptTime = now;
+        _connections.push_back(connection);
+    }
+
+    // 渲染快照是最贵的部分，每帧最多渲染一个应答
+    bool bRendered = false;
+    size_t sendBudget = SEND_BUDGET_PER_FRAME;
+    for (size_t i = 0; i < _connections.size();)
+    {
+        HttpConnection& connection = _connections[i];
+        if (processConnection(connection, bRendered, sendBudget) && now - connection.acceptTime < CONNECTION_TIMEOUT)
+        {
+            ++i;
+            continue;
+        }
+        SAFE_DELETE(connection.socket);
+        connection = _connections.back();
+        _connections.pop_back();
+    }
+}
+
+bool MetricsExporter::processConnection(HttpConnection& connection, bool& bRendered, size_t& sendBudget)
+{
+    Socket* socket = connection.socket;
+    if (socket->GetConnectionState() != ESocketConnectionState::Connected)
+        return false;
+
+    // 读取请求头
+    if (!connection.response)
+    {
+        uint32 dataSize = 0;
+        if (socket->HasPendingData(dataSize))
+        {
+            char buffer[1024];
+            int32 bytesRead = 0;
+            if (socket->Recv((uint8*)buffer, sizeof(buffer), bytesRead) && bytesRead > 0)
+            {
+                connection.request.append(buffer, bytesRead);
+            }
+        }
+        if (connection.request.size() > MAX_REQUEST_SIZE)
+            return false;
+        if (connection.request.find("\r\n\r\n") == std::string::npos)
+            return true;
+        if (bRendered)
+            return true;
+        bRendered = true;
+        g_exporterRequests.increment();
+        std::shared_ptr<HttpResponse> response = std::make_shared<HttpResponse>();
+        connection.response = response;
+        TaskScheduler* scheduler = TaskScheduler::getInstance();
+        if (isMainThreadRequest(connection.request) || !scheduler->isRunning() || scheduler->getWorkerCount() == 0)
+        {
+            buildResponse(connection.request, response->header, response->body);
+            response->ready.store(true, std::memory_order_relaxed);
+        }
+        else
+        {
+            // 快照和格式化放到工作线程，主循环下一帧再来看是否渲染完
+            std::string request = connection.request;
+            scheduler->submit([response, request]()
+            {
+                buildResponse(request, response->header, response->body);
+                response->ready.store(true, std::memory_order_release);
+            });
+            return true;
+        }
+    }
+    if (!connection.response->ready.load(std::memory_order_acquire))
+        return true;
+
+    // 发送应答，发不完的下一帧继续。头部和正文作为两段一次写出
+    const HttpResponse& response = *connection.response;
+    size_t total = response.header.size() + response.body.size();
+    while (connection.sent < total && sendBudget > 0)
+    {
+        IOVec segments[2];
+        int32 segmentCount = 0;
+        size_t offset = connection.sent;
+        size_t budget = sendBudget;
+        const std::string* parts[2] = { &response.header, &response.body };
+        for (int32 i = 0; i < 2 && budget > 0; ++i)
+        {
+            if (offset >= parts[i]->size())
+            {
+                offset -= parts[i]->size();
+                continue;
+            }
+            size_t length = parts[i]->size() - offset;
+            length = length < budget ? length : budget;
+            segments[segmentCount].base = (void*)(parts[i]->data() + offset);
+            segments[segmentCount].len = length;
+            ++segmentCount;
+            budget -= length;
+            offset = 0;
+        }
+        int32 bytesSent = 0;
+        if (!socket->SendV(segments, segmentCount, bytesSent) || bytesSent <= 0)
+            break;
+        connection.sent += bytesSent;
+        sendBudget -= bytesSent;
+    }
+    return connection.sent < total;
+}
+
+bool MetricsExporter::isMainThreadRequest(const std::string& request)
+{
+    size_t methodEnd = request.find(' ');
+    return methodEnd != std::string::npos && request.compare(methodEnd + 1, 12, "/connections") == 0;
+}
+
+void MetricsExporter::buildResponse(const std::string& request, std::string& header, std::string& body)
+{
+    // 请求行：METHOD SP PATH SP VERSION
+    size_t methodEnd = request.find(' ');
+    size_t pathEnd = methodEnd == std::string::npos ? std::string::npos : request.find(' ', methodEnd + 1);
+    std::string method = request.substr(0, methodEnd);
+    std::string path = pathEnd == std::string::npos ? "" : request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+    size_t query = path.find('?');
+    std::string queryString;
+    if (query != std::string::npos)
+    {
+        queryString = path.substr(query + 1);
+        path.resize(query);
+    }
+
+    const char* status = "200 OK";
+    const char* contentType = "text/plain; charset=utf-8";
+    body.clear();
+    if (method != "GET")
+    {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported.\n";
+    }
+    else if (path == "/metrics")
+    {
+        std::vector<MetricSample> samples;
+        Metrics::getSnapshot(samples);
+        writePrometheusText(samples, body);
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+    }
+    else if (path == "/connections")
+    {
+        writeConnectionsJson(body);
+        contentType = "application/json";
+    }
+    else if (path == "/traces")
+    {
+        // id=追踪ID 只查一条，不带参数输出缓冲区里所有的追踪
+        uint64 traceId = 0;
+        bool validId = true;
+        if (queryString.compare(0, 3, "id=") == 0)
+        {
+            const char* id = queryString.c_str() + 3;
+            char* end = nullptr;
+            traceId = strtoull(id, &end, 10);
+            // 无效的ID不能退化成输出整个缓冲区
+            validId = traceId != 0 && *end == '\0' && *id >= '0' && *id <= '9';
+        }
+        if (validId)
+        {
+            std::vector<RequestTrace> traces;
+            RequestTracer::getTraces(traces, traceId);
+            RequestTracer::writeCsv(traces, body);
+            contentType = "text/csv; charset=utf-8";
+        }
+        else
+        {
+            status = "400 Bad Request";
+            body = "id must be a non-zero decimal trace id.\n";
+        }
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "Try /metrics, /connections or /traces.\n";
+    }
+
+    header.clear();
+    appendFormat(header, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n"
+        , status, contentType, (uint32)body.size());
+}
+
+void MetricsExporter::writePrometheusText(const std::vector<MetricSample>& samples, std::string& out)
+{
+    // 同名的指标（不同标签）必须写在一起，按第一次出现的顺序分组
+    FlatHashMap<std::string, uint32, StringHash, StringEqual> groupByName;
+    std::vector<std::vector<const MetricSample*> > groups;
+    for (auto& sample : samples)
+    {
+        auto iter = groupByName.find(sample.name);
+        if (iter == groupByName.end())
+        {
+            iter = groupByName.insert(std::make_pair(sample.name, (uint32)groups.size())).first;
+            groups.push_back(std::vector<const MetricSample*>());
+        }
+        groups[iter->second].push_back(&sample);
+    }
+
+    static const char* TYPE_NAMES[] = { "counter", "gauge", "histogram", "summary" };
+    for (auto& group : groups)
+    {
+        const MetricSample& first = *group.front();
+        appendFormat(out, "# HELP %s %s\n", first.name.c_str(), first.help.c_str());
+        appendFormat(out, "# TYPE %s %s\n", first.name.c_str(), TYPE_NAMES[(int)first.type]);
+        for (const MetricSample* sample : group)
+        {
+            switch (sample->type)
+            {
+            case MetricType::Counter:
+            case MetricType::Gauge:
+                out += sample->name;
+                appendLabels(out, sample->labels);
+                appendFormat(out, " %lld\n", sample->value);
+                break;
+            case MetricType::Histogram:
+            {
+                int64 cumulative = 0;
+                for (size_t i = 0; i < sample->bucketCounts.size(); ++i)
+                {
+                    cumulative += sample->bucketCounts[i];
+                    std::string bound = "+Inf";
+                    if (i < sample->bucketBounds.size())
+                    {
+                        bound.clear();
+                        appendFormat(bound, "%lld", sample->bucketBounds[i]);
+                    }
+                    out += sample->name;
+                    out += "_bucket";
+                    appendLabels(out, sample->labels, "le", bound);
+                    appendFormat(out, " %lld\n", cumulative);
+                }
+                break;
+            }
+            case MetricType::Summary:
+                for (size_t i = 0; i < sample->quantiles.size(); ++i)
+                {
+                    std::string quantile;
+                    appendFormat(quantile, "%g", sample->quantiles[i]);
+                    out += sample->name;
+                    appendLabels(out, sample->labels, "quantile", quantile);
+                    appendFormat(out, " %lld\n", sample->quantileValues[i]);
+                }
+                break;
+            }
+            if (sample->type == MetricType::Histogram || sample->type == MetricType::Summary)
+            {
+                out += sample->name;
+                out += "_sum";
+                appendLabels(out, sample->labels);
+                appendFormat(out, " %lld\n", sample->sum);
+                out += sample->name;
+                out += "_count";
+                appendLabels(out, sample->labels);
+                appendFormat(out, " %lld\n", sample->value);
+            }
+        }
+    }
+}
+
+void MetricsExporter::writeConnectionsJson(std::string& out)
+{
+    static const char* STATE_NAMES[] = { "not_connected", "connected", "connection_error" };
+    std::vector<ConnectionInfo> connections;
+    ConnectionManager::getInstance()->getConnectionInfos(connections);
+    appendFormat(out, "{\"count\":%u,\"connections\":[", (uint32)connections.size());
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        const ConnectionInfo& info = connections[i];
+        if (i > 0)
+            out += ',';
+        appendFormat(out, "{\"id\":%llu,\"peer\":", info.clientId);
+        appendJsonString(out, info.peer);
+        out += ",\"description\":";
+        appendJsonString(out, info.description);
+        appendFormat(out, ",\"state\":\"%s\"}", STATE_NAMES[(int)info.state]);
+    }
+    out += "]}\n";
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FoundationKit/GenericPlatformMacros.h"
+#include "FoundationKit/Foundation/Singleton.h"
+#include "FoundationKit/Base/LockFreeQueue.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "Networking/TcpListener.h"
+#include "Networking/IPv4Address.h"
+#include "Networking/IPv4Endpoint.h"
+#include "Networking/SocketBSD.h"
+
+USING_NS_FK;
+
+/**
+ * 内置的指标导出服务，一个很小的 HTTP/1.1 服务器：
+ *   GET /metrics      Prometheus 文本格式的指标
+ *   GET /connections  连接表的 JSON 快照
+ *   GET /traces       最近追踪的请求各阶段耗时（CSV），/traces?id=追踪ID 只输出一条
+ *
+ * TcpListener 线程只负责接受连接，请求的读取和发送都在主循环的 update()
+ * 里，以非阻塞方式进行，每帧有固定的预算，排在游戏流量之后处理，不会拖慢
+ * 客户端消息的处理。/metrics 和 /traces 的渲染交给 TaskScheduler 的工作线程，
+ * /connections 要访问只在主线程删除的 Socket，仍在主线程渲染。
+ */
+class MetricsExporter : public Singleton<MetricsExporter>
+{
+    MetricsExporter();
+    friend Singleton<MetricsExporter>;
+public:
+    ~MetricsExporter();
+
+    // 启动
+    bool Startup();
+
+    // 关闭
+    void Shutdown();
+
+    // 每帧更新，在 ConnectionManager::update 之后调用
+    void update();
+
+    // 把指标快照写成 Prometheus 文本格式（0.0.4）
+    static void writePrometheusText(const std::vector<MetricSample>& samples, std::string& out);
+
+    // 把连接表写成 JSON
+    static void writeConnectionsJson(std::string& out);
+
+protected:
+    // 渲染好的应答，工作线程写入，ready 之后主线程才读取
+    struct HttpResponse
+    {
+        HttpResponse() :ready(false){}
+
+        std::string       header;   // 状态行和头部
+        std::string       body;     // 和头部一起用 SendV 发出，不再拼成一块
+        std::atomic<bool> ready;
+    };
+
+    // 一个 HTTP 连接，应答发送完后关闭（Connection: close）
+    struct HttpConnection
+    {
+        Socket*                       socket;
+        std::string                   request;
+        std::shared_ptr<HttpResponse> response;  // 连接超时关闭后渲染任务仍持有它
+        size_t                        sent;
+        int64                         acceptTime;
+    };
+
+    // 处理连接进来，运行在 TcpListener 线程
+    bool HandleListenerConnectionAccepted(Socket* ClientSocket, const IPv4Endpoint& ClientEndpoint);
+
+    // 读取请求、发送应答，返回 false 表示连接可以关闭了
+    bool processConnection(HttpConnection& connection, bool& bRendered, size_t& sendBudget);
+
+    // 根据请求生成应答的头部和正文，可以在任何线程调用，/connections 除外
+    static void buildResponse(const std::string& request, std::string& header, std::string& body);
+
+    // 请求的应答是否只能在主线程渲染
+    static bool isMainThreadRequest(const std::string& request);
+
+    // TCP 连接监听器，监听抓取请求。
+    TcpListener*           _tcpListener;
+
+    // 刚接受的连接，监听线程写入，主线程读取。
+    MpscQueue<Socket*>     _acceptedSockets;
+
+    // 正在处理的连接，只在主线程访问。
+    std::vector<HttpConnection> _connections;
+
+    bool                   _bStartup;
+};
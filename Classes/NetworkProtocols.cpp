@@ -1,6 +1,7 @@
 #include "NetworkProtocols.h"
 #include <string>
 #include "Networking/IProtocol.h"
+#include "Networking/ProtocolMessage.h"
 #include "Networking/SocketBSD.h"
 #include "VIServer.h"
 #include "ClientProtocolDefines.h"
@@ -8,18 +9,17 @@
 
 
 // Э
-class ClientChat : IProtocol
+class ClientChat : public TypedProtocol<ClientChatMessage>
 {
 public:
-    ClientChat(int32 idx) :IProtocol(idx){}
-
-    virtual void ProcessStreamProtocol(uint64 clientID, DataStream & stream)
+    // ʽݰᵽ IProtocol::DispathStreamProtocol ͳһ־
+    virtual void ProcessMessage(uint64 clientID, const ClientChatMessage& message) override
     {
-        std::string msg;
-        stream >> msg;
-        LOG_INFO(">>RECV:%s", msg.c_str());
+        LOG_INFO_DEFERRED(">>RECV:%s", message.msg.c_str());
 
         auto client = ConnectionManager::getInstance()->getClientByID(clientID);
+        if (client == nullptr)
+            return;
 
         int bytesSend;
         char* sendMsg = "I recv you send msg.";
@@ -28,7 +28,7 @@ public:
 };
 
 
-IMPLEMENT_PROTOCOL(ClientChat, CLIENT_CHAT);
+IMPLEMENT_MESSAGE_PROTOCOL(ClientChat);
 
 
 
@@ -1,6 +1,12 @@
 
 #include "IProtocol.h"
 #include "FoundationKit/Foundation/Logger.h"
+#include "FoundationKit/Foundation/StringUtils.h"
+#include "FoundationKit/Base/Timer.h"
+
+// 无法分发的包，按原因分开统计
+static Counter g_packetsTooShort = Metrics::counter("viserver_protocol_dropped_total", "Packets that could not be dispatched.", "reason=\"too_short\"");
+static Counter g_packetsUnknown = Metrics::counter("viserver_protocol_dropped_total", "Packets that could not be dispatched.", "reason=\"unknown_protocol\"");
 
 // 协议池实例
 IProtocol::PROTOCOLS & IProtocol::GetProtoclsPool ()
@@ -11,7 +17,12 @@ IProtocol::PROTOCOLS & IProtocol::GetProtoclsPool ()
 
 // 每个协议一个协议ID
 IProtocol::IProtocol(int32 idx)
+    : _handlerTime(nullptr)
 {
+    std::string labels = StringUtils::format("protocol=\"%d\"", idx);
+    _handledCounter = Metrics::counter("viserver_protocol_handled_total", "Messages handled per protocol.", labels);
+    _malformedCounter = Metrics::counter("viserver_protocol_malformed_total", "Messages that failed to decode per protocol.", labels);
+    _handlerTime = Metrics::latency("viserver_protocol_handler_nanoseconds", "ProcessStreamProtocol time per protocol.", labels);
     //LOG_ASSERT(GetMatchedProtocol(idx) == nullptr, "***** 协议id 已经存在，请重新指定。");
     PROTOCOLS & pool = GetProtoclsPool();
     pool.insert(std::pair< int32, IProtocol* >(idx, this));
@@ -27,16 +38,49 @@ IProtocol * IProtocol::GetMatchedProtocol(int32 idx)
     return nullptr;
 }
 
-void IProtocol::DispathStreamProtocol(uint64 clientID, DataStream & stream)
+void IProtocol::DispathStreamProtocol(uint64 clientID, DataStream & stream, RequestTrace* trace)
 {
     int32 idx = stream.read<int32>();
+    uint64 traceId = 0;
+    if (!stream.hasError() && (idx & PROTOCOL_TRACE_FLAG))
+    {
+        idx &= ~PROTOCOL_TRACE_FLAG;
+        traceId = stream.read<uint64>();
+    }
+    if (stream.hasError())
+    {
+        g_packetsTooShort.increment();
+        LOG_RATE_LIMITED(Logger::Level::LV_ERROR, 10, "***** Packet from client[%llu] is too short to hold a protocol id", clientID);
+        return;
+    }
+    // 客户端带了追踪ID的消息总是追踪，其余的按采样率抽样
+    bool traced = trace != nullptr && RequestTracer::begin(*trace, traceId, clientID, idx);
     IProtocol * pProtocol = GetMatchedProtocol( idx );
     if ( pProtocol )
     {
+        int64 handlerStart = Timer::nowNanoseconds();
+        if (traced)
+            RequestTracer::mark(*trace, TraceStage::Dispatched, handlerStart);
         pProtocol->ProcessStreamProtocol(clientID, stream);
+        int64 handlerEnd = Timer::nowNanoseconds();
+        pProtocol->_handlerTime->record(handlerEnd - handlerStart);
+        pProtocol->_handledCounter.increment();
+        // 处理函数里已经回复的话，追踪到这里就完整了
+        if (traced)
+            RequestTracer::mark(*trace, TraceStage::Handled, handlerEnd);
+        // 解码错误是粘滞的，每条消息在这里统一检查一次
+        if (stream.hasError())
+        {
+            pProtocol->_malformedCounter.increment();
+            LOG_RATE_LIMITED(Logger::Level::LV_ERROR, 10, "***** Malformed protocol[%d] from client[%llu]", idx, clientID);
+        }
     }
     else
     {
-        LOG_ERROR("***** Cannot found procotol by id[%d]", idx);
+        g_packetsUnknown.increment();
+        if (traced)
+            RequestTracer::finish(*trace);
+        // A misbehaving client can send these as fast as it likes, keep them from flooding the log.
+        LOG_RATE_LIMITED(Logger::Level::LV_ERROR, 10, "***** Cannot found procotol by id[%d]", idx);
     }
 }
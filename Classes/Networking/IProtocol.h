@@ -1,18 +1,27 @@
 #ifndef LOSEMYMIND_IPROTOCOL_H
 #define LOSEMYMIND_IPROTOCOL_H
 
-#include <unordered_map>
 #include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/FlatHashMap.h"
 #include "FoundationKit/Base/DataStream.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/RequestTracer.h"
 
 USING_NS_FK;
 
+/**
+ * 协议头是一个 int32 协议ID。协议ID设置了 PROTOCOL_TRACE_FLAG 时，后面紧跟一个
+ * uint64 追踪ID，服务器会记录这条消息经过各阶段的时间（见 RequestTracer），
+ * 之后可以按追踪ID查到这条消息慢在哪里。不设置这一位的客户端不受影响。
+ */
+#define PROTOCOL_TRACE_FLAG 0x40000000
+
 /**
 @brief 实现接收客户端协议的接口 
 */
 class IProtocol
 {
-    typedef std::unordered_map< int32, IProtocol * > PROTOCOLS;
+    typedef FlatHashMap< int32, IProtocol * > PROTOCOLS;
 private:
     /**
      * @brief		禁止默认建构 
@@ -28,18 +37,28 @@ private:
      * @brief		根据协议ID获得协议的指针 
      */
     static IProtocol * GetMatchedProtocol(int32 idx);
+
+    /**
+     * @brief		每个协议的统计：处理次数、解码错误次数、处理耗时（纳秒，可查询百分位）
+     */
+    Counter           _handledCounter;
+    Counter           _malformedCounter;
+    LatencyHistogram* _handlerTime;
 public:
     IProtocol(int32 idx);
     virtual ~IProtocol() {}
 
     /**
      * @brief		分发原始流协议 
+     * @param		trace  连接上的追踪上下文，为空时不追踪
      */
-    static void DispathStreamProtocol(uint64 clientID, DataStream & stream);
+    static void DispathStreamProtocol(uint64 clientID, DataStream & stream, RequestTrace* trace = nullptr);
         
  
     /**
      * @brief		处理原始流协议 
+     *              解码越界不会抛出异常，stream 会进入粘滞错误状态，
+     *              读到的值为默认值，实现者可在使用数据前检查 stream.hasError()。
      */
     virtual void ProcessStreamProtocol(uint64 clientID, DataStream & stream) {}
 };
@@ -0,0 +1,93 @@
+#ifndef LOSEMYMIND_PROTOCOLMESSAGE_H
+#define LOSEMYMIND_PROTOCOLMESSAGE_H
+
+#pragma once
+#include "FoundationKit/Base/Types.h"
+#include "FoundationKit/Base/DataStream.h"
+#include "IProtocol.h"
+
+USING_NS_FK;
+
+/**
+ * Declares the wire layout of a protocol message in one place.
+ *
+ * The field list is written once and drives the generated code:
+ *   - PROTOCOL_ID    the id the message is dispatched by.
+ *   - measure()      the exact encoded size, including the id.
+ *   - encode()       reserves once, then writes the id and every field.
+ *                    encode(stream, traceId) writes a traced header, the
+ *                    id with PROTOCOL_TRACE_FLAG followed by the trace id,
+ *                    measure() + 8 bytes in total.
+ *   - decode()       reads every field; the id has already been consumed
+ *                    by IProtocol::DispathStreamProtocol.
+ *
+ * Sample usage:
+ *
+ *     struct ClientChatMessage
+ *     {
+ *         std::string msg;
+ *         DECLARE_PROTOCOL_MESSAGE(CLIENT_CHAT, msg)
+ *     };
+ *
+ * Fields are encoded with the DataStream operators, so any type DataStream
+ * supports can be used and the bytes match a hand written encoder. A
+ * message without fields is declared as DECLARE_PROTOCOL_MESSAGE(IDX) and
+ * encodes to the id alone.
+ */
+#define DECLARE_PROTOCOL_MESSAGE(IDX, ...)                              \
+    static const int32 PROTOCOL_ID = IDX;                               \
+    size_t measure() const                                              \
+    {                                                                   \
+        return sizeof(int32) + DataStream::measure(__VA_ARGS__);        \
+    }                                                                   \
+    void encode(DataStream& stream) const                               \
+    {                                                                   \
+        stream.reserve(measure());                                      \
+        stream << (int32)PROTOCOL_ID;                                   \
+        stream.writeAll(__VA_ARGS__);                                   \
+    }                                                                   \
+    void encode(DataStream& stream, uint64 traceId) const               \
+    {                                                                   \
+        stream.reserve(measure() + sizeof(uint64));                     \
+        stream << (int32)(PROTOCOL_ID | PROTOCOL_TRACE_FLAG) << traceId;\
+        stream.writeAll(__VA_ARGS__);                                   \
+    }                                                                   \
+    bool decode(DataStream& stream)                                     \
+    {                                                                   \
+        stream.readAll(__VA_ARGS__);                                    \
+        return !stream.hasError();                                      \
+    }
+
+/**
+ * A protocol handler that receives a decoded message instead of the raw stream.
+ *
+ * The handler registers itself under MessageType::PROTOCOL_ID, so there is
+ * no id to keep in sync by hand. Malformed packets never reach ProcessMessage;
+ * the dispatcher reports them.
+ */
+template<typename MessageType>
+class TypedProtocol : public IProtocol
+{
+public:
+    typedef MessageType message_type;
+
+    TypedProtocol() :IProtocol(MessageType::PROTOCOL_ID){}
+
+    virtual void ProcessStreamProtocol(uint64 clientID, DataStream & stream) override
+    {
+        MessageType message;
+        if (message.decode(stream))
+        {
+            ProcessMessage(clientID, message);
+        }
+    }
+
+    /**
+     * @brief		Handles one decoded message.
+     */
+    virtual void ProcessMessage(uint64 clientID, const MessageType& message) = 0;
+};
+
+#define IMPLEMENT_MESSAGE_PROTOCOL(CLS) CLS G_PROTOCOL_##CLS
+
+#endif // LOSEMYMIND_PROTOCOLMESSAGE_H
@@ -20,6 +20,27 @@ bool Socket::Send(const uint8* data, int32 count, int32& bytesSent)
 }
 
 
+bool Socket::SendV(const IOVec* buffers, int32 bufferCount, int32& bytesSent)
+{
+    // Platforms without a native gather write fall back to one Send per buffer.
+    bytesSent = 0;
+    for (int32 i = 0; i < bufferCount; ++i)
+    {
+        int32 sent = 0;
+        if (!Send((const uint8*)buffers[i].base, (int32)buffers[i].len, sent))
+        {
+            return bytesSent > 0;
+        }
+        bytesSent += sent;
+        if (sent < (int32)buffers[i].len)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+
 bool Socket::RecvFrom(uint8* data, int32 bufferSize, int32& bytesRead, InternetAddrBSD& source, ESocketReceiveFlags flags)
 {
     if (bytesRead > 0)
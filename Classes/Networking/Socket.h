@@ -6,6 +6,8 @@
 #include <string>
 #include "FoundationKit/Base/Types.h"
 #include "FoundationKit/Base/Timespan.h"
+#include "FoundationKit/Base/RequestTracer.h"
+#include "FoundationKit/Base/SegmentedDataStream.h"
 #include "IPAddressBSD.h"
 #include "winsock_init.hpp"
 
@@ -107,12 +109,20 @@ protected:
 	/** Debug description of socket usage. */
 	std::string _SocketDescription;
 
+	/** When the request being answered was received (Timer::nowNanoseconds), 0 if none. */
+	int64 _RequestReceivedTime;
+
+	/** Stage times of the request being answered when it is traced. */
+	RequestTrace _RequestTrace;
+
 public:
 
 	/** Default ctor */
 	inline Socket() 
         : _SocketType(ESocketType::Unknown)
         , _SocketDescription("")
+        , _RequestReceivedTime(0)
+        , _RequestTrace()
 	{
 	}
 
@@ -124,7 +134,9 @@ public:
 	 */
 	inline Socket(ESocketType socketType, const std::string& socketDescription) :
         _SocketType(socketType),
-        _SocketDescription(socketDescription)
+        _SocketDescription(socketDescription),
+        _RequestReceivedTime(0),
+        _RequestTrace()
 	{
 	}
 
@@ -133,6 +145,8 @@ public:
 	 */
 	virtual ~Socket()
 	{
+		// Closed before the traced request was answered.
+		RequestTracer::finish(_RequestTrace);
 	}
 
 	/**
@@ -224,6 +238,15 @@ public:
 	 */
 	virtual bool Send(const uint8* data, int32 count, int32& bytesSent);
 
+	/**
+	 * Sends a list of buffers on a connected socket with a single gather write
+	 *
+	 * @param Buffers the buffers to send, in order
+	 * @param BufferCount the number of entries in Buffers
+	 * @param BytesSent out param indicating how much was sent in total
+	 */
+	virtual bool SendV(const IOVec* buffers, int32 bufferCount, int32& bytesSent);
+
 	/**
 	 * Reads a chunk of data from the socket. Gathers the source address too
 	 *
@@ -421,6 +444,26 @@ public:
 	{
 		return _SocketDescription;
 	}
+
+	/**
+	 * Marks that a request was received at the given time. The next successful
+	 * Send or SendV records the time from here to the response leaving.
+	 *
+	 * @param ReceivedTime Timer::nowNanoseconds() taken right after the receive
+	 */
+	FORCEINLINE void MarkRequestReceived(int64 receivedTime)
+	{
+		_RequestReceivedTime = receivedTime;
+		// The last traced request got no answer, keep what it reached.
+		RequestTracer::finish(_RequestTrace);
+		_RequestTrace.stages[(uint32)TraceStage::Received] = receivedTime;
+	}
+
+	/** Trace context of the request being answered, see RequestTracer. */
+	FORCEINLINE RequestTrace& GetRequestTrace()
+	{
+		return _RequestTrace;
+	}
 };
 
 
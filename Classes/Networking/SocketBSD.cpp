@@ -1,9 +1,32 @@
 
 #include "SocketBSD.h"
 #include "FoundationKit/Foundation/Logger.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/Timer.h"
+#include "FoundationKit/Foundation/FrameProfiler.h"
 
 USING_NS_FK;
 
+static Counter g_bytesSent = Metrics::counter("viserver_bytes_sent_total", "Bytes written to sockets by Send and SendV.");
+static Counter g_sendCalls = Metrics::counter("viserver_send_calls_total", "Send and SendV calls, a gather write counts once.");
+static LatencyHistogram* g_requestLatency = Metrics::latency("viserver_request_nanoseconds", "Time from receiving a request to its response being sent.");
+
+// The first send after Socket::MarkRequestReceived closes the request.
+static inline void recordRequestLatency(int64& receivedTime, RequestTrace& trace)
+{
+	if (receivedTime != 0)
+	{
+		int64 now = Timer::nowNanoseconds();
+		g_requestLatency->record(now - receivedTime);
+		receivedTime = 0;
+		if (trace.traceId != 0)
+			RequestTracer::mark(trace, TraceStage::Sent, now);
+	}
+}
+
+// One huge page holds thousands of sockets, scanning them stays within a few TLB entries.
+IMPLEMENT_POOLED_ALLOCATION_EX(SocketBSD, PageAllocator::HUGE_PAGE_SIZE, true);
+
 #if ((TARGET_PLATFORM == PLATFORM_ANDROID) ||(TARGET_PLATFORM == PLATFORM_LINUX))
 
 #define PLATFORM_HAS_BSD_SOCKET_FEATURE_IOCTL 1
@@ -15,6 +38,14 @@ USING_NS_FK;
 #define PLATFORM_HAS_BSD_SOCKET_FEATURE_WINSOCKETS 1
 #endif
 
+// A write to a peer that already closed must fail with EPIPE instead of
+// raising SIGPIPE and killing the server.
+#if defined(MSG_NOSIGNAL)
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+
 
 /* FSocket overrides
  *****************************************************************************/
@@ -137,11 +168,87 @@ bool SocketBSD::SendTo(const uint8* data, int32 count, int32& bytesSent, const I
 
 bool SocketBSD::Send(const uint8* data, int32 count, int32& bytesSent)
 {
-	bytesSent = send(_Socket, (const char*)data, count, 0);
+	PROFILE_SCOPE("Socket::Send");
+	bytesSent = send(_Socket, (const char*)data, count, SendFlags);
 
 	bool Result = bytesSent >= 0;
 	if (Result)
 	{
+		g_sendCalls.increment();
+		g_bytesSent.increment(bytesSent);
+		recordRequestLatency(_RequestReceivedTime, _RequestTrace);
+		_LastActivityTime = DateTime::utcNow();
+	}
+	return Result;
+}
+
+
+bool SocketBSD::SendV(const IOVec* buffers, int32 bufferCount, int32& bytesSent)
+{
+	PROFILE_SCOPE("Socket::SendV");
+	bytesSent = 0;
+#if PLATFORM_HAS_BSD_SOCKET_FEATURE_WINSOCKETS
+	// WSABUF has a different layout from IOVec, translate in small batches on the stack
+	static const int32 MaxBatch = 64;
+	WSABUF Batch[MaxBatch];
+	int32 Offset = 0;
+	while (Offset < bufferCount)
+	{
+		int32 BatchCount = (bufferCount - Offset) < MaxBatch ? (bufferCount - Offset) : MaxBatch;
+		u_long BatchBytes = 0;
+		for (int32 i = 0; i < BatchCount; ++i)
+		{
+			Batch[i].buf = (CHAR*)buffers[Offset + i].base;
+			Batch[i].len = (ULONG)buffers[Offset + i].len;
+			BatchBytes += Batch[i].len;
+		}
+		DWORD Sent = 0;
+		if (WSASend(_Socket, Batch, BatchCount, &Sent, 0, NULL, NULL) != 0)
+		{
+			break;
+		}
+		bytesSent += (int32)Sent;
+		Offset += BatchCount;
+		if (Sent < BatchBytes)
+		{
+			break;
+		}
+	}
+#else
+	static_assert(sizeof(IOVec) == sizeof(iovec), "IOVec must match struct iovec");
+	int32 Offset = 0;
+	while (Offset < bufferCount)
+	{
+		int32 BatchCount = (bufferCount - Offset) < IOV_MAX ? (bufferCount - Offset) : IOV_MAX;
+		ssize_t BatchBytes = 0;
+		for (int32 i = 0; i < BatchCount; ++i)
+		{
+			BatchBytes += buffers[Offset + i].len;
+		}
+		// sendmsg rather than writev, writev has no way to suppress SIGPIPE
+		msghdr Message;
+		memset(&Message, 0, sizeof(Message));
+		Message.msg_iov = (iovec*)(buffers + Offset);
+		Message.msg_iovlen = BatchCount;
+		ssize_t Sent = sendmsg(_Socket, &Message, SendFlags);
+		if (Sent < 0)
+		{
+			break;
+		}
+		bytesSent += (int32)Sent;
+		Offset += BatchCount;
+		if (Sent < BatchBytes)
+		{
+			break;
+		}
+	}
+#endif
+	bool Result = bytesSent > 0 || bufferCount == 0;
+	if (Result)
+	{
+		g_sendCalls.increment();
+		g_bytesSent.increment(bytesSent);
+		recordRequestLatency(_RequestReceivedTime, _RequestTrace);
 		_LastActivityTime = DateTime::utcNow();
 	}
 	return Result;
@@ -8,6 +8,7 @@
 #include <string>
 #include "Socket.h"
 #include "FoundationKit/Base/DateTime.h"
+#include "FoundationKit/Base/SlabAllocator.h"
 
 
 /**
@@ -38,6 +39,8 @@ enum class ESocketBSDReturn
 class SocketBSD : public Socket
 {
 public:
+    // Accepted sockets come and go with every connection, keep them in one slab pool.
+    DECLARE_POOLED_ALLOCATION(SocketBSD)
 
 	/**
 	 * Assigns a BSD socket to this object.
@@ -87,6 +90,7 @@ public:
     virtual class Socket* Accept(InternetAddrBSD& outAddr, const std::string& socketDescription) override;
     virtual bool SendTo(const uint8* data, int32 count, int32& bytesSent, const InternetAddrBSD& destination) override;
     virtual bool Send(const uint8* data, int32 count, int32& bytesSent) override;
+    virtual bool SendV(const IOVec* buffers, int32 bufferCount, int32& bytesSent) override;
     virtual bool RecvFrom(uint8* data, int32 bufferSize, int32& bytesRead, InternetAddrBSD& source, ESocketReceiveFlags flags = ESocketReceiveFlags::None) override;
     virtual bool Recv(uint8* data, int32 bufferSize, int32& bytesRead, ESocketReceiveFlags flags = ESocketReceiveFlags::None) override;
 	virtual bool Wait(ESocketWaitConditions condition, Timespan waitTime) override;
@@ -7,6 +7,7 @@
 #include <functional>
 #include <thread>
 #include "FoundationKit/Base/Timespan.h"
+#include "FoundationKit/Base/Metrics.h"
 #include "Socket.h"
 #include "IPv4Address.h"
 #include "IPv4Endpoint.h"
@@ -38,6 +39,7 @@ public:
         , _Socket(nullptr)
         , _Stopping(false)
 	{
+        RegisterMetrics();
         _Thread = std::thread(std::bind(&TcpListener::Run, this));
 	}
 
@@ -56,6 +58,7 @@ public:
 		std::shared_ptr<InternetAddrBSD> LocalAddress = std::shared_ptr<InternetAddrBSD>(new InternetAddrBSD);
         _Socket->GetAddress(*LocalAddress);
         _Endpoint = IPv4Endpoint(LocalAddress);
+        RegisterMetrics();
         _Thread = std::thread(std::bind(&TcpListener::Run, this));
 	}
 
@@ -159,8 +162,13 @@ public:
 						Accepted = ConnectionAcceptedDelegate(ConnectionSocket, IPv4Endpoint(RemoteAddress));
 					}
 
-					if (!Accepted)
+					if (Accepted)
 					{
+                        _AcceptedCounter.increment();
+					}
+					else
+					{
+                        _RejectedCounter.increment();
 						ConnectionSocket->Close();
                         delete ConnectionSocket;
 					}
@@ -173,6 +181,16 @@ public:
 		return 0;
 	}
 
+private:
+
+	/** Registers the accept counters, labelled with the listen endpoint. */
+	void RegisterMetrics()
+	{
+        std::string Labels = "endpoint=\"" + _Endpoint.ToString() + "\"";
+        _AcceptedCounter = Metrics::counter("viserver_listener_accepted_total", "Connections accepted by a TcpListener.", Labels);
+        _RejectedCounter = Metrics::counter("viserver_listener_rejected_total", "Connections rejected by the accept delegate.", Labels);
+	}
+
 private:
 
 	/** Holds a flag indicating whether the socket should be deleted in the destructor. */
@@ -193,6 +211,10 @@ private:
 	/** Holds the thread object. */
 	std::thread _Thread;
 
+	/** Holds the counters of accepted and rejected connections. */
+    Counter _AcceptedCounter;
+    Counter _RejectedCounter;
+
 private:
 
 	/** Holds a delegate to be invoked when an incoming connection has been accepted. */
@@ -0,0 +1,53 @@
+#ifndef LOSEMYMIND_PROTOCOLFUZZTEST_H
+#define LOSEMYMIND_PROTOCOLFUZZTEST_H
+
+
+
+#pragma once
+
+#include <random>
+#include <vector>
+#include "Networking/IProtocol.h"
+#include "ClientProtocolDefines.h"
+
+/**
+ * Feeds random packets into IProtocol::DispathStreamProtocol.
+ *
+ * Half of the packets start with a registered protocol id so the handlers
+ * themselves get exercised, the rest are pure noise. Decoding must never
+ * throw or read out of bounds; malformed packets only leave the stream in
+ * its error state.
+ */
+void TestDispathStreamProtocolFuzz(uint32 iterations = 100000, uint32 seed = 0)
+{
+    static const int32 KnownIds[] = { CLIENT_LOGIN, CLIENT_CHAT };
+    static const size_t MaxPacketSize = 256;
+
+    std::mt19937 engine(seed);
+    std::uniform_int_distribution<uint32> byteDist(0, 255);
+    std::uniform_int_distribution<size_t> sizeDist(0, MaxPacketSize);
+
+    std::vector<uint8> packet;
+    DataStream stream;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        packet.resize(sizeDist(engine));
+        for (auto& byte : packet)
+        {
+            byte = (uint8)byteDist(engine);
+        }
+
+        if ((i & 1) && packet.size() >= sizeof(int32))
+        {
+            int32 idx = KnownIds[(i >> 1) % (sizeof(KnownIds) / sizeof(KnownIds[0]))];
+            memcpy(packet.data(), &idx, sizeof(idx));
+        }
+
+        stream.reset(packet.data(), packet.size());
+        // clientID 0 is never handed out, handlers must cope with a missing client.
+        IProtocol::DispathStreamProtocol(0, stream);
+    }
+}
+
+
+#endif // LOSEMYMIND_PROTOCOLFUZZTEST_H
@@ -0,0 +1,119 @@
+#ifndef LOSEMYMIND_SEGMENTEDSENDTEST_H
+#define LOSEMYMIND_SEGMENTEDSENDTEST_H
+
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FoundationKit/Base/SegmentedDataStream.h"
+#include "Networking/TcpSocketBuilder.h"
+
+USING_NS_FK;
+
+/**
+ * Sends a SegmentedDataStream spanning several chunks over a loopback TCP
+ * connection with Socket::SendV, consuming whatever each call wrote, and
+ * checks the receiver gets exactly stream.flatten().
+ *
+ * Then closes the receiving end and keeps sending: SendV must start failing
+ * instead of raising SIGPIPE, which would take the whole process down.
+ *
+ * @return true if both parts passed.
+ */
+bool TestSegmentedSend(uint32 messages = 20000)
+{
+    Socket* listener = TcpSocketBuilder("SegmentedSendTest listener")
+        .AsBlocking()
+        .BoundToAddress(IPv4Address::InternalLoopback)
+        .Listening(1);
+    if (listener == nullptr)
+    {
+        printf("TestSegmentedSend: could not listen on loopback\n");
+        return false;
+    }
+    Socket* sender = TcpSocketBuilder("SegmentedSendTest sender").AsBlocking();
+    IPv4Endpoint endpoint(IPv4Address::InternalLoopback, listener->GetPortNo());
+    if (sender == nullptr || !sender->Connect(*endpoint.ToInternetAddr()))
+    {
+        printf("TestSegmentedSend: could not connect to port %d\n", endpoint.Port);
+        SAFE_DELETE(sender);
+        SAFE_DELETE(listener);
+        return false;
+    }
+    Socket* receiver = listener->Accept("SegmentedSendTest receiver");
+    SAFE_DELETE(listener);
+    if (receiver == nullptr)
+    {
+        printf("TestSegmentedSend: accept failed\n");
+        SAFE_DELETE(sender);
+        return false;
+    }
+    receiver->SetNonBlocking(false);
+
+    SegmentedDataStream stream;
+    for (uint32 i = 0; i < messages; ++i)
+    {
+        stream << i << std::string("segmented payload") << (uint64)i * 7;
+    }
+    ustring expected = stream.flatten();
+    size_t segmentCount = stream.segmentCount();
+
+    // Loopback buffers are smaller than the stream, read while sending.
+    std::string received;
+    std::thread reader([&]()
+    {
+        uint8 buffer[4096];
+        while (received.size() < expected.size())
+        {
+            int32 bytesRead = 0;
+            if (!receiver->Recv(buffer, sizeof(buffer), bytesRead) || bytesRead <= 0)
+                break;
+            received.append((const char*)buffer, bytesRead);
+        }
+    });
+
+    std::vector<IOVec> segments;
+    uint32 sendCalls = 0;
+    while (!stream.empty())
+    {
+        stream.getSegments(segments);
+        int32 bytesSent = 0;
+        if (!sender->SendV(segments.data(), (int32)segments.size(), bytesSent) || bytesSent <= 0)
+            break;
+        stream.consume(bytesSent);
+        ++sendCalls;
+    }
+    reader.join();
+
+    bool bDelivered = stream.empty()
+        && received.size() == expected.size()
+        && memcmp(received.data(), expected.data(), expected.size()) == 0;
+    printf("TestSegmentedSend: %u bytes in %u segments, %u SendV calls, %s\n"
+        , (uint32)expected.size(), (uint32)segmentCount, sendCalls, bDelivered ? "delivered intact" : "MISMATCH");
+
+    // The first writes after the peer closes may still be accepted, the
+    // reset it answers with makes the following ones fail.
+    SAFE_DELETE(receiver);
+    bool bFailed = false;
+    for (uint32 attempt = 0; attempt < 100 && !bFailed; ++attempt)
+    {
+        stream.clear();
+        stream << std::string("to a closed peer");
+        stream.getSegments(segments);
+        int32 bytesSent = 0;
+        bFailed = !sender->SendV(segments.data(), (int32)segments.size(), bytesSent);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    printf("TestSegmentedSend: send to a closed peer %s\n", bFailed ? "failed cleanly" : "never failed");
+    SAFE_DELETE(sender);
+
+    return bDelivered && bFailed;
+}
+
+
+#endif // LOSEMYMIND_SEGMENTEDSENDTEST_H
@@ -0,0 +1,102 @@
+#ifndef LOSEMYMIND_TASKSCHEDULERBENCHMARK_H
+#define LOSEMYMIND_TASKSCHEDULERBENCHMARK_H
+
+
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "FoundationKit/Foundation/TaskScheduler.h"
+
+USING_NS_FK;
+
+// Recursive fibonacci with one task per call above the cutoff: a few
+// hundred nanoseconds of work per task, dominated by scheduling cost.
+static uint64 BenchmarkTaskFib(uint32 n)
+{
+    if (n < 12)
+    {
+        uint64 a = 0, b = 1;
+        for (uint32 i = 0; i < n; ++i)
+        {
+            uint64 next = a + b;
+            a = b;
+            b = next;
+        }
+        return a;
+    }
+    uint64 left = 0;
+    TaskGroup group;
+    group.run([&left, n]()
+    {
+        left = BenchmarkTaskFib(n - 1);
+    });
+    uint64 right = BenchmarkTaskFib(n - 2);
+    group.wait();
+    return left + right;
+}
+
+/**
+ * Scaling of the work stealing scheduler on fine grained tasks.
+ *
+ * Runs the same two workloads with 1, 2, 4 ... workers (plus the calling
+ * thread, which helps while waiting):
+ *   - parallel_for over 4M floats, 1024 elements per piece.
+ *   - a fibonacci task tree, about 28k tasks of a few hundred ns each.
+ * Speedups are relative to the single worker run.
+ */
+void BenchmarkTaskScheduler()
+{
+    typedef std::chrono::steady_clock clock;
+    TaskScheduler* scheduler = TaskScheduler::getInstance();
+    scheduler->stop();
+
+    std::vector<float> values(4 * 1024 * 1024);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = (float)i;
+    }
+
+    uint32 hardwareThreads = std::thread::hardware_concurrency();
+    double baseFor = 0, baseFib = 0;
+    for (uint32 workers = 1; workers < hardwareThreads * 2; workers *= 2)
+    {
+        scheduler->start(workers);
+
+        clock::time_point start = clock::now();
+        for (int repeat = 0; repeat < 10; ++repeat)
+        {
+            parallel_for(0, values.size(), 1024, [&values](size_t i)
+            {
+                values[i] = std::sqrt(values[i] * 1.0001f + 1.0f);
+            });
+        }
+        double forSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        TaskSchedulerStats before = scheduler->getStats();
+        start = clock::now();
+        uint64 fib = BenchmarkTaskFib(30);
+        double fibSeconds = std::chrono::duration<double>(clock::now() - start).count();
+        TaskSchedulerStats after = scheduler->getStats();
+        uint64 tasks = after.executed - before.executed;
+
+        if (workers == 1)
+        {
+            baseFor = forSeconds;
+            baseFib = fibSeconds;
+        }
+        printf("BenchmarkTaskScheduler: %2u workers  parallel_for %7.2fms (x%.2f)  fib(30)=%llu %7.2fms (x%.2f) %.1fM tasks/s, %llu stolen\n"
+            , workers
+            , forSeconds * 1000, baseFor / forSeconds
+            , fib, fibSeconds * 1000, baseFib / fibSeconds
+            , tasks / fibSeconds / 1e6, after.stolen - before.stolen);
+
+        scheduler->stop();
+    }
+}
+
+
+#endif // LOSEMYMIND_TASKSCHEDULERBENCHMARK_H
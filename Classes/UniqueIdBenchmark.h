@@ -0,0 +1,56 @@
+#ifndef LOSEMYMIND_UNIQUEIDBENCHMARK_H
+#define LOSEMYMIND_UNIQUEIDBENCHMARK_H
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "FoundationKit/Foundation/unique_id.hpp"
+
+USING_NS_FK;
+
+/**
+ * Measures unique_id::create() throughput with threadCount threads creating
+ * idsPerThread ids each, then checks that no id was handed out twice.
+ */
+void BenchmarkUniqueId(uint32 threadCount = 8, uint32 idsPerThread = 1000000)
+{
+    typedef std::chrono::steady_clock clock;
+    std::vector<std::vector<uint64> > ids(threadCount);
+    std::vector<std::thread> threads;
+    clock::time_point start = clock::now();
+    for (uint32 t = 0; t < threadCount; ++t)
+    {
+        threads.push_back(std::thread([&ids, t, idsPerThread]()
+        {
+            std::vector<uint64>& out = ids[t];
+            out.resize(idsPerThread);
+            for (uint32 i = 0; i < idsPerThread; ++i)
+            {
+                out[i] = unique_id::create();
+            }
+        }));
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::vector<uint64> all;
+    for (auto& out : ids)
+    {
+        all.insert(all.end(), out.begin(), out.end());
+    }
+    std::sort(all.begin(), all.end());
+    size_t duplicates = all.size() - (std::unique(all.begin(), all.end()) - all.begin());
+    printf("BenchmarkUniqueId: %u threads, %.1fM ids/s, %.1fns per id per thread, %u duplicates\n"
+        , threadCount, all.size() / seconds / 1e6, seconds * 1e9 / idsPerThread, (uint32)duplicates);
+}
+
+
+#endif // LOSEMYMIND_UNIQUEIDBENCHMARK_H
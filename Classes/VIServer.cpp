@@ -4,15 +4,31 @@
 #include <iostream>
 #include <algorithm>
 #include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include "FoundationKit/Base/MathEx.h"
 #include "FoundationKit/Base/DataStream.h"
+#include "FoundationKit/Base/FrameArena.h"
+#include "FoundationKit/Base/SlabAllocator.h"
+#include "FoundationKit/Base/MemoryTracker.h"
+#include "FoundationKit/Base/Metrics.h"
+#include "FoundationKit/Base/ProfiledMutex.h"
+#include "FoundationKit/Base/RequestTracer.h"
+#include "FoundationKit/Base/Timer.h"
+#include "FoundationKit/Platform/Platform.h"
 #include "FoundationKit/Foundation/unique_id.hpp"
+#include "FoundationKit/Foundation/StringUtils.h"
+#include "FoundationKit/Foundation/TaskScheduler.h"
+#include "FoundationKit/Foundation/FrameProfiler.h"
+#include "FoundationKit/Foundation/SamplingProfiler.h"
 #include "Networking/IProtocol.h"
 #include "ConnectionManager.h"
+#include "MetricsExporter.h"
 
 USING_NS_FK;
 
-// һ꣬󶨷ִк
+// һ꣬󶨷ִкᱻ
 #define BIND_COMMAND(FUN) std::bind(&VIServer::FUN,this)
 
 
@@ -30,11 +46,67 @@ int gettimeofday(struct timeval * val, struct timezone *)
     return 0;
 }
 
+// ڴͳƶεļڹĿ¼
+#define STATS_SEGMENT_FILE "VIServer.stats"
+// ͳƵļλ
+#define STATS_PUBLISH_INTERVAL 0.5f
+
+// ÿ֡ʱԤ㣬main.cppsetFrameInterval(1/60.f)һ£λ
+#define FRAME_BUDGET_NANOSECONDS (1000000000LL / 60)
+
+// ѭÿ֡Ĵʱ
+static LatencyHistogram* g_tickTime = Metrics::latency("viserver_tick_nanoseconds", "Time spent in VIServer::update per frame.", "shard=\"main\"");
+// ֡Ԥ֡
+static Counter g_frameOverruns = Metrics::counter("viserver_frame_overruns_total", "Frames whose VIServer::update took longer than the frame budget.");
+
+// ڴͳƺͶͳΪָ굼ȡʱŶȡӷ·Ŀ
+static void registerMetricCollectors()
+{
+    Metrics::addCollector([](std::vector<MetricSample>& out)
+    {
+        std::vector<MemoryTagStats> allStats;
+        MemoryTracker::getStats(allStats);
+        for (auto& stats : allStats)
+        {
+            MetricSample sample;
+            sample.name = "viserver_memory_bytes";
+            sample.help = "Live bytes per memory tag.";
+            sample.labels = StringUtils::format("tag=\"%s\"", stats.name);
+            sample.type = MetricType::Gauge;
+            sample.value = stats.bytes;
+            sample.sum = 0;
+            out.push_back(sample);
+        }
+    });
+
+    Metrics::addCollector([](std::vector<MetricSample>& out)
+    {
+        std::vector<SlabStats> allStats;
+        SlabAllocator::getAllStats(allStats);
+        for (auto& stats : allStats)
+        {
+            MetricSample sample;
+            sample.help = "Objects per slab pool.";
+            sample.type = MetricType::Gauge;
+            sample.sum = 0;
+            sample.name = "viserver_pool_in_use";
+            sample.labels = StringUtils::format("pool=\"%s\"", stats.name.c_str());
+            sample.value = (int64)stats.inUse;
+            out.push_back(sample);
+            sample.name = "viserver_pool_capacity";
+            sample.value = (int64)stats.capacity;
+            out.push_back(sample);
+        }
+    });
+}
+
 // VIServer캯
 VIServer::VIServer()
     :_blaunched(false)
     , _deltaTime(0.0f)
     , _exit(false)
+    , _statsPublishElapsed(0.0f)
+    , _statsPublishing(false)
 {
     _lastUpdate = new struct timeval;
     memset(_lastUpdate, 0, sizeof(timeval));
@@ -52,8 +124,26 @@ void VIServer::setup()
     // Ϣ
     LOG_INFO(">>......");
 
+    // ֡ļ߳ʾ
+    FrameProfiler::setThreadName("main");
+
+    // ̵߳֡ڴҲôҳÿ֡Ŀͻ˿շ
+    FrameArena::getThreadArena().setHugePages(true);
+
+    // ļءϣѹ֮Ĺ߳
+    TaskScheduler::getInstance()->start();
+
+    // עָռڴͶͳָһ
+    registerMetricCollectors();
+
+    // ڴͳƶΣع߶ȡӰ
+    if (!_statsSegment.create(STATS_SEGMENT_FILE))
+    {
+        LOG_WARN(">>޷ͳƶļ[%s]", STATS_SEGMENT_FILE);
+    }
+
     // ˳
-    _commandMap["exit"] = [this]()
+    _commandMap["exit"] = [this](const std::string&)
     {
         this->setExit(true);
     };
@@ -62,6 +152,22 @@ void VIServer::setup()
     _commandMap["start"] = BIND_COMMAND(start);
     // ֹͣ
     _commandMap["stop"] = BIND_COMMAND(stop);
+    // ͳϢ
+    _commandMap["pools"] = BIND_COMMAND(printPools);
+    // ϵͳڴͳϢ
+    _commandMap["memory"] = BIND_COMMAND(printMemory);
+    // ͳϢ
+    _commandMap["tasks"] = BIND_COMMAND(printTasks);
+    // ָ
+    _commandMap["metrics"] = BIND_COMMAND(printMetrics);
+    // ¼֡ݣ profile 5s
+    _commandMap["profile"] = std::bind(&VIServer::profile, this, std::placeholders::_1);
+    // ͼõ۵ջ sample start 1000
+    _commandMap["sample"] = std::bind(&VIServer::sample, this, std::placeholders::_1);
+    // ͳƵĿأ locks on
+    _commandMap["locks"] = std::bind(&VIServer::locks, this, std::placeholders::_1);
+    // ׷٣ traces rate 100traces dump
+    _commandMap["traces"] = std::bind(&VIServer::traces, this, std::placeholders::_1);
 
     // һ̨̣߳
     _readCommandThread = std::thread([this]
@@ -71,8 +177,16 @@ void VIServer::setup()
         // ѭȴ
         while (true)
         {
-            // ȴȡ
-            std::cin >> cmd;
+            // ȴȡһһԴ
+            if (!std::getline(std::cin, cmd))
+            {
+                break;
+            }
+            StringUtils::trim(cmd);
+            if (cmd.empty())
+            {
+                continue;
+            }
             // ̻߳ȥȡִ
             pushMessage(cmd);
 
@@ -93,24 +207,27 @@ void VIServer::setup()
 // º
 void VIServer::update(bool& bExit)
 {
+    int64 tickStart = Timer::nowNanoseconds();
+
     // һ֡һܹ֡˶ʱ
     calculateDeltaTime();
 
-    // ס_commandList̷߳Դռ
-    std::unique_lock<std::mutex> lock(_commandMutex);
-    // бһʱ_readCommandThread߳̿Լ
-    std::list<std::string> copyCommand = _commandList;
-    // Ѿʱбˡ
-    _commandList.clear();
-    // _commandList_readCommandThread߳̿Է
-    lock.unlock();
-
-    // бִӦĺ
-    for (auto cmd : copyCommand)
+    // ȡдִеִӦĺ
+    // ģ_readCommandThread߳дʱ̡߳
+    std::string cmd;
     {
-        if (_commandMap.find(cmd) != _commandMap.end())
+        PROFILE_SCOPE("VIServer::commands");
+        while (_commandQueue.tryPop(cmd))
         {
-            _commandMap[cmd]();
+            // һո֮ǰ֮ǲ
+            size_t separator = cmd.find(' ');
+            std::string name = cmd.substr(0, separator);
+            std::string args = separator == std::string::npos ? std::string() : cmd.substr(separator + 1);
+            auto iterFind = _commandMap.find(name);
+            if (iterFind != _commandMap.end())
+            {
+                iterFind->second(StringUtils::trim(args));
+            }
         }
     }
 
@@ -120,6 +237,32 @@ void VIServer::update(bool& bExit)
     // ӹĸº
     ConnectionManager::getInstance()->update(_deltaTime);
 
+    // ͻϢ֮ٴָץȡÿ֡й̶Ԥ㡣
+    MetricsExporter::getInstance()->update();
+
+    {
+        PROFILE_SCOPE("VIServer::housekeeping");
+        // ֡ʱݵȫʧЧһͷš
+        FrameArena::getThreadArena().reset();
+    }
+
+    int64 tickEnd = Timer::nowNanoseconds();
+    g_tickTime->record(tickEnd - tickStart);
+
+    // Ȿ֡Ƿ񳬳Ԥ㣬¼еķҲʱ֡
+    if (FrameProfiler::endFrame(tickStart, tickEnd, FRAME_BUDGET_NANOSECONDS))
+    {
+        g_frameOverruns.increment();
+        LOG_RATE_LIMITED(Logger::Level::LV_WARN, 1, ">>֡ʱ֡ʱ[%.2fms]Ԥ[%.2fms]"
+            , (tickEnd - tickStart) / 1e6, FRAME_BUDGET_NANOSECONDS / 1e6);
+    }
+
+    // ¼ʱ䵽˾ͽ¼ƣڹ߳дļ
+    FrameProfiler::update();
+
+    // ͳƣĹڹ߳ɡ
+    publishStats();
+
 }
 
 // һ֡һִ֡еʱ䡣
@@ -138,11 +281,29 @@ void VIServer::calculateDeltaTime()
     *_lastUpdate = timeNow;
 }
 
+// ͳƵڴͳƶ
+void VIServer::publishStats()
+{
+    _statsPublishElapsed += _deltaTime;
+    if (!_statsSegment.isOpen() || _statsPublishElapsed < STATS_PUBLISH_INTERVAL)
+        return;
+    // һηûɾͳƶֻһдߡ
+    if (_statsPublishing.exchange(true, std::memory_order_acquire))
+        return;
+    _statsPublishElapsed = 0.0f;
+    TaskScheduler::getInstance()->submit([this]()
+    {
+        std::vector<MetricSample> samples;
+        Metrics::getSnapshot(samples);
+        _statsSegment.publish(samples);
+        _statsPublishing.store(false, std::memory_order_release);
+    });
+}
+
 // ̨
 void VIServer::pushMessage(std::string& comMsg)
 {
-    std::lock_guard<std::mutex>  lock(_commandMutex);
-    _commandList.push_back(comMsg);
+    _commandQueue.push(comMsg);
 }
 
 // ÷Ƿ˳
@@ -164,17 +325,256 @@ void VIServer::start()
     if (!_blaunched)
     {
         ConnectionManager::getInstance()->Startup();
+        // ָ굼ṩ /metrics  /connections
+        MetricsExporter::getInstance()->Startup();
     }
 
     _blaunched = true;
 }
 
+// жصͳϢ
+void VIServer::printPools()
+{
+    std::vector<SlabStats> allStats;
+    SlabAllocator::getAllStats(allStats);
+    LOG_INFO(">>ͳƣ");
+    for (auto& stats : allStats)
+    {
+        LOG_INFO(">>  %s: object[%u bytes] inUse[%u] peak[%u] capacity[%u] slabs[%u] hugePageSlabs[%u] allocations[%llu] frees[%llu]"
+            , stats.name.c_str(), (uint32)stats.objectSize, (uint32)stats.inUse, (uint32)stats.peakInUse
+            , (uint32)stats.capacity, (uint32)stats.slabCount, (uint32)stats.hugePageSlabs, stats.allocations, stats.frees);
+    }
+}
+
+// ϵͳڴͳϢ
+void VIServer::printMemory()
+{
+    std::vector<MemoryTagStats> allStats;
+    MemoryTracker::getStats(allStats);
+    LOG_INFO(">>ڴͳƣܼ[%.2f MB]", Platform::getProcessMemory());
+    for (auto& stats : allStats)
+    {
+        LOG_INFO(">>  %s: bytes[%lld] allocations[%lld] peak[%lld]"
+            , stats.name, stats.bytes, stats.allocations, stats.peakBytes);
+    }
+}
+
+// ͳϢ
+void VIServer::printTasks()
+{
+    TaskSchedulerStats stats = TaskScheduler::getInstance()->getStats();
+    LOG_INFO(">>workers[%u] executed[%llu] stolen[%llu] injected[%llu]"
+        , stats.workerCount, stats.executed, stats.stolen, stats.injected);
+}
+
+// ֱָ꣬ͼƽֵӳͳٷλ
+void VIServer::printMetrics()
+{
+    std::vector<MetricSample> samples;
+    Metrics::getSnapshot(samples);
+    LOG_INFO(">>ָ꣺");
+    for (auto& sample : samples)
+    {
+        std::string name = sample.labels.empty() ? sample.name : sample.name + "{" + sample.labels + "}";
+        if (sample.type == MetricType::Summary)
+        {
+            LOG_INFO(">>  %s: count[%lld] p50[%lld] p90[%lld] p99[%lld] p999[%lld] max[%lld]", name.c_str(), sample.value
+                , sample.quantileValues[0], sample.quantileValues[1], sample.quantileValues[2], sample.quantileValues[3], sample.quantileValues[4]);
+        }
+        else if (sample.type == MetricType::Histogram)
+        {
+            LOG_INFO(">>  %s: count[%lld] avg[%.1f]", name.c_str(), sample.value
+                , sample.value > 0 ? (double)sample.sum / sample.value : 0.0);
+        }
+        else
+        {
+            LOG_INFO(">>  %s: %lld", name.c_str(), sample.value);
+        }
+    }
+}
+
+// ¼֡ݣʱ5s500msֻдĬ5
+void VIServer::profile(const std::string& args)
+{
+    double seconds = 5.0;
+    if (!args.empty())
+    {
+        char* end = nullptr;
+        double value = strtod(args.c_str(), &end);
+        std::string unit = end;
+        if (unit == "ms")
+            value /= 1000.0;
+        else if (!unit.empty() && unit != "s")
+            value = 0;
+        seconds = value;
+    }
+    if (seconds <= 0 || seconds > 60)
+    {
+        LOG_WARN(">>Ч¼ʱ[%s]Ӧ060֮䣬 profile 5s", args.c_str());
+        return;
+    }
+    if (!FrameProfiler::startCapture(seconds))
+    {
+        LOG_WARN(">>һ֡ûн");
+        return;
+    }
+    LOG_INFO(">>ʼ¼֡ݣʱ[%.2fs]", seconds);
+}
+
+// ĿغͲƵʣֹͣڲ߳д samples_<ʱ>.folded
+void VIServer::sample(const std::string& args)
+{
+    SamplingProfiler* profiler = SamplingProfiler::getInstance();
+    if (args.compare(0, 5, "start") == 0)
+    {
+        uint32 samplesPerSecond = SamplingProfiler::MAX_SAMPLES_PER_SECOND;
+        if (args.size() > 5)
+        {
+            samplesPerSecond = static_cast<uint32>(strtoul(args.c_str() + 5, nullptr, 10));
+        }
+        if (samplesPerSecond == 0 || samplesPerSecond > SamplingProfiler::MAX_SAMPLES_PER_SECOND)
+        {
+            LOG_WARN(">>ЧĲƵ[%s]Ӧ1%u֮", args.c_str() + 5, SamplingProfiler::MAX_SAMPLES_PER_SECOND);
+            return;
+        }
+        if (!profiler->start(samplesPerSecond))
+        {
+            LOG_WARN(">>ѾУһεĽûд");
+            return;
+        }
+        LOG_INFO(">>ʼÿ[%u]", samplesPerSecond);
+    }
+    else if (args == "stop")
+    {
+        if (!profiler->stop())
+        {
+            LOG_WARN(">>û");
+        }
+    }
+    else
+    {
+        SamplingProfilerStats stats = profiler->getStats();
+        LOG_INFO(">>%s rate[%u] samples[%llu] dropped[%llu] stacks[%u]", profiler->isRunning() ? "" : "δ"
+            , stats.samplesPerSecond, stats.samples, stats.dropped, stats.stacks);
+        LOG_INFO(">>÷sample start [ÿ]sample stop");
+    }
+}
+
+// 򿪻رͳƣʱÿĻȡôȴͳʱ
+void VIServer::locks(const std::string& args)
+{
+    if (args == "on" || args == "off")
+    {
+        ProfiledMutex::setProfiling(args == "on");
+        LOG_INFO(">>ͳ%s", args == "on" ? "" : "ر");
+        return;
+    }
+
+    std::vector<MetricSample> samples;
+    Metrics::getSnapshot(samples);
+    LOG_INFO(">>ͳƣ%s", ProfiledMutex::isProfiling() ? "" : "رգ locks on ");
+    for (auto& sample : samples)
+    {
+        if (sample.name.compare(0, 14, "viserver_lock_") != 0)
+            continue;
+        if (sample.type == MetricType::Summary)
+        {
+            LOG_INFO(">>  %s{%s}: count[%lld] p50[%lld] p99[%lld] max[%lld]", sample.name.c_str(), sample.labels.c_str()
+                , sample.value, sample.quantileValues[0], sample.quantileValues[2], sample.quantileValues[4]);
+        }
+        else
+        {
+            LOG_INFO(">>  %s{%s}: %lld", sample.name.c_str(), sample.labels.c_str(), sample.value);
+        }
+    }
+}
+
+// ׷٣òʡ׷ٻдCSV߰׷IDһĸ׶κʱ
+void VIServer::traces(const std::string& args)
+{
+    if (args.compare(0, 4, "rate") == 0)
+    {
+        const char* number = args.c_str() + 4;
+        while (*number == ' ')
+            ++number;
+        char* end = nullptr;
+        unsigned long long value = strtoull(number, &end, 10);
+        // ˵Ĳܵ0Ѳص
+        if (*number < '0' || *number > '9' || *end != '\0' || value > 0xFFFFFFFFull)
+        {
+            LOG_WARN(">>ЧĲ[%s]÷traces rate NNΪ0ֻ׷ٴ׷ID", number);
+            return;
+        }
+        uint32 oneIn = static_cast<uint32>(value);
+        RequestTracer::setSampleRate(oneIn);
+        if (oneIn == 0)
+            LOG_INFO(">>ֻ׷ٿͻ˴׷ID");
+        else
+            LOG_INFO(">>ÿ[%u]׷һ", oneIn);
+        return;
+    }
+
+    std::vector<RequestTrace> traces;
+    if (args == "dump")
+    {
+        RequestTracer::getTraces(traces);
+        std::string csv;
+        RequestTracer::writeCsv(traces, csv);
+        std::string path = StringUtils::format("traces_%lld.csv", (long long)time(nullptr));
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            LOG_ERROR("***** ޷д׷ļ[%s]", path.c_str());
+            return;
+        }
+        fwrite(csv.data(), 1, csv.size(), file);
+        fclose(file);
+        LOG_INFO(">>[%u]׷д[%s]", (uint32)traces.size(), path.c_str());
+        return;
+    }
+
+    if (!args.empty())
+    {
+        char* end = nullptr;
+        uint64 traceId = strtoull(args.c_str(), &end, 10);
+        // ׷IDΪ0ȡ
+        if (traceId == 0 || *end != '\0' || args[0] < '0' || args[0] > '9')
+        {
+            LOG_WARN(">>Ч׷ID[%s]÷traces rate Ntraces dumptraces ׷ID", args.c_str());
+            return;
+        }
+        RequestTracer::getTraces(traces, traceId);
+        if (traces.empty())
+        {
+            LOG_WARN(">>׷ٻû׷ID[%s]", args.c_str());
+            return;
+        }
+        // ׶εʱ䶼յʱ䣬δĽ׶Ϊ -1
+        for (auto& trace : traces)
+        {
+            int64 received = trace.stages[(uint32)TraceStage::Received];
+            int64 stages[(uint32)TraceStage::Count];
+            for (uint32 i = 0; i < (uint32)TraceStage::Count; ++i)
+                stages[i] = trace.stages[i] != 0 ? (trace.stages[i] - received) / 1000 : -1;
+            LOG_INFO(">>׷[%llu] client[%llu] protocol[%d] dispatched[%lldus] handled[%lldus] sent[%lldus]"
+                , trace.traceId, trace.clientId, trace.protocolId
+                , stages[(uint32)TraceStage::Dispatched], stages[(uint32)TraceStage::Handled], stages[(uint32)TraceStage::Sent]);
+        }
+        return;
+    }
+
+    LOG_INFO(">>׷٣ÿ[%u]׷һ0Ϊֻ׷ٴ׷ID Ѽ¼[%llu] [%u]", RequestTracer::getSampleRate()
+        , RequestTracer::getRecordedCount(), RequestTracer::CAPACITY);
+    LOG_INFO(">>÷traces rate Ntraces dumptraces ׷IDҲԷ http://127.0.0.1:4160/traces");
+}
+
 // ֹͣ
 void VIServer::stop()
 {
     LOG_INFO(">>ֹͣ......");
     _blaunched = false;
     ConnectionManager::getInstance()->Shutdown();
+    MetricsExporter::getInstance()->Shutdown();
 
 }
 
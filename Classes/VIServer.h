@@ -9,20 +9,22 @@
 #pragma once
 // ߳̿
 #include <thread>
-// 
-#include <mutex>
-// 
-#include <list>
+// ԭӲ
+#include <atomic>
 // ַ
 #include <string>
-// unordered_map
-#include <unordered_map>
 // 
 #include <functional>
 // ƽ̨
 #include "FoundationKit/GenericPlatformMacros.h"
 // ģ
 #include "FoundationKit/Foundation/Singleton.h"
+// Ѱַϣ
+#include "FoundationKit/Base/FlatHashMap.h"
+// 
+#include "FoundationKit/Base/LockFreeQueue.h"
+// ڴͳƶ
+#include "FoundationKit/Base/StatsSegment.h"
 // TCPӼ
 #include "Networking/TcpListener.h"
 // IPv4 ַ
@@ -43,7 +45,8 @@ class VIServer : public Singleton<VIServer>
     friend Singleton<VIServer>;
 public:
     // ̨бִеĺ
-    typedef std::unordered_map<std::string, std::function<void()> > CommandMap;
+    // ΪҪ
+    typedef FlatHashMap<std::string, std::function<void(const std::string&)>, StringHash, StringEqual> CommandMap;
 
     // VIServerִڴͷš
     ~VIServer();
@@ -54,7 +57,7 @@ public:
     // ·߼
     void update(bool& bExit);
 
-    // ̨浽 _commandList, ߳
+    // ̨浽 _commandQueue, ߳
     // ȥȡЩȥִ.
     void pushMessage(std::string& comMsg);
 
@@ -68,11 +71,36 @@ public:
     void start();
     // ֹͣ
     void stop();
+    // ͳϢ
+    void printPools();
+    // ϵͳڴͳϢ
+    void printMemory();
+
+    // ͳϢ
+    void printTasks();
+
+    // ָ
+    void printMetrics();
+
+    // ¼һʱ֡ݣChrome traceļΪʱ 5s500ms
+    void profile(const std::string& args);
+
+    // sample start [ÿ]sample stopsample ״̬
+    void sample(const std::string& args);
+
+    // ͳƣlocks onlocks offͳ
+    void locks(const std::string& args);
+
+    // ׷٣traces rate N òʣtraces dump дCSVtraces ׷ID һ
+    void traces(const std::string& args);
     
 private:
     // ÿ֡еʱ
     void calculateDeltaTime();
 
+    // ڰָ귢ڴͳƶ
+    void publishStats();
+
     // ǷѾ
     bool  _blaunched;
 
@@ -85,11 +113,8 @@ private:
     // _exitΪtrue,˳
     bool            _exit;
 
-    // ̨ڿƷ
-    std::list<std::string> _commandList;
-
-    // 󣬱֤_commandList̰߳ȫġ
-    std::mutex             _commandMutex;
+    // ̨ڿƷ_readCommandThreadд룬̶߳ȡ
+    MpscQueue<std::string> _commandQueue;
 
     // ϣ¼ֵ֧Ѿִеķ
     CommandMap             _commandMap;
@@ -97,6 +122,15 @@ private:
     // ڶȡ̨̡߳
     std::thread            _readCommandThread;
 
+    // ڴͳƶΣⲿعߣTools/StatsMonitorֻӳ䡣
+    StatsSegment           _statsSegment;
+
+    // ϴηͳƾʱ䣬λ롣
+    float                  _statsPublishElapsed;
+
+    // Ƿڹ߳С
+    std::atomic<bool>      _statsPublishing;
+
 };
 
 
@@ -0,0 +1,102 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+// Decodes a binary log written by Logger::setBinaryLogFile() into text.
+//
+// Build together with FoundationKit/Foundation/BinaryLog.cpp, with Classes/
+// on the include path, e.g.
+//     cl /EHsc /I..\..\Classes main.cpp ..\..\Classes\FoundationKit\Foundation\BinaryLog.cpp
+//
+// Usage: LogDecoder <binary log> [output file]
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "FoundationKit/Foundation/BinaryLog.h"
+
+USING_NS_FK;
+
+static const char* LevelMsg[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <binary log> [output file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* input = fopen(argv[1], "rb");
+    if (input == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    FILE* output = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (output == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        fclose(input);
+        return 1;
+    }
+
+    std::unordered_map<uint32, std::string> formats;
+    std::vector<uint8> payload;
+    std::string line;
+    RecordHeader header;
+    size_t records = 0;
+    while (fread(&header, sizeof(header), 1, input) == 1)
+    {
+        if (header.size < sizeof(header) || header.length > header.size - sizeof(header))
+        {
+            fprintf(stderr, "Corrupted record after %u records\n", (uint32)records);
+            break;
+        }
+        payload.resize(header.size - sizeof(header));
+        if (!payload.empty() && fread(&payload[0], payload.size(), 1, input) != 1)
+            break;
+        ++records;
+
+        uint32 formatId = 0;
+        if (header.length >= sizeof(uint32))
+            memcpy(&formatId, &payload[0], sizeof(uint32));
+        const char* level = header.level < sizeof(LevelMsg) / sizeof(LevelMsg[0]) ? LevelMsg[header.level] : "?";
+
+        if ((header.kind == RK_FORMAT || header.kind == RK_BINARY) && header.length < sizeof(uint32))
+            continue;
+
+        line.clear();
+        switch (header.kind)
+        {
+        case RK_FORMAT:
+            formats[formatId].assign((const char*)&payload[sizeof(uint32)], header.length - sizeof(uint32));
+            continue;
+        case RK_TEXT:
+            line.append(level).append(":").append((const char*)payload.data(), header.length);
+            break;
+        case RK_BINARY:
+        {
+            line.append(level).append(":");
+            auto iter = formats.find(formatId);
+            if (iter == formats.end())
+                line.append("<unknown format id>");
+            else
+                BinaryLog::format(iter->second.c_str(), &payload[sizeof(uint32)], header.length - sizeof(uint32), line);
+            break;
+        }
+        default:
+            continue;
+        }
+        fprintf(output, "%s\n", line.c_str());
+    }
+
+    fclose(input);
+    if (output != stdout)
+        fclose(output);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/****************************************************************************
+  Copyright (c) 2016 libo All rights reserved.
+
+  losemymind.libo@gmail.com
+
+****************************************************************************/
+
+// Live top-style view of the stats segment VIServer publishes.
+//
+// The segment is mapped read only and read under its seqlock, the server
+// never notices the monitor. Rates are computed here from two consecutive
+// publishes.
+//
+// Build together with FoundationKit/Base/StatsSegment.cpp, with Classes/
+// on the include path, e.g.
+//     cl /EHsc /I..\..\Classes main.cpp ..\..\Classes\FoundationKit\Base\StatsSegment.cpp
+//
+// Usage: StatsMonitor [segment file] [refresh ms] [filter]
+//   segment file  defaults to VIServer.stats in the current directory
+//   refresh ms    defaults to 1000
+//   filter        only show metrics whose name contains it
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "FoundationKit/Base/StatsSegment.h"
+
+USING_NS_FK;
+
+static const char* TypeNames[] = { "counter", "gauge", "histogram", "summary" };
+
+static void clearScreen()
+{
+#if (TARGET_PLATFORM == PLATFORM_WIN32)
+    system("cls");
+#else
+    printf("\033[2J\033[H");
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "VIServer.stats";
+    int refreshMs = argc > 2 ? atoi(argv[2]) : 1000;
+    const char* filter = argc > 3 ? argv[3] : nullptr;
+    if (refreshMs <= 0)
+        refreshMs = 1000;
+
+    StatsSegment segment;
+    StatsSegmentInfo info;
+    std::vector<StatsSegmentEntry> entries;
+    std::unordered_map<std::string, int64> previousValues;
+    std::unordered_map<std::string, double> rates;
+    uint64 previousPublishCount = 0;
+    int64 previousPublishTime = 0;
+    while (true)
+    {
+        if (!segment.isOpen() && !segment.openReadOnly(path))
+        {
+            clearScreen();
+            printf("Waiting for %s ...\n", path.c_str());
+            std::this_thread::sleep_for(std::chrono::milliseconds(refreshMs));
+            continue;
+        }
+        if (!segment.read(info, entries))
+        {
+            // The writer kept it busy, try again next refresh.
+            std::this_thread::sleep_for(std::chrono::milliseconds(refreshMs));
+            continue;
+        }
+
+        int64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        // Rates only move when the server published again, the screen may
+        // refresh faster than that.
+        if (info.publishCount != previousPublishCount)
+        {
+            double interval = (info.publishTime - previousPublishTime) / 1000.0;
+            for (auto& entry : entries)
+            {
+                std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+                auto iter = previousValues.find(name);
+                if (previousPublishCount != 0 && iter != previousValues.end() && interval > 0)
+                    rates[name] = (entry.value - iter->second) / interval;
+                previousValues[name] = entry.value;
+            }
+            previousPublishCount = info.publishCount;
+            previousPublishTime = info.publishTime;
+        }
+
+        clearScreen();
+        printf("VIServer pid %u  published %.1fs ago  #%llu  %u/%u metrics%s\n\n"
+            , info.processId, (now - info.publishTime) / 1000.0, info.publishCount
+            , (uint32)entries.size(), info.capacity
+            , now - info.publishTime > 5000 ? "  (STALE)" : "");
+        printf("%-60s %-9s %14s %12s %12s %12s %12s %12s\n", "metric", "type", "value", "rate/s", "p50", "p99", "p999", "max");
+        for (auto& entry : entries)
+        {
+            std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+            if (filter != nullptr && name.find(filter) == std::string::npos)
+                continue;
+            const char* type = entry.type < 4 ? TypeNames[entry.type] : "?";
+            auto rate = rates.find(name);
+            if (entry.type == (uint32)MetricType::Counter)
+            {
+                if (rate != rates.end())
+                    printf("%-60s %-9s %14lld %12.1f\n", name.c_str(), type, entry.value, rate->second);
+                else
+                    printf("%-60s %-9s %14lld %12s\n", name.c_str(), type, entry.value, "-");
+            }
+            else if (entry.type == (uint32)MetricType::Gauge)
+            {
+                printf("%-60s %-9s %14lld\n", name.c_str(), type, entry.value);
+            }
+            else
+            {
+                printf("%-60s %-9s %14lld %12.1f %12lld %12lld %12lld %12lld\n"
+                    , name.c_str(), type, entry.value, rate != rates.end() ? rate->second : 0.0
+                    , entry.p50, entry.p99, entry.p999, entry.max);
+            }
+        }
+        fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::milliseconds(refreshMs));
+    }
+    return 0;
+}